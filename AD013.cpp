@@ -14,10 +14,33 @@
 // for meaningful output across boards
 #include <LibPrintf.h>
 
-// Global Definitions
-#define AD013_MSG_HEADER_SIZE     10
-#define AD013_MAX_ACK_BUFF_SIZE   20
-#define AD013_MAX_BIN_BUFF_SIZE  128
+// Used for changing the baud rate while
+// scanning for the sensor
+#include <SoftwareSerial.h>
+
+// Link Records Storage
+#if defined(AD013_USE_EEPROM)
+#include <EEPROM.h>
+#elif defined(__linux__) && defined(AD013_LINK_FILE)
+#include <stdio.h>
+#endif
+
+// Memory-Mapped Sink (host builds)
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The library never allocates from the heap: frames are built in fixed
+// size buffers and responses are decoded into caller-owned storage. Any
+// (re)introduced heap call fails to compile.
+#pragma GCC poison malloc calloc realloc free
+
+// Message Header
+#define AD013_MSG_HEADER_HI     0xEF
+#define AD013_MSG_HEADER_LO     0x01
 
 // Message Offsets
 #define AD013_MSG_OFFSET_HEADER    0
@@ -27,6 +50,9 @@
 #define AD013_MSG_OFFSET_CODE      9
 #define AD013_MSG_OFFSET_DATA     10
 
+// Command Frame (header, code, params and sum)
+#define AD013_MAX_FRAME_SIZE     (AD013_MSG_OFFSET_CODE + 1 + AD013_MAX_PARAMS_SIZE + 2)
+
 // Debugging Messaging
 #ifdef AD013_DEBUG
 #define AD013_DEBUG_IS_ENABLED     1
@@ -83,60 +109,53 @@ typedef enum {
 
 // Defaults
 char AD013_def_passwd[4] = { 0x00 };
-char AD013_def_devid[4] = { 0xFF };
+char AD013_def_devid[4] = { (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF };
 
 // Global Variables
 AD013_Params AD013_DefaultParams = {
-  { 0xFF, 0xFF, 0xFF, 0xFF }, // Default DeviceID
   { 0x00 },  // Zero-Padded Empty Params
+  { (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF }, // Default DeviceID
   0          // Param Length (Zero is Empty)
 };
 
-// Global Variable(s)
-static const char msgTemplate[10] = {
-  0xEF, 0x01,             /* Header */
-  0xFF, 0xFF, 0xFF, 0xFF, /* Device ID */
-  0x01,                   /* Flag */
-  0x00, 0x03,             /* Data Length (Code/Data + Sum) */
-  0x00                    /* Code/Data */
-  /* Sum (char[2]) Omitted from the Template */
+// Default Transaction Policy (new contexts)
+static AD013_Policy AD013_defPolicy = {
+  0,                      // No Deadline
+  AD013_DEFAULT_TIMEOUT,  // Per-Reply Timeout
+  AD013_DEFAULT_RETRIES,
+  AD013_DEFAULT_BACKOFF
 };
 
+// Frame Builder. The frame is statically sized (header, max params
+// and sum) and the sum is updated as bytes are written, so building
+// and sending a command never touches the heap.
+typedef struct frame_st {
+  byte     buff[AD013_MAX_FRAME_SIZE];
+  uint16_t size;
+  uint16_t sum;
+} AD013_Frame;
+
 
                         // =============================
                         // Internal Functions Prototypes
                         // =============================
 
 uint16_t AD013_get_uint16_value(char * val);
+uint32_t AD013_get_uint32_value(const char * val);
 void AD013_set_uint16_value(char * buff, uint16_t val);
 
-int AD013_AddParam1(AD013_Params * params, uint8_t val);
-int AD013_AddParam2(AD013_Params * params, uint16_t val);
 int AD013_AddParamN(AD013_Params * params, char * buff, uint8_t size);
 
-int AD013_Send (int           code,
-              Stream     &  SensorCom,
-              AD013_Params *  params             = NULL,
-              byte       ** recv_data_buff     = NULL,
-              int        *  recv_data_buff_len = NULL);
-              
-int AD013_Recv(char * data, int data_len);
+void AD013_FrameBegin(AD013_Frame * frame, const char * devId, uint8_t flag);
+void AD013_FramePut(AD013_Frame * frame, uint8_t val);
+void AD013_FramePutN(AD013_Frame * frame, const char * buff, int size);
+int AD013_FrameEnd(AD013_Frame * frame);
+
+int AD013_AckCode(AD013_Parser * parser, const char * devId);
 
 #define AD013_ClearParams(a) \
   (a)->size = 0
 
-#define PS_VerifyPwd(a,b) \
-  AD013_Send(0x13,a,b)
-
-#define PS_GetImage(a) \
-  AD013_Send(0x01,a)
-
-#define PS_GenChar(a,b) \
-  AD013_Send(0x02,a,b)
-
-#define PS_Search(a,b,c,d) \
-  AD013_Send(0x04,a,b,c,d)
-
                         // =============================
                         // Fingerprint Utility Functions
                         // =============================
@@ -152,6 +171,11 @@ uint16_t AD013_get_uint16_value(char * val) {
   return ret;
 }
 
+uint32_t AD013_get_uint32_value(const char * val) {
+  return ((uint32_t)(byte) val[0] << 24) | ((uint32_t)(byte) val[1] << 16) |
+         ((uint32_t)(byte) val[2] << 8)  |  (uint32_t)(byte) val[3];
+}
+
 void AD013_set_uint16_value(char * buff, uint16_t val) {
   
   byte * pnt1 = (byte *) &val;
@@ -163,415 +187,4119 @@ void AD013_set_uint16_value(char * buff, uint16_t val) {
   *((byte *)(buff + 1)) = (byte) *pnt1;
 }
 
-
-int AD013_AddParam1(AD013_Params * params, uint8_t val) {
-  if (!params || params->size > AD013_MAX_PARAMS_SIZE - 1)
+int AD013_AddParamN(AD013_Params * params, char * buff, uint8_t size) {
+  if (!params || !buff || params->size > AD013_MAX_PARAMS_SIZE - size)
     return -1;
 
-  // Fixes the value of the size
-  if (params->size < 0) params->size = 0;
+   memcpy(params->buff + params->size, buff, size);
+   params->size += size;
+      
+   return params->size;
+}
+
+                        // =======================
+                        // Frame Encoding Functions
+                        // =======================
 
-  // Stores the uint16_t param by reverting the
-  // order of the bytes
-  params->buff[params->size++] = val;
-  return params->size;
+void AD013_FrameBegin(AD013_Frame * frame, const char * devId, uint8_t flag) {
+
+  // Header and Device ID are not part of the sum
+  frame->buff[AD013_MSG_OFFSET_HEADER]     = AD013_MSG_HEADER_HI;
+  frame->buff[AD013_MSG_OFFSET_HEADER + 1] = AD013_MSG_HEADER_LO;
+  memcpy(frame->buff + AD013_MSG_OFFSET_DEVID, devId, 4);
+
+  // The Flag is the first summed byte
+  frame->buff[AD013_MSG_OFFSET_FLAG] = flag;
+  frame->sum = flag;
+
+  // Length is filled in by AD013_FrameEnd()
+  frame->size = AD013_MSG_OFFSET_CODE;
 }
 
-int AD013_AddParam2(AD013_Params * params, uint16_t val) {
-  char * pnt = (char *)&val;
-  if (!params || params->size > AD013_MAX_PARAMS_SIZE - 2)
-    return -1;
+void AD013_FramePut(AD013_Frame * frame, uint8_t val) {
+  // Leaves room for the sum
+  if (frame->size > AD013_MAX_FRAME_SIZE - 3) return;
+  frame->buff[frame->size++] = val;
+  frame->sum += val;
+}
+
+void AD013_FramePutN(AD013_Frame * frame, const char * buff, int size) {
+  for (int i = 0; i < size; i++) AD013_FramePut(frame, (uint8_t) buff[i]);
+}
+
+int AD013_FrameEnd(AD013_Frame * frame) {
 
-  // Fixes the value of the size
-  if (params->size < 0) params->size = 0;
+  // Packet Length [Code/Data (Var) + Sum (2)]
+  uint16_t len = frame->size - AD013_MSG_OFFSET_CODE + 2;
 
-  // Stores the uint16_t param by reverting the
-  // order of the bytes
-  params->buff[params->size++] = *(pnt + 1);
-  params->buff[params->size++] = *(pnt);
+  AD013_set_uint16_value((char *)frame->buff + AD013_MSG_OFFSET_LENGTH, len);
+  frame->sum += (len >> 8) + (len & 0xFF);
 
-  return params->size;
+  // Appends the Sum
+  AD013_set_uint16_value((char *)frame->buff + frame->size, frame->sum);
+  frame->size += 2;
+
+  return frame->size;
 }
 
-int AD013_AddParamN(AD013_Params * params, char * buff, uint8_t size) {
-  char * pnt = buff;
-  if (!params || !buff || params->size > AD013_MAX_PARAMS_SIZE - size)
+int AD013_AckCode(AD013_Parser * parser, const char * devId) {
+
+  // Let's check the reply comes from the addressed device
+  if (memcmp(devId, parser->devId, sizeof(parser->devId)) != 0)
     return -1;
 
-   memcpy(params->buff + params->size, buff, size);
-   params->size += size;
-      
-   return params->size;
+  // Gets the Code from the received message
+  return parser->payload[0];
 }
 
-int AD013_Send (int           code,
-              Stream     &  Sensorcom, 
-              AD013_Params *  params,
-              byte       ** recv_data_buff,
-              int        *  recv_data_buff_len) {
+                        // =================
+                        // Metrics Functions
+                        // =================
 
-  // Receive Buffer
-  char     recv_buff[20] = { 0x00 };
-  uint16_t recv_buff_len = 0;
-  int      recv_code     = -1;
+#if AD013_METRICS
+
+static AD013_Metrics AD013_metrics;
+
+// Tracked opcodes (AD013_Metrics::ops order)
+static const uint8_t AD013_metricsOps[AD013_METRICS_OPCODES] = {
+  0x01, 0x02, 0x03, 0x04, 0x13, 0x1F, 0x32, AD013_METRICS_OTHER
+};
+
+static AD013_OpMetrics * AD013_MetricsOp(uint8_t code) {
 
-  int read_chars = 0;
   int i = 0;
-  
-  uint16_t len = 0;
-  uint16_t sum = 0;
-  uint16_t max_retries = 5;
-  
-  // Small Checks
-  if ((params != NULL) && (params->buff == NULL || params->size < 1))
-    return -1;
 
-  // Send Buffer Size
-  int send_buff_len = 12 + (params != NULL ? params->size : 0);
+  // Fixed set, the last slot takes all the other opcodes
+  while (i < AD013_METRICS_OPCODES - 1 && AD013_metricsOps[i] != code) i++;
+
+  return &AD013_metrics.ops[i];
+}
 
-  // Allocates the needed Memory
-  char * send_buff = (char *) malloc(send_buff_len);
+static void AD013_MetricsSent(uint8_t code) {
+  AD013_MetricsOp(code)->calls++;
+}
 
-  // Sets the Defaults
-  memcpy(send_buff, msgTemplate, sizeof(msgTemplate));
+static void AD013_MetricsReply(uint8_t code, int ret, int result,
+                               bool partial, long rttUs) {
 
-  // Sets the right message code
-  send_buff[AD013_MSG_OFFSET_CODE] = (uint8_t) code;
+  AD013_Metrics * m = &AD013_metrics;
 
-  if ((params != NULL) && (params->size > 0)) {
-    memcpy(send_buff + AD013_MSG_OFFSET_DATA, params->buff, params->size);
+  if (ret == AD013_PARSE_BAD_SUM) {
+    m->badSums++;
+    return;
   }
 
-  // Sets the Packet Length [Code (1) + Sum (2) + params_len (Var)]
-  len = 3 + (params != NULL ? params->size : 0);
-  byte *pnt1 = (byte *) &len;
-  byte *pnt2 = pnt1 + 1;
-
-  AD013_set_uint16_value(send_buff + AD013_MSG_OFFSET_LENGTH, len);
+  if (ret != AD013_PARSE_DONE) {
+    if (partial) m->shortReads++;
+    else m->timeouts++;
+    return;
+  }
 
-  // Calculates the Checksum
-  for (i = AD013_MSG_OFFSET_FLAG; i < send_buff_len - 2; i++) {
-    // Calculates the Sum
-    sum = (sum + (uint8_t) send_buff[i]) & 65535;
+  if (result < 0) {
+    m->badDevIds++;
+    return;
   }
 
-  // Saves the Sum
-  AD013_set_uint16_value(&send_buff[AD013_MSG_OFFSET_DATA + (params != NULL ? params->size : 0)], sum);
+  m->codes[result < AD013_METRICS_CODES - 1 ? result : AD013_METRICS_CODES - 1]++;
 
-  // printf("SENT SUM: %02X\n", 
-  //   AD013_get_uint16_value(send_buff + send_buff_len - 2););
-  
-  // Writes the Fixed header
-  SensorCom.write((byte *)send_buff, send_buff_len);
-
-  // Now we need to read the ACK packet. First we get the
-  // fixed size of the packet;
-  while (recv_buff_len < AD013_MSG_HEADER_SIZE + 2) {
-    if (0 >= --max_retries) break;
-    // while (SensorCom.available() == false)
-    //  delay(1); //Wait for user input
-    read_chars = SensorCom.readBytes(recv_buff + recv_buff_len, sizeof(recv_buff) - recv_buff_len);
-    recv_buff_len += read_chars; 
-  }
-
-  if (recv_buff_len < 10) {
-    printf("ERROR: Cannot Read (Timeout Reached; Read: %d bytes Reply)\n", recv_buff_len);
-    goto err;
-  }
-
-  // Let's check the message is ok
-  if (memcmp(send_buff, recv_buff, 5) == 0) {
-    
-    uint16_t pkt_len = 0;
-    uint16_t recv_sum = 0;
-    uint16_t sum = 0;
-    uint16_t max_data = 0;
-
-    // Gets the Packet (Anything After Length) Data Size
-    pkt_len = AD013_get_uint16_value(recv_buff + AD013_MSG_OFFSET_LENGTH);
-
-    // Gets the Checksum from the Received Message
-    recv_sum = AD013_get_uint16_value(recv_buff + recv_buff_len - 2);
-
-    // Gets the Code from the received message
-    recv_code = (uint8_t) *(recv_buff + AD013_MSG_OFFSET_CODE);
-    
-    // Calculates the Sum
-    for (i = AD013_MSG_OFFSET_FLAG ; i < recv_buff_len - 2; i++) {
-      sum = (sum + recv_buff[i]) & 65535;
-    }
+  // Round Trip (first reply to the command only)
+  if (rttUs >= 0) {
+    AD013_OpMetrics * op = AD013_MetricsOp(code);
+    unsigned long ms = rttUs / 1000;
+    int bucket = 0;
 
-    // Compares the Checksums, if an error, let's reject
-    // the message and return the error
-    if (sum != recv_sum) {
-      printf("CHECKSUM ERROR: Received = %02X, Calculated = %02\n", 
-        recv_sum, sum);
-      if (send_buff) free(send_buff);
-      return -99;
+    while (ms && bucket < AD013_METRICS_HIST_SIZE - 1) {
+      ms >>= 1;
+      bucket++;
     }
+    m->rttHist[bucket]++;
 
-    // Here we should get the parameters
-    if (recv_data_buff) {
-      // If the pointer is provided
-      if (*recv_data_buff == NULL) {
-        // If the Buffer is not Provided, we allocate it
-        max_data = pkt_len - 2;
-        *recv_data_buff = (byte *) malloc (pkt_len - 2);
-      } else {
-        // Gets the size of the input buffer (if provided)
-        max_data = *recv_data_buff_len;
-      }
-      // We have a good buffer, now let's fill it in
-      memcpy(*recv_data_buff, &recv_buff[AD013_MSG_OFFSET_DATA], max_data);
-    }
-    
-  } else {
-    if (AD013_DEBUG_IS_ENABLED) printf("ERROR: Received checksum does not match.\n");
-    goto err;
+    if (op->replies == 0 || (uint32_t) rttUs < op->minUs) op->minUs = rttUs;
+    if ((uint32_t) rttUs > op->maxUs) op->maxUs = rttUs;
+    op->replies++;
+    op->totalUs += rttUs;
   }
-  
-  if (send_buff) free(send_buff);
-  
-  return recv_code;
+}
 
-err:
+void AD013_GetMetrics(AD013_Metrics * snapshot) {
+  if (!snapshot) return;
+  *snapshot = AD013_metrics;
+  for (int i = 0; i < AD013_METRICS_OPCODES; i++)
+    snapshot->ops[i].code = AD013_metricsOps[i];
+}
 
-  // Debug Information
-  printf("MSG SENT: ");
-  for (i = 0 ; i < send_buff_len; i++) {
-    printf("%02.2X:", send_buff[i]);
+void AD013_ResetMetrics(void) {
+  memset(&AD013_metrics, 0, sizeof(AD013_metrics));
+}
+
+int AD013_PrintMetrics(Print & out) {
+
+  AD013_Metrics m;
+  char line[128];
+  int lines = 0;
+
+  AD013_GetMetrics(&m);
+
+  // Link Errors
+  snprintf(line, sizeof(line), "ad013 badsum=%lu short=%lu timeout=%lu devid=%lu retx=%lu deadline=%lu\n",
+    (unsigned long) m.badSums, (unsigned long) m.shortReads,
+    (unsigned long) m.timeouts, (unsigned long) m.badDevIds,
+    (unsigned long) m.retransmits, (unsigned long) m.deadlines);
+  out.print(line);
+  lines++;
+
+  // Per-Opcode Round Trip (us)
+  for (int i = 0; i < AD013_METRICS_OPCODES; i++) {
+    AD013_OpMetrics * op = &m.ops[i];
+    char code[8];
+    if (op->calls == 0) continue;
+    if (op->code != AD013_METRICS_OTHER) snprintf(code, sizeof(code), "0x%02X", op->code);
+    else snprintf(code, sizeof(code), "other");
+    snprintf(line, sizeof(line), "ad013 op=%s calls=%lu replies=%lu min=%lu avg=%lu max=%lu\n",
+      code, (unsigned long) op->calls, (unsigned long) op->replies,
+      (unsigned long) op->minUs,
+      (unsigned long)(op->replies ? op->totalUs / op->replies : 0),
+      (unsigned long) op->maxUs);
+    out.print(line);
+    lines++;
   }
-  Serial.println();
-  delay(50);
-  
-  printf("MSG RECV: ");
-  for (i = 0; i < recv_buff_len; i++) {
-    printf("%02.2X:", recv_buff[i]);
+
+  // Sensor Codes
+  for (int i = 0; i < AD013_METRICS_CODES; i++) {
+    if (m.codes[i] == 0) continue;
+    if (i < AD013_METRICS_CODES - 1)
+      snprintf(line, sizeof(line), "ad013 code=0x%02X n=%lu\n", i, (unsigned long) m.codes[i]);
+    else
+      snprintf(line, sizeof(line), "ad013 code=other n=%lu\n", (unsigned long) m.codes[i]);
+    out.print(line);
+    lines++;
   }
-  Serial.println();
-  delay(50);
 
-  // Free Allocated Memory
-  if (send_buff) free(send_buff);
+  // Round Trip Histogram (upper bound in ms)
+  for (int i = 0; i < AD013_METRICS_HIST_SIZE; i++) {
+    if (m.rttHist[i] == 0) continue;
+    if (i < AD013_METRICS_HIST_SIZE - 1)
+      snprintf(line, sizeof(line), "ad013 rtt<%lums n=%lu\n", 1UL << i, (unsigned long) m.rttHist[i]);
+    else
+      snprintf(line, sizeof(line), "ad013 rtt>=%lums n=%lu\n", 1UL << (i - 1), (unsigned long) m.rttHist[i]);
+    out.print(line);
+    lines++;
+  }
 
-  // Error
-  return -1;
+  return lines;
 }
 
-int AD013_Recv(char * data, int data_len) {
+#define AD013_METRICS_INC(counter) AD013_metrics.counter++
 
-  char buff[128];
-  
-  int read_chars = 0;
-  int i = 0;
-  
-  read_chars = SensorCom.readBytes(buff, sizeof(buff));
+#else
 
-  return 1;
+#define AD013_MetricsSent(code) do { } while (0)
+#define AD013_MetricsReply(code, ret, result, partial, rttUs) do { } while (0)
+#define AD013_METRICS_INC(counter) do { } while (0)
+
+#endif
+
+                        // ===============
+                        // Trace Functions
+                        // ===============
+
+#if defined(AD013_TRACE)
+
+#if AD013_TRACE_SIZE < 8 + AD013_TRACE_MAX_DATA
+#error "AD013_TRACE_SIZE must hold at least one full record"
+#endif
+
+// Trace Ring (whole records, the oldest ones are dropped first)
+static byte     AD013_traceBuf[AD013_TRACE_SIZE];
+static uint16_t AD013_traceHead;
+static uint16_t AD013_traceLen;
+static uint32_t AD013_traceDropped;
+
+static inline uint8_t AD013_TraceAt(uint16_t pos) {
+  return AD013_traceBuf[(AD013_traceHead + pos) % AD013_TRACE_SIZE];
 }
 
-                        // ================================
-                        // Fingerprint High-Level Functions
-                        // ================================
+static inline void AD013_TracePut(uint8_t b) {
+  AD013_traceBuf[(AD013_traceHead + AD013_traceLen) % AD013_TRACE_SIZE] = b;
+  AD013_traceLen++;
+}
 
-int CFP_FindSensor(Stream     & SensorCom,
-                   int          serSpeed,
-                   AD013_Params * params) {
-  // Let's Check we have a sensor attached and we can
-  // verify the password. Use the params to modify the
-  // defaults
-  
-  AD013_Params myParams;
-    // Container for params
+static void AD013_TraceRecord(uint8_t type, uint8_t aux,
+                              const byte * a, uint16_t aLen,
+                              const byte * b, uint16_t bLen) {
 
-  SoftwareSerial * swSerial = (SoftwareSerial *) &SensorCom;
-    // Container for a more generic Serial interface
-    
-  if (!params) {
-    myParams = AD013_DefaultParams;
-    // Adds the Password as the default command
-    AD013_AddParamN(&myParams, AD013_def_passwd, sizeof(AD013_def_passwd));
-  } else {
-    // Copies the params struct into the local variable
-    myParams = *params;
+  uint16_t size = aLen + bLen;
+  uint16_t kept = size < AD013_TRACE_MAX_DATA ? size : AD013_TRACE_MAX_DATA;
+  unsigned long now = micros();
+
+  // Makes room for the record
+  while (AD013_TRACE_SIZE - AD013_traceLen < 8 + kept) {
+    uint16_t old = (AD013_TraceAt(2) << 8) | AD013_TraceAt(3);
+    uint16_t skip = 8 + (old < AD013_TRACE_MAX_DATA ? old : AD013_TRACE_MAX_DATA);
+    AD013_traceHead = (AD013_traceHead + skip) % AD013_TRACE_SIZE;
+    AD013_traceLen -= skip;
+    AD013_traceDropped++;
   }
 
-  // Sets the Default Timeout
-  SensorCom.setTimeout(defTimeout);
+  AD013_TracePut(type);
+  AD013_TracePut(aux);
+  AD013_TracePut(size >> 8);
+  AD013_TracePut(size & 0xFF);
+  for (int i = 24; i >= 0; i -= 8) AD013_TracePut((now >> i) & 0xFF);
 
-  if (serSpeed < 0) {
-    // Array Of Speeds To Try
-    int speedVals[5] = {115200, 57600, 38400, 19200, 9600};
-    // Debug Info
-    if (AD013_DEBUG_IS_ENABLED)
-      printf("Looking for Fingerprint Sensor - checking 115200-9600 baud range\n");
- 
-    // Check which Speed Works
-    for (int i = 0; i < sizeof(speedVals)/sizeof(int); i++) {
-      if (AD013_DEBUG_IS_ENABLED) printf("Checking Speed %d baud ....: ", speedVals[i]);
-      // SensorCom.begin(speedVals[i]);
-      swSerial->begin(speedVals[i]);
-      delay(100);
-      if (AD013_Send(0x13, SensorCom, &myParams) < 0) {
-        if (AD013_DEBUG_IS_ENABLED) printf("Not Supported\n");
-      } else {
-        if (AD013_DEBUG_IS_ENABLED) printf("Ok (Supported).\n");
-        return 1;
-      }
-    }
-    
-    // Debug
-    if (AD013_DEBUG_IS_ENABLED)
-      printf("All Speed Failed, Aborting.\n");
+  for (uint16_t i = 0; i < kept; i++)
+    AD013_TracePut(i < aLen ? a[i] : b[i - aLen]);
+}
 
-    // ALL speeds fail, let's fail
-    return -1;
-    
-  } else {
+static void AD013_TraceReply(const AD013_Parser * parser, int ret, int code) {
 
-    // If Speed was requested, let's set the speed
-    if (serSpeed > 0) swSerial->begin(serSpeed);
-    delay(50);
-  
-    // Execute the call
-    if (AD013_Send(0x13, SensorCom, &myParams) < 0) return -1;
+  uint8_t type = AD013_TRACE_ERR;
+  uint8_t aux = AD013_TRACE_TIMEOUT;
+
+  if (ret == AD013_PARSE_BAD_SUM) {
+    aux = AD013_TRACE_BAD_SUM;
+  } else if (ret == AD013_PARSE_DONE && code < 0) {
+    aux = AD013_TRACE_BAD_DEVID;
+  } else if (ret == AD013_PARSE_DONE) {
+    type = AD013_TRACE_RX;
+    aux = parser->flag;
   }
-  
-  // All Done
-  return 1;
+
+  AD013_TraceRecord(type, aux, parser->payload, parser->payload_len, NULL, 0);
 }
 
-int AD013_SearchTemplate (Stream & SensorCom,
-                        int      timeOut,
-                        int      threashold,
-                        bool     SecurityOfficerOnly) {
+int AD013_TraceDump(Print & out) {
 
-  int defDelayPeriod = 240; // Built-in Delay for processing
-  int delayPeriod = 120;
-  int code = -1;
+  byte head[12] = { 'A', 'D', 'T', 'R', AD013_TRACE_VERSION, AD013_TRACE_MAX_DATA };
+  uint16_t first = AD013_TRACE_SIZE - AD013_traceHead;
 
-  // Allocates the params and initializes w/ default values
-  AD013_Params params = AD013_DefaultParams;
+  if (first > AD013_traceLen) first = AD013_traceLen;
 
-  // Debug Information
-  if (AD013_DEBUG_IS_ENABLED)
-    printf("Please put finger on sensor...\n");
+  head[6] = AD013_traceDropped >> 24;
+  head[7] = (AD013_traceDropped >> 16) & 0xFF;
+  head[8] = (AD013_traceDropped >> 8) & 0xFF;
+  head[9] = AD013_traceDropped & 0xFF;
+  head[10] = AD013_traceLen >> 8;
+  head[11] = AD013_traceLen & 0xFF;
 
-  // Generates the Char/Template to Serch for
-  while ((code = PS_GetImage(SensorCom)) != 0) {
+  // Raw copy (the ring wraps at most once)
+  out.write(head, sizeof(head));
+  out.write(AD013_traceBuf + AD013_traceHead, first);
+  out.write(AD013_traceBuf, AD013_traceLen - first);
 
-    // Checks for specific errors
-    if (code == 0x01 || code == 0x03) {
-      // Packet Error (0x01) or Failure (0x03)
-      if (AD013_DEBUG_IS_ENABLED)
-        printf("ERROR: Cannot Get Image (code: %d)\n", code);
-    }
+  return sizeof(head) + AD013_traceLen;
+}
 
-    // Code 0x02 is for Fingerprint NOT on sensor (polling)
-    
-    // Checks for Timeout Conditions
-    if (timeOut <= 0) {
-      if (AD013_DEBUG_IS_ENABLED) printf("Timeout Reached, aborting...\n");
-      break;
-    } else {
-      delay(delayPeriod);
-      timeOut -= delayPeriod + defDelayPeriod;
-    }
+void AD013_TraceReset(void) {
+  AD013_traceHead = 0;
+  AD013_traceLen = 0;
+  AD013_traceDropped = 0;
+}
+
+#define AD013_TRACE_FRAME(type, aux, a, aLen, b, bLen) \
+  AD013_TraceRecord(type, aux, a, aLen, b, bLen)
+#define AD013_TRACE_REPLY(parser, ret, code) \
+  AD013_TraceReply(parser, ret, code)
+
+#else
+
+// Compiled out (no code, no RAM)
+#define AD013_TRACE_FRAME(type, aux, a, aLen, b, bLen) do { } while (0)
+#define AD013_TRACE_REPLY(parser, ret, code) do { } while (0)
+
+#endif
+
+                        // ===================
+                        // Command Descriptors
+                        // ===================
+
+// Each command is described by its code, the expected reply data
+// size (after the code) and the types of its fields (written big
+// endian). The send functions only accept the declared fields, so
+// a malformed parameter list fails to compile. Each value must be
+// an unsigned field type no wider than its field: int literals and
+// wider values need a cast at the call site, where the narrowing
+// can be seen.
+
+template <typename T> struct AD013_FieldSize { static constexpr uint8_t value = 0; };
+template <> struct AD013_FieldSize<uint8_t>  { static constexpr uint8_t value = 1; };
+template <> struct AD013_FieldSize<uint16_t> { static constexpr uint8_t value = 2; };
+template <> struct AD013_FieldSize<uint32_t> { static constexpr uint8_t value = 4; };
+
+template <typename... F> struct AD013_Layout;
+template <> struct AD013_Layout<> { static constexpr uint8_t size = 0; };
+template <typename T, typename... F> struct AD013_Layout<T, F...> {
+  static_assert(AD013_FieldSize<T>::value != 0,
+    "AD013: command fields are uint8_t, uint16_t or uint32_t");
+  static constexpr uint8_t size = AD013_FieldSize<T>::value + AD013_Layout<F...>::size;
+};
+
+// Checks one value (type A) against its field (type T)
+template <typename T, typename A> struct AD013_FieldArg {
+  static_assert(AD013_FieldSize<A>::value != 0,
+    "AD013: command values must be uint8_t, uint16_t or uint32_t (cast them)");
+  static_assert(AD013_FieldSize<A>::value <= AD013_FieldSize<T>::value,
+    "AD013: command value is wider than its field (cast it)");
+  static constexpr int value = 0;
+};
+
+static inline void AD013_FramePutField(AD013_Frame * frame, uint8_t val) {
+  AD013_FramePut(frame, val);
+}
+
+static inline void AD013_FramePutField(AD013_Frame * frame, uint16_t val) {
+  AD013_FramePut(frame, val >> 8);
+  AD013_FramePut(frame, val & 0xFF);
+}
+
+static inline void AD013_FramePutField(AD013_Frame * frame, uint32_t val) {
+  AD013_FramePutField(frame, (uint16_t)(val >> 16));
+  AD013_FramePutField(frame, (uint16_t)(val & 0xFFFF));
+}
+
+template <uint8_t CODE, uint8_t RESP, typename... F>
+struct AD013_Command {
+  static constexpr uint8_t code    = CODE;
+  static constexpr uint8_t reqLen  = AD013_Layout<F...>::size;
+  static constexpr uint8_t respLen = RESP;
+
+  static_assert(reqLen <= AD013_MAX_PARAMS_SIZE,
+    "AD013: command fields exceed AD013_MAX_PARAMS_SIZE");
+
+  template <typename... A>
+  static void put(AD013_Frame * frame, A... args) {
+    static_assert(sizeof...(A) == sizeof...(F),
+      "AD013: wrong number of command fields");
+    int checked[] = { 0, AD013_FieldArg<F, A>::value... };
+    int unused[] = { 0, (AD013_FramePutField(frame, (F) args), 0)... };
+    (void) checked;
+    (void) unused;
+    (void) frame;
   }
+};
 
-  // If we do not have a successful finger on
-  // the sensor, let's abort
-  if (code != 0) return (-1);
+// Frames for the commands without fields (default device ID), sum
+// included, are built at compile time
+#define AD013_CONST_FRAME_SIZE   12
 
-  // DEBUG information
-  if (AD013_DEBUG_IS_ENABLED)
-    printf("Preparing to Match Finger...\n");
+template <uint8_t CODE>
+struct AD013_ConstFrame {
+  static constexpr uint16_t sum = AD013_FLAG_COMMAND + 3 + CODE;
+  static const byte data[AD013_CONST_FRAME_SIZE];
+};
 
-  // Adds the number of the buffer to match (1)
-  AD013_AddParam1(&params, 1);
+template <uint8_t CODE>
+const byte AD013_ConstFrame<CODE>::data[AD013_CONST_FRAME_SIZE] = {
+  AD013_MSG_HEADER_HI, AD013_MSG_HEADER_LO,   /* Header */
+  0xFF, 0xFF, 0xFF, 0xFF,                     /* Device ID */
+  AD013_FLAG_COMMAND,                         /* Flag */
+  0x00, 0x03,                                 /* Length (Code + Sum) */
+  CODE,                                       /* Code */
+  (byte)(AD013_ConstFrame<CODE>::sum >> 8),   /* Sum */
+  (byte)(AD013_ConstFrame<CODE>::sum & 0xFF)
+};
 
-  // Generates the Char/Template from the acquired
-  // Image. Possible error codes are handled in the
-  // switch statement
-  code = PS_GenChar(SensorCom, &params);
+template <bool B> struct AD013_Tag { };
 
-  // Error Handling
-  switch (code) {
-    case AD013_CODE_ERROR                  /* 0x01 */ :
-    case AD013_CODE_FEATURE_FAIL_AMORPHOUS /* 0x06 */ :
-    case AD013_CODE_FEATURE_FAIL_MINUTIAE  /* 0x07 */ :
-    case AD013_CODE_IMAGE_INCOMPLETE_ERROR /* 0x15 */ : {
-      if (AD013_DEBUG_IS_ENABLED) 
-        printf("DETECTED CFS ERROR [%d]\n", code);
-      return -1;
+template <class CMD> static inline const byte * AD013_PrebuiltFrame(AD013_Tag<true>) {
+  return AD013_ConstFrame<CMD::code>::data;
+}
+
+template <class CMD> static inline const byte * AD013_PrebuiltFrame(AD013_Tag<false>) {
+  return NULL;
+}
+
+//                    Code  Reply  Fields
+typedef AD013_Command<0x01,  0>                               AD013_CmdGetImage;
+typedef AD013_Command<0x02,  0, uint8_t>                      AD013_CmdGenChar;      // Buffer
+typedef AD013_Command<0x03,  2>                               AD013_CmdMatch;        // -> Score
+typedef AD013_Command<0x04,  4, uint8_t, uint16_t, uint16_t>  AD013_CmdSearch;       // Buffer, Start, Count -> ID, Score
+typedef AD013_Command<0x05,  0>                               AD013_CmdRegModel;
+typedef AD013_Command<0x06,  0, uint8_t, uint16_t>            AD013_CmdStoreChar;    // Buffer, Template ID
+typedef AD013_Command<0x07,  0, uint8_t, uint16_t>            AD013_CmdLoadChar;     // Buffer, Template ID
+typedef AD013_Command<0x08,  0, uint8_t>                      AD013_CmdUpChar;       // Buffer -> Data Packets
+typedef AD013_Command<0x09,  0, uint8_t>                      AD013_CmdDownChar;     // Buffer <- Data Packets
+typedef AD013_Command<0x0A,  0>                               AD013_CmdUpImage;      // -> Data Packets
+typedef AD013_Command<0x0C,  0, uint16_t, uint16_t>           AD013_CmdDeletChar;    // Template ID, Count
+typedef AD013_Command<0x0D,  0>                               AD013_CmdEmpty;
+typedef AD013_Command<0x0E,  0, uint8_t, uint8_t>             AD013_CmdWriteReg;     // Register, Value
+typedef AD013_Command<0x13,  0, uint32_t>                     AD013_CmdVerifyPwd;    // Password
+typedef AD013_Command<0x1F, 32, uint8_t>                      AD013_CmdReadIndex;    // Page -> Occupancy Bits
+typedef AD013_Command<0x30,  0>                               AD013_CmdCancel;
+typedef AD013_Command<0x32,  5, uint8_t, uint16_t, uint16_t>  AD013_CmdAutoIdentify; // Level, ID, Param -> Stage, ID, Score
+typedef AD013_Command<0x33,  0>                               AD013_CmdSleep;
+
+                        // ========================
+                        // Packet Parsing Functions
+                        // ========================
+
+void AD013_ParserInit(AD013_Parser * parser) {
+  parser->state = AD013_PARSER_HEADER_HI;
+  parser->flag = 0;
+  parser->length = 0;
+  parser->pos = 0;
+  parser->sum = 0;
+  parser->recv_sum = 0;
+  parser->payload_len = 0;
+}
+
+int AD013_ParserFeed(AD013_Parser * parser, byte val) {
+
+  switch (parser->state) {
+
+    case AD013_PARSER_DONE:
+      // Previous packet was consumed, starts over
+      AD013_ParserInit(parser);
+      // Fall Through
+
+    case AD013_PARSER_HEADER_HI: {
+      if (val == AD013_MSG_HEADER_HI) parser->state = AD013_PARSER_HEADER_LO;
+    } break;
+
+    case AD013_PARSER_HEADER_LO: {
+      if (val == AD013_MSG_HEADER_LO) {
+        parser->state = AD013_PARSER_DEVID;
+        parser->pos = 0;
+      } else if (val != AD013_MSG_HEADER_HI) {
+        // Resync on the next header
+        parser->state = AD013_PARSER_HEADER_HI;
+      }
+    } break;
+
+    case AD013_PARSER_DEVID: {
+      parser->devId[parser->pos++] = val;
+      if (parser->pos >= sizeof(parser->devId)) parser->state = AD013_PARSER_FLAG;
+    } break;
+
+    case AD013_PARSER_FLAG: {
+      parser->flag = val;
+      parser->sum = val;
+      parser->length = 0;
+      parser->pos = 0;
+      parser->state = AD013_PARSER_LENGTH;
+    } break;
+
+    case AD013_PARSER_LENGTH: {
+      parser->length = (parser->length << 8) | val;
+      parser->sum += val;
+      if (++parser->pos < 2) break;
+
+      // Length includes the Sum (2 bytes)
+      if (parser->length < 3 || parser->length - 2 > AD013_MAX_PAYLOAD_SIZE) {
+        AD013_ParserInit(parser);
+        return AD013_PARSE_OVERFLOW;
+      }
+      parser->payload_len = 0;
+      parser->state = AD013_PARSER_PAYLOAD;
+    } break;
+
+    case AD013_PARSER_PAYLOAD: {
+      parser->payload[parser->payload_len++] = val;
+      parser->sum += val;
+      if (parser->payload_len >= parser->length - 2) {
+        parser->recv_sum = 0;
+        parser->pos = 0;
+        parser->state = AD013_PARSER_SUM;
+      }
+    } break;
+
+    case AD013_PARSER_SUM: {
+      parser->recv_sum = (parser->recv_sum << 8) | val;
+      if (++parser->pos < 2) break;
+
+      if (parser->recv_sum != parser->sum) {
+        if (AD013_DEBUG_IS_ENABLED)
+          printf("CHECKSUM ERROR: Received = %02X, Calculated = %02X\n",
+            parser->recv_sum, parser->sum);
+        AD013_ParserInit(parser);
+        return AD013_PARSE_BAD_SUM;
+      }
+      parser->state = AD013_PARSER_DONE;
+      return AD013_PARSE_DONE;
     } break;
 
     default:
-      if (AD013_DEBUG_IS_ENABLED) printf("CFS CODE: %d\n", code);
+      AD013_ParserInit(parser);
   }
 
-  // Builds the new params
-  AD013_ClearParams(&params);  // Clears the Parameters
-  AD013_AddParam1(&params, 1); // Adds Buffer Num. Param (1 byte)
-  AD013_AddParam2(&params, 0); // Adds Start Num. Param (2 bytes)
-  AD013_AddParam2(&params, 99);// Adds End Num. Param (2 bytes)
-  
-  // Search the DB for the Generated Char
-  // byte data[20] = { 0x00 };
-  byte * data = NULL;
-  int len = 0;
-  int matched_template = PS_Search(SensorCom, &params, (byte **) &data, &len);
+  return AD013_PARSE_MORE;
+}
 
-  if (matched_template >= 0) {
-    if (AD013_DEBUG_IS_ENABLED)
-      printf("Matched Template: %d (Template: %d, Score: %d)\n",
-        matched_template, AD013_get_uint16_value((char *)data), 
-        AD013_get_uint16_value((char *)&data[2]));
-  } else {
-    printf("ERROR: Code %d\n");
-  }
+int AD013_ParserPoll(AD013_Parser * parser, Stream & SensorCom) {
 
-  if (data) free(data);
+  int ret = AD013_PARSE_MORE;
 
-  return 1;
+  while (SensorCom.available() > 0) {
+    int val = SensorCom.read();
+    if (val < 0) break;
+    if ((ret = AD013_ParserFeed(parser, (byte) val)) != AD013_PARSE_MORE)
+      break;
+  }
+
+  return ret;
 }
 
-/* !\brief Clears one template from the fingerprint DB */
+                        // =======================
+                        // Async Command Functions
+                        // =======================
 
-int AD013_ClearTemplates (Stream & SerialPort,
-					    int      rangeStart,
-					    int      rangeEnd) {
-  // DEBUG: PLACEHOLDER: Missing Code
-  printf("AD013_ClearTemplate() Not Implemented, yet.\n");
-  return -1;
+// Built-in Delays (ms)
+#define AD013_POLL_MIN_PERIOD      40   // Adaptive polling (first polls)
+#define AD013_POLL_MAX_PERIOD     480   // Adaptive polling (backed off)
+#define AD013_TOUCH_RETRY_PERIOD   20   // Touched, image not ready yet
+#define AD013_WAKE_PROBE_TIMEOUT   50   // Password probes while the sensor boots
+
+#ifndef AD013_MAX_TOUCH_PINS
+#define AD013_MAX_TOUCH_PINS        4
+#endif
+#define AD013_SPEED_SETTLE_DELAY  100   // After changing the baud rate
+
+// Internal Marker for 'issue the command for this step'
+#define AD013_STEP_ISSUE        -1000
+
+// Identify Steps
+#define AD013_IDENTIFY_GET_IMAGE    0
+#define AD013_IDENTIFY_GEN_CHAR     1
+#define AD013_IDENTIFY_SEARCH       2
+
+// Verify Steps
+#define AD013_VERIFY_LOAD_CHAR      0
+#define AD013_VERIFY_GET_IMAGE      1
+#define AD013_VERIFY_GEN_CHAR       2
+#define AD013_VERIFY_MATCH          3
+
+// Enroll Steps
+#define AD013_ENROLL_LOAD_INDEX     0
+#define AD013_ENROLL_GET_IMAGE      1
+#define AD013_ENROLL_GEN_CHAR       2
+#define AD013_ENROLL_DUP_SEARCH     3
+#define AD013_ENROLL_REG_MODEL      4
+#define AD013_ENROLL_STORE          5
+#define AD013_ENROLL_LIFT           6
+
+// Template Transfer Steps
+#define AD013_XFER_LOAD_CHAR        0
+#define AD013_XFER_COMMAND          1
+#define AD013_XFER_DATA             2
+#define AD013_XFER_STORE_CHAR       3
+
+// Speeds to try when scanning for the sensor
+static const long AD013_speedVals[] = {115200, 57600, 38400, 19200, 9600};
+
+// Auto-Identify Stages (from the sensor's status packets)
+#define AD013_AUTO_STAGE_CHECK      0x00  // Command accepted
+#define AD013_AUTO_STAGE_IMAGE      0x01  // Image captured
+#define AD013_AUTO_STAGE_RESULT     0x05  // Search result
+
+// Auto-Identify Parameters
+#define AD013_AUTO_ID_ANY         0xFFFF  // 1:N search
+#define AD013_AUTO_PARAM_STAGES   0x0000  // Stage packets on, LED default
+
+// Speed Upgrade Steps
+#define AD013_UPGRADE_WRITE_REG     0
+#define AD013_UPGRADE_SWITCH        1
+#define AD013_UPGRADE_VERIFY        2
+#define AD013_UPGRADE_ROLLBACK_REG  3
+#define AD013_UPGRADE_ROLLBACK      4
+#define AD013_UPGRADE_REVERIFY      5
+
+// System Parameters (Registers)
+#define AD013_REG_BAUD              4   // Speed is N x 9600
+#define AD013_BAUD_UNIT          9600
+#define AD013_MAX_BAUD_N           12
+
+// Discovery Steps (speedIdx of the cached link attempt)
+#define AD013_FIND_CACHED          -1
+
+// Link Record
+#define AD013_LINK_MAGIC        0xAD13
+#define AD013_LINK_VERSION           2
+
+#ifndef AD013_LINK_EEPROM_ADDR
+#define AD013_LINK_EEPROM_ADDR       0
+#endif
+
+#ifndef AD013_MAX_LINK_SLOTS
+#define AD013_MAX_LINK_SLOTS         4
+#endif
+
+// In-RAM copy of the link records (loaded on first use)
+static AD013_Link AD013_links[AD013_MAX_LINK_SLOTS];
+static uint8_t    AD013_linksLoaded = 0;
+
+// Duration of the last discovery (ms)
+static unsigned long AD013_discoveryMs = 0;
+
+// Touch to capture latency of the last capture (ms)
+static unsigned long AD013_captureMs = 0;
+
+// Touch to link ready latency of the last wake up (ms)
+static unsigned long AD013_wakeMs = 0;
+
+// Search Tiers (after the hot tier)
+static AD013_SearchRange AD013_tiers[AD013_MAX_SEARCH_TIERS] = {
+  { 0, AD013_SO_TEMPLATES },
+  { AD013_SO_TEMPLATES, AD013_MAX_TEMPLATES - AD013_SO_TEMPLATES }
+};
+static uint8_t AD013_tiersLen = 2;
+
+// Recently Matched Templates (one list per link slot, most recent
+// first, as the same IDs mean different fingers on another sensor)
+typedef struct hot_st {
+  uint16_t ids[AD013_HOT_SIZE];
+  uint8_t  len;
+} AD013_Hot;
+
+static AD013_Hot AD013_hot[AD013_MAX_LINK_SLOTS];
+
+// Search Planner Statistics
+static AD013_SearchStats AD013_searchStats;
+
+// Recent Match (one per link slot, kept while the finger stays on)
+typedef struct recent_st {
+  uint8_t       valid;
+  int           templateId;
+  int           score;
+  unsigned long seenAt;          // Finger last seen (millis)
+} AD013_Recent;
+
+static AD013_Recent  AD013_recent[AD013_MAX_LINK_SLOTS];
+static unsigned long AD013_recentTtl = AD013_MATCH_CACHE_TTL;
+
+// Default Baud Hook (none, see AD013_SetBaudHook())
+static AD013_BaudHook AD013_baudHook = NULL;
+
+// Template Index (one occupancy bitmap per link slot, bit N of
+// byte B is the template ID B x 8 + N as in PS_ReadIndexTable)
+#define AD013_INDEX_PAGE_SIZE    256   // Templates per index page
+#define AD013_INDEX_PAGES       ((AD013_MAX_TEMPLATES + AD013_INDEX_PAGE_SIZE - 1) / AD013_INDEX_PAGE_SIZE)
+
+typedef struct index_st {
+  uint8_t valid;
+  uint8_t bits[(AD013_MAX_TEMPLATES + 7) / 8];
+#if AD013_HASH_CACHE
+  // Hashes of the stored templates (backup and restore), bit set
+  // when known, dropped with the slot or the index
+  uint8_t  hashed[(AD013_MAX_TEMPLATES + 7) / 8];
+  uint16_t sizes[AD013_MAX_TEMPLATES];
+  uint32_t hashes[AD013_MAX_TEMPLATES];
+#endif
+} AD013_Index;
+
+static AD013_Index AD013_index[AD013_MAX_LINK_SLOTS];
+
+// Sensors attached to the touch interrupts
+static AD013_Sensor * volatile AD013_touchSensors[AD013_MAX_TOUCH_PINS];
+
+#if defined(AD013_USE_EEPROM)
+
+static int AD013_DefaultStorageRead(int slot, void * data, int size) {
+  int addr = AD013_LINK_EEPROM_ADDR + slot * size;
+  for (int i = 0; i < size; i++) ((byte *)data)[i] = EEPROM.read(addr + i);
+  return size;
 }
 
-                      
-/* !\brief Clears all user templates from the fingerprint DB */
+static int AD013_DefaultStorageWrite(int slot, const void * data, int size) {
+  int addr = AD013_LINK_EEPROM_ADDR + slot * size;
+  for (int i = 0; i < size; i++) EEPROM.update(addr + i, ((const byte *)data)[i]);
+  return size;
+}
 
-int AD013_ClearUserTemplates (Stream & SerialPort) {
-  // DEBUG: PLACEHOLDER: Missing Code
-  printf("AD013_ClearUserTemplates() Not Implemented, yet.\n");
-  return -1;
+#elif defined(__linux__) && defined(AD013_LINK_FILE)
+
+// File named by the build (e.g. -DAD013_LINK_FILE=\"/var/lib/ad013/link.bin\")
+static int AD013_DefaultStorageRead(int slot, void * data, int size) {
+  int ret = 0;
+  FILE * fp = fopen(AD013_LINK_FILE, "rb");
+  if (!fp) return 0;
+  if (fseek(fp, (long) slot * size, SEEK_SET) == 0)
+    ret = fread(data, 1, size, fp);
+  fclose(fp);
+  return ret;
 }
 
+static int AD013_DefaultStorageWrite(int slot, const void * data, int size) {
+  int ret = 0;
+  FILE * fp = fopen(AD013_LINK_FILE, "r+b");
+  if (!fp) fp = fopen(AD013_LINK_FILE, "w+b");
+  if (!fp) return 0;
+  if (fseek(fp, (long) slot * size, SEEK_SET) == 0)
+    ret = fwrite(data, 1, size, fp);
+  fclose(fp);
+  return ret;
+}
 
-/* !\brief Clears all the Security Officer (SO) templates from the
-           fingerprint DB */
+#else
 
-int AD013_ClearSOTemplates(Stream * SerialPort) {
-  {
-  // DEBUG: PLACEHOLDER: Missing Code
-  printf("AD013_ClearSOTemplates() Not Implemented, yet.\n");
-  return -1;
+// RAM only (records do not survive a reset)
+#define AD013_DefaultStorageRead   NULL
+#define AD013_DefaultStorageWrite  NULL
+
+#endif
+
+static AD013_StorageRead  AD013_storageRead  = AD013_DefaultStorageRead;
+static AD013_StorageWrite AD013_storageWrite = AD013_DefaultStorageWrite;
+
+void AD013_SetStorage(AD013_StorageRead  readCb,
+                      AD013_StorageWrite writeCb) {
+
+  AD013_storageRead = readCb ? readCb : AD013_DefaultStorageRead;
+  AD013_storageWrite = writeCb ? writeCb : AD013_DefaultStorageWrite;
+
+  // Reloads from the new storage
+  AD013_linksLoaded = 0;
 }
+
+static uint8_t AD013_LinkSum(const AD013_Link * link) {
+  uint8_t sum = 0;
+  for (unsigned int i = 0; i < offsetof(AD013_Link, sum); i++)
+    sum += ((const byte *)link)[i];
+  return sum;
+}
+
+static AD013_Link * AD013_LinkGet(int slot) {
+
+  if (slot < 0 || slot >= AD013_MAX_LINK_SLOTS) return NULL;
+
+  if (!AD013_linksLoaded) {
+    memset(AD013_links, 0, sizeof(AD013_links));
+    for (int i = 0; AD013_storageRead && i < AD013_MAX_LINK_SLOTS; i++) {
+      if (AD013_storageRead(i, &AD013_links[i], sizeof(AD013_Link)) != sizeof(AD013_Link))
+        memset(&AD013_links[i], 0, sizeof(AD013_Link));
+    }
+    AD013_linksLoaded = 1;
+  }
+
+  // Only returns valid records
+  if (AD013_links[slot].magic != AD013_LINK_MAGIC ||
+      AD013_links[slot].version != AD013_LINK_VERSION ||
+      AD013_links[slot].sum != AD013_LinkSum(&AD013_links[slot]))
+    return NULL;
+
+  return &AD013_links[slot];
+}
+
+static void AD013_LinkSave(const AD013_Sensor * sensor) {
+
+  int slot = sensor->slot;
+  AD013_Link * link = AD013_LinkGet(slot);
+
+  if (slot < 0 || slot >= AD013_MAX_LINK_SLOTS) return;
+
+  // Nothing changed, saves the storage from unneeded writes
+  if (link && link->baud == (uint32_t) sensor->baud &&
+      memcmp(link->devId, sensor->devId, sizeof(link->devId)) == 0 &&
+      memcmp(link->passwd, sensor->passwd, sizeof(link->passwd)) == 0)
+    return;
+
+  link = &AD013_links[slot];
+  link->magic = AD013_LINK_MAGIC;
+  link->version = AD013_LINK_VERSION;
+  memcpy(link->devId, sensor->devId, sizeof(link->devId));
+  memcpy(link->passwd, sensor->passwd, sizeof(link->passwd));
+  link->baud = (uint32_t) sensor->baud;
+  link->sum = AD013_LinkSum(link);
+
+  if (AD013_storageWrite) AD013_storageWrite(slot, link, sizeof(AD013_Link));
+}
+
+unsigned long AD013_DiscoveryTime(void) {
+  return AD013_discoveryMs;
+}
+
+void AD013_SetBaudHook(AD013_BaudHook hook) {
+  AD013_baudHook = hook;
+}
+
+void AD013_PortBaudHook(Stream & com, long baud) {
+  static_cast<AD013_Port &>(com).setBaud(baud);
+}
+
+void AD013_SoftSerialBaudHook(Stream & com, long baud) {
+  static_cast<SoftwareSerial &>(com).begin(baud);
+}
+
+static void AD013_SensorBaud(AD013_Sensor * sensor, long speed) {
+  // Host side of the link (the hook knows the Stream type), without
+  // a hook the port stays at the speed it was opened with
+  if (sensor->baudHook) sensor->baudHook(*sensor->com, speed);
+}
+
+void AD013_SensorInit(AD013_Sensor * sensor, Stream & SensorCom) {
+
+  memset(sensor, 0, sizeof(AD013_Sensor));
+
+  sensor->com = &SensorCom;
+  memcpy(sensor->devId, AD013_def_devid, sizeof(sensor->devId));
+  memcpy(sensor->passwd, AD013_def_passwd, sizeof(sensor->passwd));
+  sensor->params = AD013_DefaultParams;
+  sensor->baudHook = AD013_baudHook;
+  sensor->op = AD013_OP_NONE;
+  sensor->result = -1;
+  sensor->policy = AD013_defPolicy;
+  sensor->touchPin = AD013_TOUCH_NONE;
+  sensor->packetSize = AD013_DEFAULT_PACKET_SIZE;
+
+  AD013_ParserInit(&sensor->parser);
+}
+
+void AD013_SetPolicy(AD013_Sensor * sensor, const AD013_Policy * policy) {
+  if (sensor) sensor->policy = policy ? *policy : AD013_defPolicy;
+}
+
+void AD013_SetDefaultPolicy(const AD013_Policy * policy) {
+
+  static const AD013_Policy defaults = {
+    0, AD013_DEFAULT_TIMEOUT, AD013_DEFAULT_RETRIES, AD013_DEFAULT_BACKOFF
+  };
+
+  AD013_defPolicy = policy ? *policy : defaults;
+}
+
+                        // ========================
+                        // Template Index Functions
+                        // ========================
+
+static AD013_Hot * AD013_HotGet(AD013_Sensor * sensor) {
+  if (sensor->slot < 0 || sensor->slot >= AD013_MAX_LINK_SLOTS) return NULL;
+  return &AD013_hot[sensor->slot];
+}
+
+static void AD013_HotForget(AD013_Sensor * sensor, uint16_t start, uint16_t count) {
+
+  AD013_Hot * hot = AD013_HotGet(sensor);
+  uint8_t len = 0;
+
+  if (!hot) return;
+
+  // Keeps the order of the remaining entries
+  for (uint8_t i = 0; i < hot->len; i++) {
+    if (hot->ids[i] >= start && hot->ids[i] - start < count) continue;
+    hot->ids[len++] = hot->ids[i];
+  }
+  hot->len = len;
+}
+
+static void AD013_RecentForget(AD013_Sensor * sensor) {
+  if (sensor && sensor->slot >= 0 && sensor->slot < AD013_MAX_LINK_SLOTS)
+    AD013_recent[sensor->slot].valid = 0;
+}
+
+static AD013_Index * AD013_IndexGet(AD013_Sensor * sensor) {
+  if (!sensor || sensor->slot < 0 || sensor->slot >= AD013_MAX_LINK_SLOTS)
+    return NULL;
+  return &AD013_index[sensor->slot];
+}
+
+static void AD013_IndexMark(AD013_Index * index, int start, int count, bool used) {
+  for (int id = start; id < start + count && id < AD013_MAX_TEMPLATES; id++) {
+    if (used) index->bits[id >> 3] |= (1 << (id & 0x07));
+    else index->bits[id >> 3] &= ~(1 << (id & 0x07));
+  }
+}
+
+static void AD013_HashForget(AD013_Index * index, int start, int count) {
+#if AD013_HASH_CACHE
+  for (int id = start; id < start + count && id < AD013_MAX_TEMPLATES; id++)
+    index->hashed[id >> 3] &= ~(1 << (id & 0x07));
+#else
+  (void) index; (void) start; (void) count;
+#endif
+}
+
+static bool AD013_HashGet(AD013_Sensor * sensor, int id, uint32_t * hash, long * size) {
+#if AD013_HASH_CACHE
+  AD013_Index * index = AD013_IndexGet(sensor);
+
+  if (!index || !index->valid || !(index->hashed[id >> 3] & (1 << (id & 0x07))))
+    return false;
+  *hash = index->hashes[id];
+  *size = index->sizes[id];
+  return true;
+#else
+  (void) sensor; (void) id; (void) hash; (void) size;
+  return false;
+#endif
+}
+
+static void AD013_HashSet(AD013_Sensor * sensor, int id, uint32_t hash, long size) {
+#if AD013_HASH_CACHE
+  AD013_Index * index = AD013_IndexGet(sensor);
+
+  if (!index || !index->valid) return;
+  index->hashed[id >> 3] |= (1 << (id & 0x07));
+  index->hashes[id] = hash;
+  index->sizes[id] = (uint16_t) size;
+#else
+  (void) sensor; (void) id; (void) hash; (void) size;
+#endif
+}
+
+static void AD013_IndexTrack(AD013_Sensor * sensor, int code,
+                             const byte * buff, int size) {
+
+  const byte * data = buff + AD013_MSG_OFFSET_DATA;
+
+  // Template range changed by the command (if any)
+  sensor->dbStart = 0;
+  sensor->dbCount = 0;
+
+  if (code == AD013_CmdStoreChar::code &&
+      size >= AD013_MSG_OFFSET_DATA + AD013_CmdStoreChar::reqLen) {
+    sensor->dbStart = (data[1] << 8) | data[2];
+    sensor->dbCount = 1;
+  } else if (code == AD013_CmdDeletChar::code &&
+             size >= AD013_MSG_OFFSET_DATA + AD013_CmdDeletChar::reqLen) {
+    sensor->dbStart = (data[0] << 8) | data[1];
+    sensor->dbCount = (data[2] << 8) | data[3];
+  } else if (code == AD013_CmdEmpty::code) {
+    sensor->dbCount = AD013_MAX_TEMPLATES;
+  }
+}
+
+static void AD013_IndexUpdate(AD013_Sensor * sensor, int code) {
+
+  AD013_Index * index = AD013_IndexGet(sensor);
+
+  // Deleted templates leave the hot tier (and the recent match)
+  if (code == AD013_CODE_OK && sensor->dbCount > 0 &&
+      sensor->code != AD013_CmdStoreChar::code) {
+    AD013_HotForget(sensor, sensor->dbStart, sensor->dbCount);
+    AD013_RecentForget(sensor);
+  }
+
+  if (!index) return;
+
+  // Whatever the outcome, the slots may hold something else now
+  AD013_HashForget(index, sensor->dbStart, sensor->dbCount);
+
+  // An empty DB is always known
+  if (code == AD013_CODE_OK && sensor->code == AD013_CmdEmpty::code) {
+    memset(index->bits, 0, sizeof(index->bits));
+    index->valid = 1;
+    return;
+  }
+
+  if (!index->valid) return;
+
+  switch (code) {
+    case AD013_CODE_OK:
+      if (sensor->dbCount == 0) break;
+      AD013_IndexMark(index, sensor->dbStart, sensor->dbCount,
+        sensor->code == AD013_CmdStoreChar::code);
+      break;
+
+    // The DB is not what we think it is
+    case AD013_CODE_TEMLATE_DB_RANGE_ERROR:
+    case AD013_CODE_TEMPLATE_READ_ERROR:
+    case AD013_CODE_DELETE_FAIL:
+    case AD013_CODE_TEMPLATE_DB_CLEAR_FAIL:
+    case AD013_CODE_FLASH_READ_WRITE_ERROR:
+    case AD013_CODE_TEMPLATE_DB_FULL:
+      index->valid = 0;
+      break;
+
+    default:
+      // Unknown outcome of a store or delete
+      if (sensor->dbCount > 0) index->valid = 0;
+  }
+}
+
+int AD013_IndexFindFree(AD013_Sensor * sensor, int start, int end) {
+
+  AD013_Index * index = AD013_IndexGet(sensor);
+
+  if (!index || !index->valid) return AD013_INDEX_UNKNOWN;
+
+  if (start < 0) start = 0;
+  if (end >= AD013_MAX_TEMPLATES) end = AD013_MAX_TEMPLATES - 1;
+
+  for (int id = start; id <= end; id++) {
+    // Skips the full bytes
+    if ((id & 0x07) == 0 && id + 7 <= end && index->bits[id >> 3] == 0xFF) {
+      id += 7;
+      continue;
+    }
+    if (!(index->bits[id >> 3] & (1 << (id & 0x07)))) return id;
+  }
+
+  return -1;
+}
+
+int AD013_IndexRangeEmpty(AD013_Sensor * sensor, int start, int end) {
+
+  AD013_Index * index = AD013_IndexGet(sensor);
+
+  if (!index || !index->valid) return AD013_INDEX_UNKNOWN;
+
+  if (start < 0) start = 0;
+  if (end >= AD013_MAX_TEMPLATES) end = AD013_MAX_TEMPLATES - 1;
+
+  for (int id = start; id <= end; id++) {
+    if (index->bits[id >> 3] & (1 << (id & 0x07))) return 0;
+  }
+
+  return 1;
+}
+
+void AD013_IndexInvalidate(AD013_Sensor * sensor) {
+  AD013_Index * index = AD013_IndexGet(sensor);
+  if (index) index->valid = 0;
+}
+
+static int AD013_AsyncStart(AD013_Sensor   * sensor,
+                            int              op,
+                            AD013_Callback   callback,
+                            void           * ctx) {
+
+  if (!sensor || !sensor->com || sensor->op != AD013_OP_NONE)
+    return -1;
+
+  sensor->op = op;
+  sensor->step = 0;
+  sensor->waiting = 0;
+  sensor->result = -1;
+  sensor->frames = 0;
+  sensor->dataIn = 0;
+  sensor->startedAt = millis();
+  sensor->wakeAt = sensor->startedAt;
+  sensor->deadline = sensor->startedAt;
+  sensor->expiresAt = sensor->startedAt + sensor->policy.deadline;
+  sensor->retry = 0;
+  sensor->resend = 0;
+  sensor->timedOut = 0;
+  sensor->txLen = 0;
+  sensor->waking = 0;
+  sensor->callback = callback;
+  sensor->ctx = ctx;
+
+  return 1;
+}
+
+static void AD013_AsyncTransmit(AD013_Sensor * sensor, int code,
+                                const byte * buff, int size) {
+
+  // Discards stale input from previous transactions
+  AD013_ParserInit(&sensor->parser);
+  while (sensor->com->available() > 0) sensor->com->read();
+
+  sensor->com->write(buff, size);
+  AD013_TRACE_FRAME(AD013_TRACE_TX, 0, buff, size, NULL, 0);
+
+  AD013_MetricsSent(code);
+
+  sensor->code = code;
+  sensor->frames++;
+  sensor->sentAt = millis();
+  sensor->sentUs = micros();
+  sensor->timing = 1;
+  sensor->waiting = 1;
+}
+
+static void AD013_AsyncWrite(AD013_Sensor * sensor, int code,
+                             const byte * buff, int size) {
+
+  // Keeps the frame for the retransmits
+  sensor->txLen = size <= (int) sizeof(sensor->txFrame) ? size : 0;
+  memcpy(sensor->txFrame, buff, sensor->txLen);
+  sensor->retry = 0;
+
+  AD013_IndexTrack(sensor, code, buff, size);
+
+  sensor->replyTimeout = sensor->policy.frameTimeout;
+  AD013_AsyncTransmit(sensor, code, buff, size);
+}
+
+static void AD013_AsyncSend(AD013_Sensor * sensor, int code) {
+
+  AD013_Frame frame;
+
+  // Runtime built frame (from the context params)
+  AD013_FrameBegin(&frame, sensor->devId, AD013_FLAG_COMMAND);
+  AD013_FramePut(&frame, (uint8_t) code);
+  AD013_FramePutN(&frame, sensor->params.buff, sensor->params.size);
+  AD013_FrameEnd(&frame);
+
+  AD013_AsyncWrite(sensor, code, frame.buff, frame.size);
+}
+
+template <class CMD, typename... Args>
+static void AD013_AsyncCmd(AD013_Sensor * sensor, Args... args) {
+
+  AD013_Frame frame;
+
+  const byte * prebuilt = AD013_PrebuiltFrame<CMD>(AD013_Tag<CMD::reqLen == 0>());
+
+  // Constant commands go out as they are
+  if (prebuilt && memcmp(sensor->devId, AD013_def_devid, sizeof(sensor->devId)) == 0) {
+    AD013_AsyncWrite(sensor, CMD::code, prebuilt, AD013_CONST_FRAME_SIZE);
+    return;
+  }
+
+  // Fields are written straight into the frame
+  AD013_FrameBegin(&frame, sensor->devId, AD013_FLAG_COMMAND);
+  AD013_FramePut(&frame, CMD::code);
+  CMD::put(&frame, args...);
+  AD013_FrameEnd(&frame);
+
+  AD013_AsyncWrite(sensor, CMD::code, frame.buff, frame.size);
+}
+
+template <class CMD>
+static inline bool AD013_ReplyHas(AD013_Sensor * sensor) {
+  // Checks the reply carries the data expected for the command
+  return sensor->parser.payload_len >= 1 + CMD::respLen;
+}
+
+static void AD013_AsyncWriteData(AD013_Sensor * sensor, uint8_t flag,
+                                 const byte * data, uint16_t size) {
+
+  byte head[AD013_MSG_OFFSET_CODE];
+  byte tail[2];
+  uint16_t len = size + 2;
+  uint16_t sum = flag + (len >> 8) + (len & 0xFF);
+
+  // Header, Device ID, Flag and Length (Data + Sum)
+  head[0] = AD013_MSG_HEADER_HI;
+  head[1] = AD013_MSG_HEADER_LO;
+  memcpy(head + AD013_MSG_OFFSET_DEVID, sensor->devId, sizeof(sensor->devId));
+  head[AD013_MSG_OFFSET_FLAG] = flag;
+  head[AD013_MSG_OFFSET_LENGTH] = len >> 8;
+  head[AD013_MSG_OFFSET_LENGTH + 1] = len & 0xFF;
+
+  for (uint16_t i = 0; i < size; i++) sum += data[i];
+  tail[0] = sum >> 8;
+  tail[1] = sum & 0xFF;
+
+  // The data goes out from the caller's buffer (no frame copy),
+  // the sensor does not ACK data packets
+  sensor->com->write(head, sizeof(head));
+  sensor->com->write(data, size);
+  sensor->com->write(tail, sizeof(tail));
+  AD013_TRACE_FRAME(AD013_TRACE_TX, 0, head, sizeof(head), data, size);
+
+  sensor->frames++;
+}
+
+static void AD013_AsyncExpect(AD013_Sensor * sensor, unsigned long ms) {
+  // Waits for one more reply packet (no command is sent)
+  sensor->sentAt = millis();
+  sensor->replyTimeout = ms;
+  sensor->waiting = 1;
+}
+
+static void AD013_AsyncDone(AD013_Sensor * sensor, int result) {
+
+  AD013_Callback callback = sensor->callback;
+
+  // Failures after a reply timeout (or at the deadline) are timeouts
+  if (result == -1 && sensor->timedOut) result = AD013_TIMEOUT;
+
+  sensor->lastOp = sensor->op;
+  sensor->op = AD013_OP_NONE;
+  sensor->waiting = 0;
+  sensor->dataIn = 0;
+  sensor->result = result;
+
+  // The callback can submit the next operation
+  if (callback) callback(sensor, result, sensor->ctx);
+}
+
+static int AD013_FlowError(AD013_Sensor * sensor) {
+  // Failed flows return -1, timeouts stay distinct
+  return sensor->result == AD013_TIMEOUT ? AD013_TIMEOUT : -1;
+}
+
+static void AD013_AsyncWait(AD013_Sensor * sensor, unsigned long ms) {
+  sensor->wakeAt = millis() + ms;
+}
+
+static bool AD013_AsyncRetry(AD013_Sensor * sensor, int ret) {
+
+  unsigned long wait = sensor->policy.backoff << sensor->retry;
+
+  // Only corrupted or short replies to the command itself (not the
+  // data packets or the later status packets) are retransmitted
+  if (ret != AD013_PARSE_BAD_SUM &&
+      !(ret == AD013_PARSE_MORE && sensor->parser.state != AD013_PARSER_HEADER_HI))
+    return false;
+
+  if (!sensor->txLen || !sensor->timing || sensor->dataIn ||
+      sensor->retry >= sensor->policy.retries)
+    return false;
+
+  // Not worth it if the deadline comes first
+  if (sensor->policy.deadline &&
+      (long)(millis() + wait - sensor->expiresAt) >= 0)
+    return false;
+
+  sensor->retry++;
+  sensor->resend = 1;
+  AD013_AsyncWait(sensor, wait);
+  AD013_METRICS_INC(retransmits);
+
+  return true;
+}
+
+                        // ============================
+                        // Finger Detection Functions
+                        // ============================
+
+static void AD013_TouchISR0(void) { if (AD013_touchSensors[0]) AD013_TouchNotify(AD013_touchSensors[0]); }
+#if AD013_MAX_TOUCH_PINS > 1
+static void AD013_TouchISR1(void) { if (AD013_touchSensors[1]) AD013_TouchNotify(AD013_touchSensors[1]); }
+#endif
+#if AD013_MAX_TOUCH_PINS > 2
+static void AD013_TouchISR2(void) { if (AD013_touchSensors[2]) AD013_TouchNotify(AD013_touchSensors[2]); }
+#endif
+#if AD013_MAX_TOUCH_PINS > 3
+static void AD013_TouchISR3(void) { if (AD013_touchSensors[3]) AD013_TouchNotify(AD013_touchSensors[3]); }
+#endif
+
+static void (* const AD013_touchISRs[])(void) = {
+  AD013_TouchISR0,
+#if AD013_MAX_TOUCH_PINS > 1
+  AD013_TouchISR1,
+#endif
+#if AD013_MAX_TOUCH_PINS > 2
+  AD013_TouchISR2,
+#endif
+#if AD013_MAX_TOUCH_PINS > 3
+  AD013_TouchISR3,
+#endif
+};
+
+void AD013_TouchNotify(AD013_Sensor * sensor) {
+  // A new touch can be another finger
+  AD013_RecentForget(sensor);
+  if (!sensor || sensor->touched) return;
+  sensor->touchedAt = millis();
+  sensor->touched = 1;
+}
+
+int AD013_SetTouchPin(AD013_Sensor * sensor,
+                      int            pin,
+                      int            mode) {
+
+  int slot = -1;
+
+  if (!sensor) return -1;
+
+  // Releases the previous interrupt (if any)
+  for (int i = 0; i < (int)(sizeof(AD013_touchISRs)/sizeof(AD013_touchISRs[0])); i++) {
+    if (AD013_touchSensors[i] == sensor) {
+      detachInterrupt(digitalPinToInterrupt(sensor->touchPin));
+      AD013_touchSensors[i] = NULL;
+    }
+    if (slot < 0 && AD013_touchSensors[i] == NULL) slot = i;
+  }
+
+  sensor->touched = 0;
+  sensor->touchPin = pin;
+  sensor->touchLevel = (mode == FALLING) ? LOW : HIGH;
+
+  if (pin < 0) return 1;
+
+  if (slot < 0) {
+    sensor->touchPin = AD013_TOUCH_NONE;
+    return -1;
+  }
+
+  AD013_touchSensors[slot] = sensor;
+  pinMode(pin, INPUT);
+  attachInterrupt(digitalPinToInterrupt(pin), AD013_touchISRs[slot], mode);
+
+  return 1;
+}
+
+unsigned long AD013_CaptureLatency(void) {
+  return AD013_captureMs;
+}
+
+unsigned long AD013_WakeLatency(void) {
+  return AD013_wakeMs;
+}
+
+static void AD013_WakeIssue(AD013_Sensor * sensor) {
+
+  AD013_Link * link = AD013_LinkGet(sensor->slot);
+
+  // Cached speed, device ID and password (no scan, no settle delay)
+  if (!sensor->baud && link) {
+    AD013_SensorBaud(sensor, link->baud);
+    sensor->baud = link->baud;
+    memcpy(sensor->devId, link->devId, sizeof(sensor->devId));
+    memcpy(sensor->passwd, link->passwd, sizeof(sensor->passwd));
+  }
+
+  // Short probes: the first reply means the sensor is up
+  AD013_AsyncCmd<AD013_CmdVerifyPwd>(sensor, AD013_get_uint32_value(sensor->passwd));
+  sensor->replyTimeout = AD013_WAKE_PROBE_TIMEOUT;
+  sensor->waking = 1;
+}
+
+static int AD013_WakeReply(AD013_Sensor * sensor, int code) {
+
+  sensor->waking = 0;
+
+  // Still booting (or no answer yet), probes again
+  if (code != AD013_CODE_OK) return 0;
+
+  AD013_wakeMs = millis() - (sensor->touched ? sensor->touchedAt : sensor->startedAt);
+  sensor->wakeLatency = AD013_wakeMs;
+  sensor->asleep = 0;
+
+  if (AD013_DEBUG_IS_ENABLED)
+    printf("Sensor Ready (Wake: %lu ms)\n", AD013_wakeMs);
+
+  return 1;
+}
+
+static void AD013_WakeGate(AD013_Sensor * sensor, int code) {
+
+  // Asleep: nothing goes to the UART until a touch wakes the sensor
+  // up, then the link is checked before the first command of the
+  // operation. The finger flows wait up to their timeOut
+  unsigned long limit = sensor->startedAt + AD013_WAKE_TIMEOUT;
+
+  if ((long)(sensor->deadline - limit) > 0) limit = sensor->deadline;
+
+  if (code != AD013_STEP_ISSUE) {
+    AD013_WakeReply(sensor, code);
+    return;
+  }
+
+  if ((long)(millis() - limit) >= 0) {
+    if (AD013_DEBUG_IS_ENABLED) printf("Sensor still asleep, aborting...\n");
+    sensor->timedOut = 1;
+    AD013_AsyncDone(sensor, -1);
+    return;
+  }
+
+  // Finger already on (no edge)
+  if (sensor->touchPin >= 0 && !sensor->touched &&
+      digitalRead(sensor->touchPin) == sensor->touchLevel) {
+    sensor->touchedAt = millis();
+    sensor->touched = 1;
+  }
+
+  if (sensor->touched) AD013_WakeIssue(sensor);
+}
+
+static void AD013_FingerStart(AD013_Sensor * sensor) {
+  // Starts the wait for a finger (call when the flow starts). A touch
+  // latched before the flow is kept, and the touch output is sampled
+  // for a finger that was already on (no edge to catch). A latched
+  // touch is a new placement, the recent match no longer applies
+  if (sensor->touched) AD013_RecentForget(sensor);
+  if (sensor->touchPin >= 0) {
+    if (digitalRead(sensor->touchPin) != sensor->touchLevel) {
+      sensor->touched = 0;
+    } else if (!sensor->touched) {
+      sensor->touchedAt = millis();
+      sensor->touched = 1;
+    }
+  }
+  sensor->pollPeriod = AD013_POLL_MIN_PERIOD;
+  sensor->lastPollAt = millis();
+}
+
+static int AD013_FingerIssue(AD013_Sensor * sensor) {
+
+  // Checks for Timeout Conditions
+  if ((long)(millis() - sensor->deadline) >= 0) {
+    if (AD013_DEBUG_IS_ENABLED) printf("Timeout Reached, aborting...\n");
+    sensor->timedOut = 1;
+    return -1;
+  }
+
+  // Touch detection: nothing to send until the interrupt fires
+  if (sensor->touchPin != AD013_TOUCH_NONE && !sensor->touched)
+    return 0;
+
+  AD013_AsyncCmd<AD013_CmdGetImage>(sensor);
+
+  return 1;
+}
+
+static int AD013_FingerReply(AD013_Sensor * sensor, int code) {
+
+  unsigned long now = millis();
+
+  // The finger is gone, the next match needs a new search
+  if (code == AD013_CODE_NO_FINGER) AD013_RecentForget(sensor);
+
+  if (code == AD013_CODE_OK) {
+    // Measures the first touch to capture latency
+    AD013_captureMs = now - (sensor->touched ? sensor->touchedAt : sensor->lastPollAt);
+    sensor->captureLatency = AD013_captureMs;
+    sensor->touched = 0;
+    return 1;
+  }
+
+  // Checks for specific errors
+  if (code == AD013_CODE_ERROR || code == AD013_CODE_IMAGE_FAIL) {
+    // Packet Error (0x01) or Failure (0x03)
+    if (AD013_DEBUG_IS_ENABLED)
+      printf("ERROR: Cannot Get Image (code: %d)\n", code);
+  }
+
+  // Checks for Timeout Conditions
+  if ((long)(now - sensor->deadline) >= 0) {
+    if (AD013_DEBUG_IS_ENABLED) printf("Timeout Reached, aborting...\n");
+    sensor->timedOut = 1;
+    return -1;
+  }
+
+  if (sensor->touchPin != AD013_TOUCH_NONE) {
+    // Still touching (image not ready yet), retries shortly,
+    // otherwise waits for the next touch
+    if (sensor->touchPin >= 0 && digitalRead(sensor->touchPin) == sensor->touchLevel) {
+      AD013_AsyncWait(sensor, AD013_TOUCH_RETRY_PERIOD);
+    } else {
+      sensor->touched = 0;
+    }
+    return 0;
+  }
+
+  // Adaptive Polling: fingers are usually presented right
+  // away, backs off the longer the sensor stays untouched
+  sensor->lastPollAt = now;
+  AD013_AsyncWait(sensor, sensor->pollPeriod);
+  sensor->pollPeriod *= 2;
+  if (sensor->pollPeriod > AD013_POLL_MAX_PERIOD)
+    sensor->pollPeriod = AD013_POLL_MAX_PERIOD;
+
+  return 0;
+}
+
+static void AD013_CommandStep(AD013_Sensor * sensor, int code) {
+  if (code == AD013_STEP_ISSUE) AD013_AsyncSend(sensor, sensor->code);
+  else AD013_AsyncDone(sensor, code);
+}
+
+static void AD013_FindSensorDone(AD013_Sensor * sensor, int result) {
+
+  // Remembers the working speed and device ID
+  if (result > 0) AD013_LinkSave(sensor);
+  else sensor->baud = 0;
+
+  AD013_discoveryMs = millis() - sensor->startedAt;
+
+  if (AD013_DEBUG_IS_ENABLED)
+    printf("Discovery Time: %lu ms\n", AD013_discoveryMs);
+
+  AD013_AsyncDone(sensor, result);
+}
+
+static void AD013_FindSensorStep(AD013_Sensor * sensor, int code) {
+
+  int speeds = sizeof(AD013_speedVals)/sizeof(AD013_speedVals[0]);
+  AD013_Link * link = AD013_LinkGet(sensor->slot);
+
+  if (code == AD013_STEP_ISSUE) {
+
+    // Step 0 sets the speed and waits for the link to settle,
+    // step 1 verifies the password
+    if (sensor->step == 0) {
+      long speed = sensor->serSpeed;
+      if (sensor->serSpeed < 0) {
+        if (sensor->speedIdx == AD013_FIND_CACHED) {
+          // Last-good speed and device ID first
+          speed = link->baud;
+          memcpy(sensor->devId, link->devId, sizeof(sensor->devId));
+        } else {
+          // Full scan (skips the already tried cached speed)
+          speed = AD013_speedVals[sensor->speedIdx];
+          memcpy(sensor->devId, sensor->params.devId, sizeof(sensor->devId));
+          if (link && (long) link->baud == speed &&
+              memcmp(link->devId, sensor->devId, sizeof(sensor->devId)) == 0) {
+            if (++sensor->speedIdx >= speeds) AD013_FindSensorDone(sensor, -1);
+            return;
+          }
+        }
+      }
+      if (speed > 0) {
+        if (AD013_DEBUG_IS_ENABLED) printf("Checking Speed %ld baud ....: ", speed);
+        AD013_SensorBaud(sensor, speed);
+        sensor->baud = speed;
+      }
+      sensor->step = 1;
+      AD013_AsyncWait(sensor, AD013_SPEED_SETTLE_DELAY);
+    } else {
+      AD013_AsyncCmd<AD013_CmdVerifyPwd>(sensor, AD013_get_uint32_value(sensor->passwd));
+      // Wrong speeds just do not answer, no need to wait for long
+      if (sensor->serSpeed < 0) sensor->replyTimeout = AD013_PROBE_TIMEOUT;
+    }
+    return;
+  }
+
+  if (code >= 0) {
+    if (AD013_DEBUG_IS_ENABLED) printf("Ok (Supported).\n");
+    AD013_FindSensorDone(sensor, 1);
+    return;
+  }
+
+  if (AD013_DEBUG_IS_ENABLED) printf("Not Supported\n");
+
+  // Tries the next speed (if scanning)
+  if (sensor->serSpeed < 0 && ++sensor->speedIdx < speeds) {
+    sensor->step = 0;
+    return;
+  }
+
+  // Debug
+  if (AD013_DEBUG_IS_ENABLED && sensor->serSpeed < 0)
+    printf("All Speed Failed, Aborting.\n");
+
+  AD013_FindSensorDone(sensor, -1);
+}
+
+static void AD013_UpgradeBaudStep(AD013_Sensor * sensor, int code) {
+
+
+  // Target speed (serSpeed) or previous speed when rolling back
+  long speed = sensor->step < AD013_UPGRADE_ROLLBACK_REG ?
+    sensor->serSpeed : sensor->prevBaud;
+
+  if (code == AD013_STEP_ISSUE) {
+    switch (sensor->step) {
+
+      case AD013_UPGRADE_WRITE_REG:
+      case AD013_UPGRADE_ROLLBACK_REG: {
+        // Writes the baud register (sensor replies at the old speed)
+        AD013_AsyncCmd<AD013_CmdWriteReg>(sensor, (uint8_t) AD013_REG_BAUD,
+          (uint8_t)(speed / AD013_BAUD_UNIT));
+      } break;
+
+      case AD013_UPGRADE_SWITCH:
+      case AD013_UPGRADE_ROLLBACK: {
+        if (AD013_DEBUG_IS_ENABLED) printf("Switching to %ld baud\n", speed);
+        AD013_SensorBaud(sensor, speed);
+        sensor->baud = speed;
+        sensor->step++;
+        AD013_AsyncWait(sensor, AD013_SPEED_SETTLE_DELAY);
+      } break;
+
+      default: {
+        // Verifies the link at the current speed
+        AD013_AsyncCmd<AD013_CmdVerifyPwd>(sensor, AD013_get_uint32_value(sensor->passwd));
+      }
+    }
+    return;
+  }
+
+  switch (sensor->step) {
+
+    case AD013_UPGRADE_WRITE_REG: {
+      // Nothing changed on failure
+      if (code != AD013_CODE_OK) {
+        if (AD013_DEBUG_IS_ENABLED) printf("ERROR: Cannot write baud register (%d)\n", code);
+        AD013_AsyncDone(sensor, -1);
+        return;
+      }
+      sensor->step = AD013_UPGRADE_SWITCH;
+    } break;
+
+    case AD013_UPGRADE_VERIFY: {
+      if (code == AD013_CODE_OK) {
+        AD013_LinkSave(sensor);
+        AD013_AsyncDone(sensor, 1);
+        return;
+      }
+      // Rolls back, the register write is attempted at the
+      // new speed (for a sensor that switched but did not verify)
+      if (AD013_DEBUG_IS_ENABLED) printf("Verify failed at %ld baud, rolling back\n", speed);
+      sensor->step = AD013_UPGRADE_ROLLBACK_REG;
+    } break;
+
+    case AD013_UPGRADE_ROLLBACK_REG: {
+      // Goes back to the old speed regardless of the reply
+      sensor->step = AD013_UPGRADE_ROLLBACK;
+    } break;
+
+    case AD013_UPGRADE_REVERIFY: {
+      if (code == AD013_CODE_OK) {
+        AD013_LinkSave(sensor);
+        AD013_AsyncDone(sensor, -1);
+        return;
+      }
+      // Link lost, a new discovery is needed
+      sensor->baud = 0;
+      AD013_AsyncDone(sensor, -2);
+    } break;
+
+    default:
+      AD013_AsyncDone(sensor, -1);
+  }
+}
+
+static void AD013_MatchStart(AD013_Sensor * sensor) {
+  sensor->match.status = -1;
+  sensor->match.templateId = -1;
+  sensor->match.score = 0;
+  sensor->match.quality = AD013_CODE_OK;
+  sensor->match.elapsed = 0;
+}
+
+static void AD013_MatchDone(AD013_Sensor * sensor, int status,
+                            int templateId, int score) {
+
+  AD013_SearchResult * match = &sensor->match;
+
+  match->status = status;
+  match->templateId = templateId;
+  match->score = score;
+  match->elapsed = millis() - sensor->startedAt;
+
+  // Applies the host-side threshold (the candidate and its
+  // score are kept for tuning)
+  if (status == AD013_CODE_OK && score < sensor->threashold) {
+    if (AD013_DEBUG_IS_ENABLED)
+      printf("Template %d rejected (Score: %d < %d)\n",
+        templateId, score, sensor->threashold);
+    match->status = AD013_CODE_FINGER_NOT_FOUND;
+  }
+
+  AD013_AsyncDone(sensor, match->status == AD013_CODE_OK ? templateId : -1);
+}
+
+                        // ========================
+                        // Search Planner Functions
+                        // ========================
+
+int AD013_SetSearchTiers(const AD013_SearchRange * tiers, int count) {
+
+  if (count > AD013_MAX_SEARCH_TIERS) return -1;
+
+  if (!tiers) {
+    // Default Tiers (SO range, then the users' range)
+    AD013_tiers[0].start = 0;
+    AD013_tiers[0].count = AD013_SO_TEMPLATES;
+    AD013_tiers[1].start = AD013_SO_TEMPLATES;
+    AD013_tiers[1].count = AD013_MAX_TEMPLATES - AD013_SO_TEMPLATES;
+    AD013_tiersLen = 2;
+    return 1;
+  }
+
+  memcpy(AD013_tiers, tiers, count * sizeof(AD013_SearchRange));
+  AD013_tiersLen = count;
+
+  return 1;
+}
+
+void AD013_GetSearchStats(AD013_SearchStats * stats) {
+  if (stats) *stats = AD013_searchStats;
+}
+
+void AD013_ResetSearchStats(void) {
+  memset(&AD013_searchStats, 0, sizeof(AD013_searchStats));
+}
+
+void AD013_SetMatchCacheTTL(unsigned long ttl) {
+  AD013_recentTtl = ttl;
+  if (!ttl) memset(AD013_recent, 0, sizeof(AD013_recent));
+}
+
+static void AD013_HotTouch(AD013_Sensor * sensor, uint16_t templateId) {
+
+  AD013_Hot * hot = AD013_HotGet(sensor);
+  int i = 0;
+
+  if (!hot) return;
+
+  // Finds the entry (or drops the least recent one)
+  for (i = 0; i < hot->len; i++)
+    if (hot->ids[i] == templateId) break;
+  if (i == hot->len) {
+    if (hot->len < AD013_HOT_SIZE) hot->len++;
+    i = hot->len - 1;
+  }
+
+  // Moves it to the front
+  for (; i > 0; i--) hot->ids[i] = hot->ids[i - 1];
+  hot->ids[0] = templateId;
+}
+
+static void AD013_PlanAdd(AD013_Sensor * sensor, uint8_t tier,
+                          uint16_t start, uint16_t count) {
+
+  if (count == 0) return;
+
+  // Merges adjacent ranges of the same tier
+  if (sensor->planLen > 0 && sensor->planTier[sensor->planLen - 1] == tier) {
+    AD013_SearchRange * last = &sensor->plan[sensor->planLen - 1];
+    if (last->start + last->count == start) {
+      last->count += count;
+      return;
+    }
+  }
+
+  if (sensor->planLen >= AD013_MAX_SEARCH_RANGES) return;
+
+  sensor->plan[sensor->planLen].start = start;
+  sensor->plan[sensor->planLen].count = count;
+  sensor->planTier[sensor->planLen++] = tier;
+}
+
+static void AD013_PlanBuild(AD013_Sensor * sensor) {
+
+  uint16_t limit = sensor->soOnly ? AD013_SO_TEMPLATES : AD013_MAX_TEMPLATES;
+  AD013_Hot * hot = AD013_HotGet(sensor);
+  uint16_t skip[AD013_HOT_SIZE];
+  uint8_t skipLen = 0;
+
+  sensor->planLen = 0;
+  sensor->planIdx = 0;
+
+  // Hot Tier (recently matched templates), also kept in ID order
+  // to be left out of the configured tiers
+  for (int i = 0; hot && i < hot->len; i++) {
+    uint16_t id = hot->ids[i];
+    int j = 0;
+    if (id >= limit) continue;
+    AD013_PlanAdd(sensor, 0, id, 1);
+    for (j = skipLen++; j > 0 && skip[j - 1] > id; j--) skip[j] = skip[j - 1];
+    skip[j] = id;
+  }
+
+  // Configured Tiers (clipped to the SO range if needed), split
+  // around the hot IDs while there is room for the remaining tiers
+  for (int i = 0; i < AD013_tiersLen; i++) {
+    uint16_t start = AD013_tiers[i].start;
+    uint16_t end = start + AD013_tiers[i].count;
+    if (end > limit) end = limit;
+    for (int j = 0; j < skipLen && start < end; j++) {
+      if (skip[j] < start || skip[j] >= end) continue;
+      if (sensor->planLen + 1 + (AD013_tiersLen - i) > AD013_MAX_SEARCH_RANGES) break;
+      AD013_PlanAdd(sensor, i + 1, start, skip[j] - start);
+      start = skip[j] + 1;
+    }
+    if (start < end) AD013_PlanAdd(sensor, i + 1, start, end - start);
+  }
+}
+
+static void AD013_SearchDone(AD013_Sensor * sensor, int status,
+                             int templateId, int score) {
+
+  AD013_SearchStats * stats = &AD013_searchStats;
+  unsigned long elapsed = millis() - sensor->searchAt;
+
+  stats->searches++;
+  stats->totalMs += elapsed;
+
+  // Early tier hits and latency (only accepted matches)
+  if (status == AD013_CODE_OK && score >= sensor->threashold) {
+    uint8_t tier = sensor->planTier[sensor->planIdx];
+    stats->matches++;
+    stats->tierHits[tier]++;
+    stats->tierMs[tier] += elapsed;
+    AD013_HotTouch(sensor, templateId);
+
+    // Answers the next searches while the finger stays on (until a
+    // new touch, a capture without finger or the TTL)
+    if (AD013_recentTtl &&
+        sensor->slot >= 0 && sensor->slot < AD013_MAX_LINK_SLOTS) {
+      AD013_Recent * recent = &AD013_recent[sensor->slot];
+      recent->valid = 1;
+      recent->templateId = templateId;
+      recent->score = score;
+      recent->seenAt = millis();
+    }
+  }
+
+  AD013_MatchDone(sensor, status, templateId, score);
+}
+
+static bool AD013_RecentMatch(AD013_Sensor * sensor) {
+
+  AD013_Recent * recent = NULL;
+  unsigned long now = millis();
+
+  if (sensor->slot < 0 || sensor->slot >= AD013_MAX_LINK_SLOTS) return false;
+  recent = &AD013_recent[sensor->slot];
+
+  if (!recent->valid) return false;
+
+  // Finger not checked for too long, it may have changed
+  if (now - recent->seenAt > AD013_recentTtl) {
+    recent->valid = 0;
+    return false;
+  }
+
+  // Must also be a match for this search
+  if (recent->score < sensor->threashold ||
+      (sensor->soOnly && recent->templateId >= AD013_SO_TEMPLATES))
+    return false;
+
+  recent->seenAt = now;
+  AD013_searchStats.suppressed++;
+
+  if (AD013_DEBUG_IS_ENABLED)
+    printf("Same Finger, Template: %d (No Search)\n", recent->templateId);
+
+  AD013_MatchDone(sensor, AD013_CODE_OK, recent->templateId, recent->score);
+
+  return true;
+}
+
+static void AD013_IdentifyStep(AD013_Sensor * sensor, int code) {
+
+
+  switch (sensor->step) {
+
+    case AD013_IDENTIFY_GET_IMAGE: {
+      int ret = (code == AD013_STEP_ISSUE) ?
+        AD013_FingerIssue(sensor) : AD013_FingerReply(sensor, code);
+
+      if (ret < 0) {
+        AD013_MatchDone(sensor, code == AD013_STEP_ISSUE ?
+          AD013_CODE_NO_FINGER : code, -1, 0);
+      } else if (ret > 0 && code != AD013_STEP_ISSUE) {
+        // Finger still on since the last match
+        if (AD013_RecentMatch(sensor)) return;
+        // DEBUG information
+        if (AD013_DEBUG_IS_ENABLED)
+          printf("Preparing to Match Finger...\n");
+        sensor->step = AD013_IDENTIFY_GEN_CHAR;
+      }
+
+      // Code 0x02 is for Fingerprint NOT on sensor (polling),
+      // the CPU is free until the next poll (or touch)
+    } break;
+
+    case AD013_IDENTIFY_GEN_CHAR: {
+      if (code == AD013_STEP_ISSUE) {
+        // Generates the Char/Template from the acquired
+        // Image into buffer (1)
+        AD013_AsyncCmd<AD013_CmdGenChar>(sensor, (uint8_t) 1);
+        return;
+      }
+
+      // Error Handling (e.g., AD013_CODE_FEATURE_FAIL_AMORPHOUS,
+      // AD013_CODE_FEATURE_FAIL_MINUTIAE, AD013_CODE_IMAGE_INCOMPLETE_ERROR)
+      sensor->match.quality = code;
+      if (code != AD013_CODE_OK) {
+        if (AD013_DEBUG_IS_ENABLED) 
+          printf("DETECTED CFS ERROR [%d]\n", code);
+        AD013_MatchDone(sensor, code, -1, 0);
+        return;
+      }
+
+      sensor->step = AD013_IDENTIFY_SEARCH;
+    } break;
+
+    case AD013_IDENTIFY_SEARCH: {
+      AD013_SearchRange * range = &sensor->plan[sensor->planIdx];
+
+      if (code == AD013_STEP_ISSUE) {
+        if (sensor->planIdx == 0) sensor->searchAt = millis();
+        if (sensor->planLen == 0) {
+          AD013_SearchDone(sensor, AD013_CODE_FINGER_NOT_FOUND, -1, 0);
+          return;
+        }
+        // Buffer Num. (1), Start Num. and Count
+        AD013_AsyncCmd<AD013_CmdSearch>(sensor, (uint8_t) 1, range->start, range->count);
+        AD013_searchStats.commands++;
+        return;
+      }
+
+      // Reply Data: Template ID (2 bytes) and Score (2 bytes)
+      if (code == AD013_CODE_OK && AD013_ReplyHas<AD013_CmdSearch>(sensor)) {
+        int matched_template = AD013_get_uint16_value((char *)sensor->parser.payload + 1);
+        int score = AD013_get_uint16_value((char *)sensor->parser.payload + 3);
+        if (AD013_DEBUG_IS_ENABLED)
+          printf("Matched Template: %d (Score: %d, Tier: %d)\n", matched_template,
+            score, sensor->planTier[sensor->planIdx]);
+        // Early Exit
+        if (score >= sensor->threashold) {
+          AD013_SearchDone(sensor, code, matched_template, score);
+          return;
+        }
+        // Below the threshold, keeps the best candidate and
+        // goes on with the next tiers
+        if (score > sensor->match.score) {
+          sensor->match.templateId = matched_template;
+          sensor->match.score = score;
+        }
+      } else if (code != AD013_CODE_FINGER_NOT_FOUND) {
+        if (AD013_DEBUG_IS_ENABLED) printf("ERROR: Code %d\n", code);
+        AD013_SearchDone(sensor, code == AD013_CODE_OK ? -1 : code, -1, 0);
+        return;
+      }
+
+      // Next Range
+      if (sensor->planIdx + 1 < sensor->planLen) {
+        sensor->planIdx++;
+        return;
+      }
+
+      // Not found in any tier (reports the best candidate)
+      AD013_SearchDone(sensor, sensor->match.templateId >= 0 ?
+        AD013_CODE_OK : AD013_CODE_FINGER_NOT_FOUND,
+        sensor->match.templateId, sensor->match.score);
+    } break;
+
+    default:
+      AD013_MatchDone(sensor, -1, -1, 0);
+  }
+}
+
+static void AD013_VerifyStep(AD013_Sensor * sensor, int code) {
+
+  switch (sensor->step) {
+
+    case AD013_VERIFY_LOAD_CHAR: {
+      if (code == AD013_STEP_ISSUE) {
+        // Loads the claimed template into buffer (2) first, an
+        // empty slot fails before waiting for the finger
+        AD013_AsyncCmd<AD013_CmdLoadChar>(sensor, (uint8_t) 2, (uint16_t) sensor->targetId);
+        return;
+      }
+
+      if (code != AD013_CODE_OK) {
+        if (AD013_DEBUG_IS_ENABLED)
+          printf("ERROR: Cannot load template %d (code: %d)\n", sensor->targetId, code);
+        AD013_MatchDone(sensor, code, -1, 0);
+        return;
+      }
+
+      // Debug Information
+      if (AD013_DEBUG_IS_ENABLED)
+        printf("Please put finger on sensor...\n");
+
+      AD013_FingerStart(sensor);
+      sensor->step = AD013_VERIFY_GET_IMAGE;
+    } break;
+
+    case AD013_VERIFY_GET_IMAGE: {
+      int ret = (code == AD013_STEP_ISSUE) ?
+        AD013_FingerIssue(sensor) : AD013_FingerReply(sensor, code);
+
+      if (ret < 0) {
+        AD013_MatchDone(sensor, code == AD013_STEP_ISSUE ?
+          AD013_CODE_NO_FINGER : code, -1, 0);
+      } else if (ret > 0 && code != AD013_STEP_ISSUE) {
+        sensor->step = AD013_VERIFY_GEN_CHAR;
+      }
+    } break;
+
+    case AD013_VERIFY_GEN_CHAR: {
+      if (code == AD013_STEP_ISSUE) {
+        // Fresh capture into buffer (1)
+        AD013_AsyncCmd<AD013_CmdGenChar>(sensor, (uint8_t) 1);
+        return;
+      }
+
+      sensor->match.quality = code;
+      if (code != AD013_CODE_OK) {
+        if (AD013_DEBUG_IS_ENABLED)
+          printf("DETECTED CFS ERROR [%d]\n", code);
+        AD013_MatchDone(sensor, code, -1, 0);
+        return;
+      }
+
+      sensor->step = AD013_VERIFY_MATCH;
+    } break;
+
+    case AD013_VERIFY_MATCH: {
+      if (code == AD013_STEP_ISSUE) {
+        // Matches buffer (1) against buffer (2)
+        AD013_AsyncCmd<AD013_CmdMatch>(sensor);
+        return;
+      }
+
+      // Reply Data: Score (2 bytes), code is 0x08 if not matched
+      int score = AD013_ReplyHas<AD013_CmdMatch>(sensor) ?
+        AD013_get_uint16_value((char *)sensor->parser.payload + 1) : 0;
+
+      if (AD013_DEBUG_IS_ENABLED)
+        printf("Verify Template: %d (code: %d, Score: %d)\n", sensor->targetId, code, score);
+
+      AD013_MatchDone(sensor, code,
+        code == AD013_CODE_OK ? sensor->targetId : -1, score);
+    } break;
+
+    default:
+      AD013_MatchDone(sensor, -1, -1, 0);
+  }
+}
+
+static void AD013_AutoIdentifyStep(AD013_Sensor * sensor, int code) {
+
+  byte         * data   = sensor->parser.payload + 1;
+  long           left   = (long)(sensor->deadline - millis());
+
+  if (code == AD013_STEP_ISSUE) {
+    // Single command, the sensor streams the stages back
+    AD013_AsyncCmd<AD013_CmdAutoIdentify>(sensor, (uint8_t) sensor->securityLevel,
+      (uint16_t) AD013_AUTO_ID_ANY, (uint16_t) AD013_AUTO_PARAM_STAGES);
+    return;
+  }
+
+  if (code != AD013_CODE_OK || sensor->parser.payload_len < 2) {
+    // Host-side timeout, the sensor is still waiting for a
+    // finger: cancels the command (the reply is discarded
+    // with the next command)
+    if (code == -1 && left <= 0) {
+      AD013_AsyncCmd<AD013_CmdCancel>(sensor);
+      if (AD013_DEBUG_IS_ENABLED) printf("Timeout Reached, aborting...\n");
+    } else if (AD013_DEBUG_IS_ENABLED) {
+      printf("ERROR: Auto-Identify failed (code: %d)\n", code);
+    }
+    AD013_MatchDone(sensor, code, -1, 0);
+    return;
+  }
+
+  switch (data[0]) {
+
+    case AD013_AUTO_STAGE_RESULT: {
+      // Stage (1 byte), Template ID (2 bytes) and Score (2 bytes)
+      if (!AD013_ReplyHas<AD013_CmdAutoIdentify>(sensor)) {
+        AD013_MatchDone(sensor, -1, -1, 0);
+        return;
+      }
+      int matched_template = AD013_get_uint16_value((char *)data + 1);
+      int score = AD013_get_uint16_value((char *)data + 3);
+      if (AD013_DEBUG_IS_ENABLED)
+        printf("Matched Template: %d (Score: %d)\n", matched_template, score);
+      AD013_MatchDone(sensor, AD013_CODE_OK, matched_template, score);
+    } break;
+
+    default: {
+      if (AD013_DEBUG_IS_ENABLED && data[0] == AD013_AUTO_STAGE_IMAGE)
+        printf("Preparing to Match Finger...\n");
+      // Waits for the next stage (finger, extraction, search)
+      // for as long as the deadline allows
+      AD013_AsyncExpect(sensor, left > 0 ? left : 0);
+    }
+  }
+}
+
+static int AD013_IndexReadPage(AD013_Sensor * sensor, int page, int code) {
+
+  AD013_Index * index = AD013_IndexGet(sensor);
+  int offset = page * (AD013_INDEX_PAGE_SIZE / 8);
+  int len = sizeof(index->bits) - offset;
+
+  if (code != AD013_CODE_OK || !AD013_ReplyHas<AD013_CmdReadIndex>(sensor)) {
+    if (AD013_DEBUG_IS_ENABLED) printf("ERROR: Cannot read the index (%d)\n", code);
+    return -1;
+  }
+
+  // Reply Data: Occupancy Bits (32 bytes per page)
+  if (len > AD013_CmdReadIndex::respLen) len = AD013_CmdReadIndex::respLen;
+  memcpy(index->bits + offset, sensor->parser.payload + 1, len);
+
+  if (page + 1 < AD013_INDEX_PAGES) return 0;
+
+  // Drops the bits past the DB size
+  if (AD013_MAX_TEMPLATES % 8)
+    index->bits[sizeof(index->bits) - 1] &= (1 << (AD013_MAX_TEMPLATES % 8)) - 1;
+
+  // A new index, the known hashes may be stale
+  AD013_HashForget(index, 0, AD013_MAX_TEMPLATES);
+  index->valid = 1;
+  return 1;
+}
+
+static void AD013_LoadIndexStep(AD013_Sensor * sensor, int code) {
+
+  int ret = 0;
+
+  if (code == AD013_STEP_ISSUE) {
+    // Index Page
+    AD013_AsyncCmd<AD013_CmdReadIndex>(sensor, sensor->step);
+    return;
+  }
+
+  if ((ret = AD013_IndexReadPage(sensor, sensor->step, code)) < 0) {
+    AD013_AsyncDone(sensor, code == AD013_CODE_OK ? -1 : code);
+    return;
+  }
+
+  if (ret == 0) {
+    sensor->step++;
+    return;
+  }
+
+  AD013_AsyncDone(sensor, 1);
+}
+
+static void AD013_ClearStep(AD013_Sensor * sensor, int code) {
+
+  AD013_SearchRange * range = &sensor->plan[sensor->planIdx];
+
+  if (code == AD013_STEP_ISSUE) {
+    if (sensor->planLen == 0) {
+      // Nothing stored in the range
+      AD013_AsyncDone(sensor, 1);
+    } else if (range->start == 0 && range->count >= AD013_MAX_TEMPLATES) {
+      AD013_AsyncCmd<AD013_CmdEmpty>(sensor);
+    } else {
+      // Template ID and Count
+      AD013_AsyncCmd<AD013_CmdDeletChar>(sensor, range->start, range->count);
+    }
+    return;
+  }
+
+  if (code != AD013_CODE_OK) {
+    if (AD013_DEBUG_IS_ENABLED) printf("ERROR: Cannot delete templates (%d)\n", code);
+    AD013_AsyncDone(sensor, code);
+    return;
+  }
+
+  if (++sensor->planIdx < sensor->planLen) return;
+
+  AD013_AsyncDone(sensor, 1);
+}
+
+static void AD013_EnrollDone(AD013_Sensor * sensor, int status) {
+
+  AD013_EnrollResult * enroll = &sensor->enroll;
+
+  enroll->status = status;
+  if (status != AD013_CODE_OK) enroll->templateId = -1;
+  enroll->elapsed = millis() - sensor->startedAt;
+
+  if (AD013_DEBUG_IS_ENABLED)
+    printf("Enroll Done (Status: %d, ID: %d, Retries: %d, Time: %lu ms)\n",
+      status, enroll->templateId, enroll->retries, enroll->elapsed);
+
+  AD013_AsyncDone(sensor, status == AD013_CODE_OK ? enroll->templateId : -1);
+}
+
+static int AD013_EnrollPickSlot(AD013_Sensor * sensor) {
+
+  // Explicit Template ID
+  if (sensor->targetId >= 0) {
+    sensor->enroll.templateId = sensor->targetId;
+    return 1;
+  }
+
+  // First free ID in the SO or users' range
+  sensor->enroll.templateId = sensor->soOnly ?
+    AD013_IndexFindFree(sensor, 0, AD013_SO_TEMPLATES - 1) :
+    AD013_IndexFindFree(sensor, AD013_SO_TEMPLATES, AD013_MAX_TEMPLATES - 1);
+
+  return sensor->enroll.templateId >= 0 ? 1 : -1;
+}
+
+static void AD013_EnrollStep(AD013_Sensor * sensor, int code) {
+
+  AD013_EnrollResult * enroll = &sensor->enroll;
+
+  switch (sensor->step) {
+
+    case AD013_ENROLL_LOAD_INDEX: {
+      int ret = 0;
+
+      if (code == AD013_STEP_ISSUE) {
+        // Index Page (planIdx)
+        AD013_AsyncCmd<AD013_CmdReadIndex>(sensor, sensor->planIdx);
+        return;
+      }
+
+      if ((ret = AD013_IndexReadPage(sensor, sensor->planIdx, code)) < 0) {
+        AD013_EnrollDone(sensor, code == AD013_CODE_OK ? -1 : code);
+        return;
+      }
+
+      if (ret == 0) {
+        sensor->planIdx++;
+        return;
+      }
+
+      if (AD013_EnrollPickSlot(sensor) < 0) {
+        AD013_EnrollDone(sensor, AD013_CODE_TEMPLATE_DB_FULL);
+        return;
+      }
+
+      sensor->step = AD013_ENROLL_GET_IMAGE;
+    } break;
+
+    case AD013_ENROLL_GET_IMAGE: {
+      int ret = (code == AD013_STEP_ISSUE) ?
+        AD013_FingerIssue(sensor) : AD013_FingerReply(sensor, code);
+
+      if (ret < 0) {
+        AD013_EnrollDone(sensor, code == AD013_STEP_ISSUE ?
+          AD013_CODE_NO_FINGER : code);
+      } else if (ret > 0 && code != AD013_STEP_ISSUE) {
+        sensor->step = AD013_ENROLL_GEN_CHAR;
+      }
+    } break;
+
+    case AD013_ENROLL_GEN_CHAR: {
+      if (code == AD013_STEP_ISSUE) {
+        // One char buffer per capture (1 to 5)
+        AD013_AsyncCmd<AD013_CmdGenChar>(sensor, (uint8_t)(sensor->capture + 1));
+        return;
+      }
+
+      switch (code) {
+        case AD013_CODE_OK:
+          break;
+
+        // Bad capture, retakes this one only
+        case AD013_CODE_FEATURE_FAIL_LIGTH_DRY:
+        case AD013_CODE_FEATURE_FAIL_DARK_WET:
+        case AD013_CODE_FEATURE_FAIL_AMORPHOUS:
+        case AD013_CODE_FEATURE_FAIL_MINUTIAE:
+          if (enroll->captureRetries[sensor->capture] >= AD013_ENROLL_MAX_RETRIES) {
+            AD013_EnrollDone(sensor, code);
+            return;
+          }
+          if (AD013_DEBUG_IS_ENABLED)
+            printf("Capture %d rejected (code: %d), please retry...\n",
+              sensor->capture + 1, code);
+          enroll->captureRetries[sensor->capture]++;
+          enroll->retries++;
+          sensor->step = AD013_ENROLL_GET_IMAGE;
+          AD013_FingerStart(sensor);
+          return;
+
+        default:
+          AD013_EnrollDone(sensor, code);
+          return;
+      }
+
+      enroll->captures = ++sensor->capture;
+
+      if (sensor->capture == 1) {
+        // Duplicate check before the other captures
+        sensor->step = AD013_ENROLL_DUP_SEARCH;
+      } else if (sensor->capture < AD013_ENROLL_CAPTURES) {
+        // Next capture from a new press
+        sensor->step = AD013_ENROLL_LIFT;
+      } else {
+        sensor->step = AD013_ENROLL_REG_MODEL;
+      }
+    } break;
+
+    case AD013_ENROLL_DUP_SEARCH: {
+      if (code == AD013_STEP_ISSUE) {
+        // Nothing to search in an empty DB
+        if (AD013_IndexRangeEmpty(sensor, 0, AD013_MAX_TEMPLATES - 1) == 1) {
+          code = AD013_CODE_FINGER_NOT_FOUND;
+        } else {
+          // Buffer Num. (1), Start Num. and Count (whole DB)
+          AD013_AsyncCmd<AD013_CmdSearch>(sensor, (uint8_t) 1, (uint16_t) 0,
+            (uint16_t) AD013_MAX_TEMPLATES);
+          return;
+        }
+      }
+
+      // Reply Data: Template ID (2 bytes) and Score (2 bytes)
+      if (code == AD013_CODE_OK && AD013_ReplyHas<AD013_CmdSearch>(sensor)) {
+        int matched_template = AD013_get_uint16_value((char *)sensor->parser.payload + 1);
+        int score = AD013_get_uint16_value((char *)sensor->parser.payload + 3);
+        if (score >= sensor->threashold) {
+          if (AD013_DEBUG_IS_ENABLED)
+            printf("Finger already enrolled (ID: %d, Score: %d)\n", matched_template, score);
+          enroll->duplicateId = matched_template;
+          AD013_EnrollDone(sensor, AD013_ENROLL_DUPLICATE);
+          return;
+        }
+      } else if (code != AD013_CODE_FINGER_NOT_FOUND) {
+        AD013_EnrollDone(sensor, code == AD013_CODE_OK ? -1 : code);
+        return;
+      }
+
+      sensor->step = AD013_ENROLL_LIFT;
+    } break;
+
+    case AD013_ENROLL_LIFT: {
+      // Waits for the finger to leave: the same press gives the
+      // same minutiae in every char buffer and the merge fails
+      if ((long)(millis() - sensor->deadline) >= 0) {
+        if (AD013_DEBUG_IS_ENABLED) printf("Timeout Reached, aborting...\n");
+        sensor->timedOut = 1;
+        AD013_EnrollDone(sensor, AD013_CODE_NO_FINGER);
+        return;
+      }
+
+      if (sensor->touchPin >= 0) {
+        // Touch output still active, no traffic on the UART
+        if (digitalRead(sensor->touchPin) == sensor->touchLevel) {
+          AD013_AsyncWait(sensor, AD013_TOUCH_RETRY_PERIOD);
+          return;
+        }
+      } else if (code == AD013_STEP_ISSUE) {
+        AD013_AsyncCmd<AD013_CmdGetImage>(sensor);
+        return;
+      } else if (code != AD013_CODE_NO_FINGER) {
+        AD013_AsyncWait(sensor, AD013_POLL_MIN_PERIOD);
+        return;
+      }
+
+      if (AD013_DEBUG_IS_ENABLED)
+        printf("Finger lifted, put it again for capture %d...\n", sensor->capture + 1);
+
+      sensor->step = AD013_ENROLL_GET_IMAGE;
+      AD013_FingerStart(sensor);
+    } break;
+
+    case AD013_ENROLL_REG_MODEL: {
+      if (code == AD013_STEP_ISSUE) {
+        // Merges the chars into the template
+        AD013_AsyncCmd<AD013_CmdRegModel>(sensor);
+        return;
+      }
+
+      if (code != AD013_CODE_OK) {
+        AD013_EnrollDone(sensor, code);
+        return;
+      }
+
+      sensor->step = AD013_ENROLL_STORE;
+    } break;
+
+    case AD013_ENROLL_STORE: {
+      if (code == AD013_STEP_ISSUE) {
+        // Buffer Num. (1) and Template ID
+        AD013_AsyncCmd<AD013_CmdStoreChar>(sensor, (uint8_t) 1, (uint16_t) enroll->templateId);
+        return;
+      }
+
+      AD013_EnrollDone(sensor, code);
+    } break;
+
+    default:
+      AD013_EnrollDone(sensor, -1);
+  }
+}
+
+static void AD013_UploadStep(AD013_Sensor * sensor, int code) {
+
+  switch (sensor->step) {
+
+    case AD013_XFER_LOAD_CHAR: {
+      if (code == AD013_STEP_ISSUE) {
+        // Buffer Num. (1) and Template ID
+        AD013_AsyncCmd<AD013_CmdLoadChar>(sensor, (uint8_t) 1, (uint16_t) sensor->targetId);
+        return;
+      }
+      if (code != AD013_CODE_OK) {
+        AD013_AsyncDone(sensor, code);
+        return;
+      }
+      sensor->step = AD013_XFER_COMMAND;
+    } break;
+
+    case AD013_XFER_COMMAND: {
+      if (code == AD013_STEP_ISSUE) {
+        // Buffer Num. (1), the data packets follow the ACK
+        AD013_AsyncCmd<AD013_CmdUpChar>(sensor, (uint8_t) 1);
+        return;
+      }
+      if (code != AD013_CODE_OK) {
+        AD013_AsyncDone(sensor, code);
+        return;
+      }
+      sensor->step = AD013_XFER_DATA;
+      sensor->dataIn = 1;
+      sensor->dataAt = millis();
+      AD013_AsyncExpect(sensor, sensor->policy.frameTimeout);
+    } break;
+
+    case AD013_XFER_DATA: {
+      if (code != AD013_CODE_OK) {
+        if (AD013_DEBUG_IS_ENABLED)
+          printf("ERROR: Data packet lost after %lu bytes\n", sensor->dataBytes);
+        AD013_AsyncDone(sensor, code);
+        return;
+      }
+
+      // Straight from the reply buffer to the sink
+      if (sensor->sink(sensor->dataCtx, sensor->parser.payload,
+                       sensor->parser.payload_len) < 0) {
+        AD013_AsyncDone(sensor, -1);
+        return;
+      }
+      sensor->dataBytes += sensor->parser.payload_len;
+
+      if (sensor->parser.flag == AD013_FLAG_DATA_END) {
+        AD013_AsyncDone(sensor, 1);
+        return;
+      }
+      AD013_AsyncExpect(sensor, sensor->policy.frameTimeout);
+    } break;
+
+    default:
+      AD013_AsyncDone(sensor, -1);
+  }
+}
+
+static void AD013_DownloadStep(AD013_Sensor * sensor, int code) {
+
+  switch (sensor->step) {
+
+    case AD013_XFER_COMMAND: {
+      if (code == AD013_STEP_ISSUE) {
+        // Buffer Num. (1), the data packets follow the ACK
+        AD013_AsyncCmd<AD013_CmdDownChar>(sensor, (uint8_t) 1);
+        return;
+      }
+      if (code != AD013_CODE_OK) {
+        AD013_AsyncDone(sensor, code);
+        return;
+      }
+      sensor->step = AD013_XFER_DATA;
+      sensor->dataAt = millis();
+    } break;
+
+    case AD013_XFER_DATA: {
+      // The reply buffer is free while the data goes out and
+      // is used as the chunk buffer
+      byte * chunk = sensor->parser.payload;
+      int size = sensor->dataLeft < sensor->packetSize ?
+        (int) sensor->dataLeft : sensor->packetSize;
+      int got = sensor->source(sensor->dataCtx, chunk, size);
+
+      // A source that finds the end as it reads (AD013_RestoreDB())
+      // shortens dataLeft to the last packet
+      if (got != size && (got <= 0 || got != sensor->dataLeft)) {
+        if (AD013_DEBUG_IS_ENABLED)
+          printf("ERROR: Source ended after %lu bytes\n", sensor->dataBytes);
+        AD013_AsyncDone(sensor, -1);
+        return;
+      }
+
+      sensor->dataLeft -= got;
+      sensor->dataBytes += got;
+      AD013_AsyncWriteData(sensor, sensor->dataLeft > 0 ?
+        AD013_FLAG_DATA : AD013_FLAG_DATA_END, chunk, got);
+
+      if (sensor->dataLeft == 0) sensor->step = AD013_XFER_STORE_CHAR;
+    } break;
+
+    case AD013_XFER_STORE_CHAR: {
+      if (code == AD013_STEP_ISSUE) {
+        // Buffer Num. (1) and Template ID
+        AD013_AsyncCmd<AD013_CmdStoreChar>(sensor, (uint8_t) 1, (uint16_t) sensor->targetId);
+        return;
+      }
+      AD013_AsyncDone(sensor, code == AD013_CODE_OK ? 1 : code);
+    } break;
+
+    default:
+      AD013_AsyncDone(sensor, -1);
+  }
+}
+
+static uint16_t AD013_RingPush(AD013_Sensor * sensor, const byte * data, uint16_t size) {
+
+  uint16_t tail = (sensor->ringHead + sensor->ringLen) % sensor->ringSize;
+  uint16_t count = 0;
+
+  if (size > sensor->ringSize - sensor->ringLen) return 0;
+
+  // Zero-fills when no data is provided
+  for (count = 0; count < size; count++) {
+    sensor->ring[tail] = data ? data[count] : 0;
+    if (++tail == sensor->ringSize) tail = 0;
+  }
+  sensor->ringLen += size;
+
+  return size;
+}
+
+static int AD013_RingDrain(AD013_Sensor * sensor) {
+
+  while (sensor->ringLen > 0) {
+    // Contiguous part of the ring
+    uint16_t size = sensor->ringSize - sensor->ringHead;
+    if (size > sensor->ringLen) size = sensor->ringLen;
+
+    int ret = sensor->sink(sensor->dataCtx, sensor->ring + sensor->ringHead, size);
+    if (ret < 0) return -1;
+    if (ret == 0) break;  // Sink is busy, retries with the next packet
+
+    sensor->ringHead = (sensor->ringHead + ret) % sensor->ringSize;
+    sensor->ringLen -= ret;
+    sensor->dataBytes += ret;
+  }
+
+  return 1;
+}
+
+static void AD013_UploadImageDone(AD013_Sensor * sensor, int result) {
+
+  // Everything left goes to the sink
+  if (result == 1) {
+    uint16_t left = 0;
+    do {
+      left = sensor->ringLen;
+      if (AD013_RingDrain(sensor) < 0) left = 0;
+    } while (sensor->ringLen > 0 && sensor->ringLen < left);
+    if (sensor->ringLen > 0) result = -1;
+  }
+
+  // Complete, but with zero-filled packets
+  if (result == 1 && sensor->dataResyncs > 0) result = AD013_PARTIAL;
+
+  if (AD013_DEBUG_IS_ENABLED)
+    printf("Image Upload Done (%lu bytes, %lu packets, %lu resyncs, %lu ms)\n",
+      sensor->dataBytes, sensor->dataPackets, sensor->dataResyncs,
+      millis() - sensor->dataAt);
+
+  AD013_AsyncDone(sensor, result);
+}
+
+static void AD013_UploadImageStep(AD013_Sensor * sensor, int code) {
+
+  switch (sensor->step) {
+
+    case AD013_XFER_COMMAND: {
+      if (code == AD013_STEP_ISSUE) {
+        // Image Buffer, the data packets follow the ACK
+        AD013_AsyncCmd<AD013_CmdUpImage>(sensor);
+        return;
+      }
+      if (code != AD013_CODE_OK) {
+        AD013_AsyncDone(sensor, code);
+        return;
+      }
+      sensor->step = AD013_XFER_DATA;
+      sensor->dataIn = 1;
+      sensor->dataAt = millis();
+      AD013_AsyncExpect(sensor, sensor->policy.frameTimeout);
+    } break;
+
+    case AD013_XFER_DATA: {
+      const byte * data = sensor->parser.payload;
+      uint16_t size = sensor->parser.payload_len;
+
+      if (code == AD013_PARSE_BAD_SUM) {
+        // Keeps the image layout, the parser resyncs on the
+        // next header
+        if (AD013_DEBUG_IS_ENABLED)
+          printf("Packet %lu corrupted, resyncing...\n", sensor->dataPackets);
+        data = NULL;
+        size = sensor->packetSize;
+        sensor->dataResyncs++;
+      } else if (code == -1 && sensor->dataSize > 0 &&
+                 (long)(sensor->dataBytes + sensor->ringLen) >= sensor->dataSize) {
+        // Last packet lost, the image is complete anyway
+        AD013_UploadImageDone(sensor, 1);
+        return;
+      } else if (code != AD013_CODE_OK) {
+        if (AD013_DEBUG_IS_ENABLED)
+          printf("ERROR: Image upload failed after %lu bytes\n", sensor->dataBytes);
+        AD013_UploadImageDone(sensor, code);
+        return;
+      }
+
+      sensor->dataPackets++;
+
+      // Makes room if needed, then queues the packet
+      if (AD013_RingPush(sensor, data, size) != size &&
+          (AD013_RingDrain(sensor) < 0 || AD013_RingPush(sensor, data, size) != size)) {
+        if (AD013_DEBUG_IS_ENABLED) printf("ERROR: Image ring overflow\n");
+        AD013_UploadImageDone(sensor, -1);
+        return;
+      }
+
+      if (AD013_RingDrain(sensor) < 0) {
+        AD013_UploadImageDone(sensor, -1);
+        return;
+      }
+
+      if (code == AD013_CODE_OK && sensor->parser.flag == AD013_FLAG_DATA_END) {
+        AD013_UploadImageDone(sensor, 1);
+        return;
+      }
+      AD013_AsyncExpect(sensor, sensor->policy.frameTimeout);
+    } break;
+
+    default:
+      AD013_AsyncDone(sensor, -1);
+  }
+}
+
+static void AD013_SleepStep(AD013_Sensor * sensor, int code) {
+
+  if (code == AD013_STEP_ISSUE) {
+    // Already asleep (it would not answer)
+    if (sensor->asleep) {
+      AD013_AsyncDone(sensor, 1);
+      return;
+    }
+    AD013_AsyncCmd<AD013_CmdSleep>(sensor);
+    return;
+  }
+
+  // Touches from before the sleep are stale
+  if (code == AD013_CODE_OK) {
+    sensor->asleep = 1;
+    sensor->touched = 0;
+  }
+
+  AD013_AsyncDone(sensor, code == AD013_CODE_OK ? 1 : code);
+}
+
+static void AD013_WakeStep(AD013_Sensor * sensor, int code) {
+
+  if (code == AD013_STEP_ISSUE) {
+    if ((long)(millis() - sensor->deadline) >= 0) {
+      sensor->timedOut = 1;
+      AD013_AsyncDone(sensor, -1);
+      return;
+    }
+    AD013_WakeIssue(sensor);
+    return;
+  }
+
+  if (AD013_WakeReply(sensor, code) > 0) AD013_AsyncDone(sensor, 1);
+}
+
+static void AD013_AsyncStep(AD013_Sensor * sensor, int code) {
+
+  switch (sensor->op) {
+    case AD013_OP_COMMAND:
+      AD013_CommandStep(sensor, code);
+      break;
+
+    case AD013_OP_FIND_SENSOR:
+      AD013_FindSensorStep(sensor, code);
+      break;
+
+    case AD013_OP_IDENTIFY:
+      AD013_IdentifyStep(sensor, code);
+      break;
+
+    case AD013_OP_SET_BAUD:
+      AD013_UpgradeBaudStep(sensor, code);
+      break;
+
+    case AD013_OP_AUTO_IDENTIFY:
+      AD013_AutoIdentifyStep(sensor, code);
+      break;
+
+    case AD013_OP_VERIFY:
+      AD013_VerifyStep(sensor, code);
+      break;
+
+    case AD013_OP_LOAD_INDEX:
+      AD013_LoadIndexStep(sensor, code);
+      break;
+
+    case AD013_OP_CLEAR:
+      AD013_ClearStep(sensor, code);
+      break;
+
+    case AD013_OP_ENROLL:
+      AD013_EnrollStep(sensor, code);
+      break;
+
+    case AD013_OP_UPLOAD:
+      AD013_UploadStep(sensor, code);
+      break;
+
+    case AD013_OP_DOWNLOAD:
+      AD013_DownloadStep(sensor, code);
+      break;
+
+    case AD013_OP_UPLOAD_IMAGE:
+      AD013_UploadImageStep(sensor, code);
+      break;
+
+    case AD013_OP_SLEEP:
+      AD013_SleepStep(sensor, code);
+      break;
+
+    case AD013_OP_WAKE:
+      AD013_WakeStep(sensor, code);
+      break;
+
+    default:
+      AD013_AsyncDone(sensor, -1);
+  }
+}
+
+int AD013_Poll(AD013_Sensor * sensor) {
+
+  int ret = AD013_PARSE_MORE;
+  int code = -1;
+  bool retry = false;
+
+  if (!sensor || sensor->op == AD013_OP_NONE)
+    return AD013_ASYNC_IDLE;
+
+  // Policy Deadline (the operation ends wherever it is)
+  if (sensor->policy.deadline && (long)(millis() - sensor->expiresAt) >= 0) {
+    if (AD013_DEBUG_IS_ENABLED) printf("Deadline Reached, aborting...\n");
+    AD013_METRICS_INC(deadlines);
+    sensor->timedOut = 1;
+    AD013_AsyncDone(sensor, -1);
+    return sensor->op == AD013_OP_NONE ? AD013_ASYNC_IDLE : AD013_ASYNC_BUSY;
+  }
+
+  if (sensor->waiting) {
+
+    // Consumes the available bytes (never blocks)
+    ret = AD013_ParserPoll(&sensor->parser, *sensor->com);
+    if (ret == AD013_PARSE_DONE && sensor->parser.flag != AD013_FLAG_ACK &&
+        !(sensor->dataIn && (sensor->parser.flag == AD013_FLAG_DATA ||
+                             sensor->parser.flag == AD013_FLAG_DATA_END)))
+      ret = AD013_PARSE_MORE;
+
+    if (ret == AD013_PARSE_MORE) {
+      // Still waiting for the reply
+      if (millis() - sensor->sentAt < sensor->replyTimeout)
+        return AD013_ASYNC_BUSY;
+      code = -1;
+    } else if (ret == AD013_PARSE_BAD_SUM) {
+      code = -99;
+    } else if (ret == AD013_PARSE_DONE && sensor->parser.flag != AD013_FLAG_ACK) {
+      // Data packets carry no code
+      code = memcmp(sensor->devId, sensor->parser.devId, sizeof(sensor->devId)) ?
+        -1 : AD013_CODE_OK;
+    } else if (ret == AD013_PARSE_DONE) {
+      code = AD013_AckCode(&sensor->parser, sensor->devId);
+    }
+
+    // Retransmits corrupted or short replies (see AD013_SetPolicy())
+    retry = AD013_AsyncRetry(sensor, ret);
+    sensor->timedOut = ret == AD013_PARSE_MORE;
+
+    // Link metrics (data packets only count when corrupted)
+    if (ret != AD013_PARSE_DONE || sensor->parser.flag == AD013_FLAG_ACK) {
+      AD013_MetricsReply(sensor->code, ret, code,
+        sensor->parser.state != AD013_PARSER_HEADER_HI,
+        sensor->timing ? (long)(micros() - sensor->sentUs) : -1);
+      sensor->timing = 0;
+    }
+    AD013_TRACE_REPLY(&sensor->parser, ret, code);
+
+    sensor->waiting = 0;
+    if (retry) return AD013_ASYNC_BUSY;
+
+    // Keeps the template index in sync with the DB
+    AD013_IndexUpdate(sensor, code);
+
+    if (sensor->waking && sensor->op != AD013_OP_WAKE) AD013_WakeGate(sensor, code);
+    else AD013_AsyncStep(sensor, code);
+
+  } else if ((long)(millis() - sensor->wakeAt) >= 0) {
+
+    if (sensor->resend) {
+      // Same frame, same reply timeout
+      sensor->resend = 0;
+      AD013_AsyncTransmit(sensor, sensor->code, sensor->txFrame, sensor->txLen);
+    } else if (sensor->asleep && sensor->op != AD013_OP_WAKE && sensor->op != AD013_OP_SLEEP) {
+      // Wakes the sensor up before the first command
+      AD013_WakeGate(sensor, AD013_STEP_ISSUE);
+    } else {
+      // Issues the command for the current step
+      AD013_AsyncStep(sensor, AD013_STEP_ISSUE);
+    }
+  }
+
+  return sensor->op == AD013_OP_NONE ? AD013_ASYNC_IDLE : AD013_ASYNC_BUSY;
+}
+
+int AD013_SubmitCommand(AD013_Sensor   * sensor,
+                        int              code,
+                        AD013_Params   * params,
+                        AD013_Callback   callback,
+                        void           * ctx) {
+
+  if (params && params->size > AD013_MAX_PARAMS_SIZE) return -1;
+
+  if (AD013_AsyncStart(sensor, AD013_OP_COMMAND, callback, ctx) < 0)
+    return -1;
+
+  AD013_ClearParams(&sensor->params);
+  if (params) AD013_AddParamN(&sensor->params, params->buff, params->size);
+  sensor->code = code;
+
+  return 1;
+}
+
+int AD013_SubmitFindSensor(AD013_Sensor   * sensor,
+                           long             serSpeed,
+                           AD013_Params   * params,
+                           AD013_Callback   callback,
+                           void           * ctx) {
+
+  // Speeds can not be set on the host side without a hook
+  if (sensor && !sensor->baudHook) return -1;
+
+  if (AD013_AsyncStart(sensor, AD013_OP_FIND_SENSOR, callback, ctx) < 0)
+    return -1;
+
+  if (!params) {
+    sensor->params = AD013_DefaultParams;
+    // Adds the Password as the default command
+    AD013_AddParamN(&sensor->params, AD013_def_passwd, sizeof(AD013_def_passwd));
+  } else {
+    // Copies the params struct (devId and password)
+    sensor->params = *params;
+  }
+  memcpy(sensor->devId, sensor->params.devId, sizeof(sensor->devId));
+  if (sensor->params.size >= (int) sizeof(sensor->passwd))
+    memcpy(sensor->passwd, sensor->params.buff, sizeof(sensor->passwd));
+
+  sensor->serSpeed = serSpeed;
+
+  // Tries the last-good link first (if any)
+  sensor->speedIdx = AD013_LinkGet(sensor->slot) ? AD013_FIND_CACHED : 0;
+
+  // Debug Info
+  if (AD013_DEBUG_IS_ENABLED && serSpeed < 0)
+    printf("Looking for Fingerprint Sensor - checking 115200-9600 baud range\n");
+
+  return 1;
+}
+
+int AD013_SubmitUpgradeBaud(AD013_Sensor   * sensor,
+                            long             targetBaud,
+                            AD013_Callback   callback,
+                            void           * ctx) {
+
+  // Needs a baud hook for the host side of the link
+  if (!sensor || !sensor->baudHook) return -1;
+
+  // Only N x 9600 speeds are supported by the sensor
+  if (sensor->baud <= 0 || targetBaud % AD013_BAUD_UNIT != 0 ||
+      targetBaud < AD013_BAUD_UNIT || targetBaud > AD013_MAX_BAUD_N * AD013_BAUD_UNIT)
+    return -1;
+
+  if (AD013_AsyncStart(sensor, AD013_OP_SET_BAUD, callback, ctx) < 0)
+    return -1;
+
+  sensor->prevBaud = sensor->baud;
+  sensor->serSpeed = targetBaud;
+  sensor->step = AD013_UPGRADE_WRITE_REG;
+
+  return 1;
+}
+
+int AD013_SubmitIdentify(AD013_Sensor   * sensor,
+                         int              timeOut,
+                         int              threashold,
+                         bool             SecurityOfficerOnly,
+                         AD013_Callback   callback,
+                         void           * ctx) {
+
+  if (AD013_AsyncStart(sensor, AD013_OP_IDENTIFY, callback, ctx) < 0)
+    return -1;
+
+  sensor->deadline = millis() + timeOut;
+  sensor->threashold = threashold;
+  sensor->soOnly = SecurityOfficerOnly;
+  sensor->step = AD013_IDENTIFY_GET_IMAGE;
+
+  AD013_MatchStart(sensor);
+  AD013_PlanBuild(sensor);
+  AD013_FingerStart(sensor);
+
+  // Debug Information
+  if (AD013_DEBUG_IS_ENABLED)
+    printf("Please put finger on sensor...\n");
+
+  return 1;
+}
+
+int AD013_SubmitAutoIdentify(AD013_Sensor   * sensor,
+                             int              timeOut,
+                             int              securityLevel,
+                             AD013_Callback   callback,
+                             void           * ctx) {
+
+  if (securityLevel < 1 || securityLevel > 5) return -1;
+
+  if (AD013_AsyncStart(sensor, AD013_OP_AUTO_IDENTIFY, callback, ctx) < 0)
+    return -1;
+
+  sensor->deadline = millis() + timeOut;
+  sensor->securityLevel = securityLevel;
+  sensor->threashold = 0;  // Matching level is on the sensor
+
+  AD013_MatchStart(sensor);
+
+  // Debug Information
+  if (AD013_DEBUG_IS_ENABLED)
+    printf("Please put finger on sensor...\n");
+
+  return 1;
+}
+
+int AD013_SubmitVerify(AD013_Sensor   * sensor,
+                       int              claimedId,
+                       int              timeOut,
+                       int              threashold,
+                       AD013_Callback   callback,
+                       void           * ctx) {
+
+  if (claimedId < 0) return -1;
+
+  if (AD013_AsyncStart(sensor, AD013_OP_VERIFY, callback, ctx) < 0)
+    return -1;
+
+  sensor->deadline = millis() + timeOut;
+  sensor->threashold = threashold;
+  sensor->targetId = claimedId;
+  sensor->step = AD013_VERIFY_LOAD_CHAR;
+
+  AD013_MatchStart(sensor);
+
+  return 1;
+}
+
+int AD013_SubmitLoadIndex(AD013_Sensor   * sensor,
+                          AD013_Callback   callback,
+                          void           * ctx) {
+
+  if (!AD013_IndexGet(sensor)) return -1;
+
+  if (AD013_AsyncStart(sensor, AD013_OP_LOAD_INDEX, callback, ctx) < 0)
+    return -1;
+
+  // Reloads from scratch
+  AD013_IndexInvalidate(sensor);
+  memset(AD013_IndexGet(sensor)->bits, 0, sizeof(AD013_index[0].bits));
+
+  return 1;
+}
+
+int AD013_SubmitClear(AD013_Sensor   * sensor,
+                      int              start,
+                      int              end,
+                      AD013_Callback   callback,
+                      void           * ctx) {
+
+  if (start < 0) start = 0;
+  if (end >= AD013_MAX_TEMPLATES) end = AD013_MAX_TEMPLATES - 1;
+  if (start > end) return -1;
+
+  if (AD013_AsyncStart(sensor, AD013_OP_CLEAR, callback, ctx) < 0)
+    return -1;
+
+  sensor->planLen = 0;
+  sensor->planIdx = 0;
+
+  // Already empty, nothing to send
+  if (AD013_IndexRangeEmpty(sensor, start, end) == 1) return 1;
+
+  // Nothing stored outside the range (SO/user split included):
+  // the whole DB goes with one PS_Empty
+  if (AD013_IndexRangeEmpty(sensor, 0, start - 1) == 1 &&
+      AD013_IndexRangeEmpty(sensor, end + 1, AD013_MAX_TEMPLATES - 1) == 1) {
+    start = 0;
+    end = AD013_MAX_TEMPLATES - 1;
+  }
+
+  // Single contiguous range
+  sensor->plan[0].start = start;
+  sensor->plan[0].count = end - start + 1;
+  sensor->planLen = 1;
+
+  return 1;
+}
+
+int AD013_SubmitEnroll(AD013_Sensor   * sensor,
+                       bool             isSecurityOfficer,
+                       int              templateId,
+                       int              timeOut,
+                       int              threashold,
+                       AD013_Callback   callback,
+                       void           * ctx) {
+
+  if (templateId >= AD013_MAX_TEMPLATES) return -1;
+
+  // No free ID in the range (index loaded)
+  if (templateId < 0 && AD013_IndexFindFree(sensor,
+        isSecurityOfficer ? 0 : AD013_SO_TEMPLATES,
+        isSecurityOfficer ? AD013_SO_TEMPLATES - 1 : AD013_MAX_TEMPLATES - 1) == -1)
+    return -1;
+
+  if (AD013_AsyncStart(sensor, AD013_OP_ENROLL, callback, ctx) < 0)
+    return -1;
+
+  sensor->deadline = millis() + timeOut;
+  sensor->threashold = threashold;
+  sensor->soOnly = isSecurityOfficer;
+  sensor->targetId = templateId;
+  sensor->capture = 0;
+  sensor->planIdx = 0;
+
+  memset(&sensor->enroll, 0, sizeof(sensor->enroll));
+  sensor->enroll.status = -1;
+  sensor->enroll.templateId = -1;
+  sensor->enroll.duplicateId = -1;
+
+  // Loads the index first (if the free ID is not known)
+  sensor->step = AD013_EnrollPickSlot(sensor) > 0 ?
+    AD013_ENROLL_GET_IMAGE : AD013_ENROLL_LOAD_INDEX;
+
+  AD013_FingerStart(sensor);
+
+  // Debug Information
+  if (AD013_DEBUG_IS_ENABLED)
+    printf("Please put finger on sensor...\n");
+
+  return 1;
+}
+
+int AD013_SubmitUploadTemplate(AD013_Sensor   * sensor,
+                               int              templateId,
+                               AD013_DataSink   sink,
+                               void           * sinkCtx,
+                               AD013_Callback   callback,
+                               void           * ctx) {
+
+  if (!sink || templateId < 0 || templateId >= AD013_MAX_TEMPLATES)
+    return -1;
+
+  if (AD013_AsyncStart(sensor, AD013_OP_UPLOAD, callback, ctx) < 0)
+    return -1;
+
+  sensor->targetId = templateId;
+  sensor->sink = sink;
+  sensor->dataCtx = sinkCtx;
+  sensor->dataBytes = 0;
+  sensor->step = AD013_XFER_LOAD_CHAR;
+
+  return 1;
+}
+
+int AD013_SubmitDownloadTemplate(AD013_Sensor     * sensor,
+                                 int                templateId,
+                                 long               size,
+                                 AD013_DataSource   source,
+                                 void             * sourceCtx,
+                                 AD013_Callback     callback,
+                                 void             * ctx) {
+
+  if (!source || size <= 0 || templateId < 0 || templateId >= AD013_MAX_TEMPLATES)
+    return -1;
+
+  // Packets are built in the reply buffer
+  if (!sensor || sensor->packetSize == 0 || sensor->packetSize > AD013_MAX_PAYLOAD_SIZE)
+    return -1;
+
+  if (AD013_AsyncStart(sensor, AD013_OP_DOWNLOAD, callback, ctx) < 0)
+    return -1;
+
+  sensor->targetId = templateId;
+  sensor->source = source;
+  sensor->dataCtx = sourceCtx;
+  sensor->dataLeft = size;
+  sensor->dataBytes = 0;
+  sensor->step = AD013_XFER_COMMAND;
+
+  return 1;
+}
+
+int AD013_SubmitUploadImage(AD013_Sensor   * sensor,
+                            byte           * ring,
+                            uint16_t         ringSize,
+                            long             imageSize,
+                            AD013_DataSink   sink,
+                            void           * sinkCtx,
+                            AD013_Callback   callback,
+                            void           * ctx) {
+
+  // The ring must hold at least one packet
+  if (!sensor || !sink || !ring || ringSize < sensor->packetSize)
+    return -1;
+
+  if (AD013_AsyncStart(sensor, AD013_OP_UPLOAD_IMAGE, callback, ctx) < 0)
+    return -1;
+
+  sensor->sink = sink;
+  sensor->dataCtx = sinkCtx;
+  sensor->dataSize = imageSize;
+  sensor->dataBytes = 0;
+  sensor->dataPackets = 0;
+  sensor->dataResyncs = 0;
+  sensor->ring = ring;
+  sensor->ringSize = ringSize;
+  sensor->ringHead = 0;
+  sensor->ringLen = 0;
+  sensor->step = AD013_XFER_COMMAND;
+
+  return 1;
+}
+
+int AD013_SubmitSleep(AD013_Sensor   * sensor,
+                      AD013_Callback   callback,
+                      void           * ctx) {
+
+  // Only a touch wakes the sensor up
+  if (!sensor || sensor->touchPin == AD013_TOUCH_NONE)
+    return -1;
+
+  if (AD013_AsyncStart(sensor, AD013_OP_SLEEP, callback, ctx) < 0)
+    return -1;
+
+  return 1;
+}
+
+int AD013_SubmitWake(AD013_Sensor   * sensor,
+                     int              timeOut,
+                     AD013_Callback   callback,
+                     void           * ctx) {
+
+  if (AD013_AsyncStart(sensor, AD013_OP_WAKE, callback, ctx) < 0)
+    return -1;
+
+  sensor->deadline = millis() + timeOut;
+
+  return 1;
+}
+
+                        // =====================
+                        // Sensor Pool Functions
+                        // =====================
+
+// One bit of the armed mask and one link slot per pooled sensor
+static_assert(AD013_MAX_POOL_SENSORS <= 8 * sizeof(((AD013_Pool *) 0)->armed),
+  "AD013: AD013_MAX_POOL_SENSORS exceeds the bits of AD013_Pool::armed");
+static_assert(AD013_MAX_POOL_SENSORS <= AD013_MAX_LINK_SLOTS,
+  "AD013: AD013_MAX_POOL_SENSORS exceeds AD013_MAX_LINK_SLOTS");
+
+void AD013_PoolInit(AD013_Pool * pool) {
+  if (pool) memset(pool, 0, sizeof(AD013_Pool));
+}
+
+int AD013_PoolAdd(AD013_Pool * pool,
+                  Stream     & SensorCom,
+                  const char * devId,
+                  long         baud) {
+
+  AD013_Sensor * sensor = NULL;
+
+  if (!pool || pool->count >= AD013_MAX_POOL_SENSORS) return -1;
+
+  sensor = &pool->sensors[pool->count];
+  AD013_SensorInit(sensor, SensorCom);
+  if (devId) memcpy(sensor->devId, devId, sizeof(sensor->devId));
+  sensor->baud = baud;
+
+  // Own link record and template index
+  sensor->slot = pool->count;
+
+  return pool->count++;
+}
+
+AD013_Sensor * AD013_PoolSensor(AD013_Pool * pool, int idx) {
+  if (!pool || idx < 0 || idx >= pool->count) return NULL;
+  return &pool->sensors[idx];
+}
+
+void AD013_PoolCallback(AD013_Sensor * sensor, int result, void * ctx) {
+
+  AD013_Pool * pool = (AD013_Pool *) ctx;
+  uint8_t idx = sensor - pool->sensors;
+  AD013_PoolEvent * ev = NULL;
+
+  // Continuous identify: no finger, just re-arms
+  if ((pool->armed & (1 << idx)) && sensor->lastOp == AD013_OP_IDENTIFY &&
+      sensor->match.status == AD013_CODE_NO_FINGER)
+    return;
+
+  if (pool->len >= AD013_POOL_QUEUE_SIZE) {
+    pool->dropped++;
+    return;
+  }
+
+  ev = &pool->queue[(pool->head + pool->len++) % AD013_POOL_QUEUE_SIZE];
+  ev->sensor = idx;
+  ev->op = sensor->lastOp;
+  ev->result = result;
+  ev->match = sensor->match;
+  ev->at = millis();
+
+  if (ev->op == AD013_OP_IDENTIFY) pool->identified++;
+}
+
+static void AD013_PoolArm(AD013_Pool * pool, int idx) {
+  AD013_SubmitIdentify(&pool->sensors[idx], pool->timeOut, pool->threashold,
+    false, AD013_PoolCallback, pool);
+}
+
+int AD013_PoolIdentifyAll(AD013_Pool * pool,
+                          int          timeOut,
+                          int          threashold) {
+
+  if (!pool || pool->count == 0) return -1;
+
+  pool->timeOut = timeOut;
+  pool->threashold = threashold;
+  pool->armed = (1 << pool->count) - 1;
+
+  // Idle sensors start now, busy ones once they are done
+  for (int i = 0; i < pool->count; i++) {
+    if (pool->sensors[i].op == AD013_OP_NONE) AD013_PoolArm(pool, i);
+  }
+
+  return 1;
+}
+
+void AD013_PoolStop(AD013_Pool * pool) {
+  if (pool) pool->armed = 0;
+}
+
+int AD013_PoolPoll(AD013_Pool * pool) {
+
+  int busy = 0;
+
+  if (!pool) return 0;
+
+  // Round-robin, a different sensor goes first every time
+  for (int i = 0; i < pool->count; i++) {
+    int idx = (pool->next + i) % pool->count;
+    AD013_Sensor * sensor = &pool->sensors[idx];
+
+    if (AD013_Poll(sensor) == AD013_ASYNC_IDLE && (pool->armed & (1 << idx)))
+      AD013_PoolArm(pool, idx);
+
+    if (sensor->op != AD013_OP_NONE) busy++;
+  }
+  if (pool->count) pool->next = (pool->next + 1) % pool->count;
+
+  return busy;
+}
+
+int AD013_PoolNextEvent(AD013_Pool * pool, AD013_PoolEvent * ev) {
+
+  if (!pool || !ev || pool->len == 0) return 0;
+
+  *ev = pool->queue[pool->head];
+  pool->head = (pool->head + 1) % AD013_POOL_QUEUE_SIZE;
+  pool->len--;
+
+  return 1;
+}
+
+                        // ================================
+                        // Fingerprint High-Level Functions
+                        // ================================
+
+AD013_Sensor * AD013_SharedSensor(Stream & SensorCom) {
+
+  // One context for all the blocking functions, kept off the stack
+  // (the functions run their flows to completion, one at a time)
+  static AD013_Sensor sensor;
+
+  // Set up once per port, then kept between the calls (touch pin,
+  // sleep state and last match)
+  if (sensor.com != &SensorCom && sensor.op == AD013_OP_NONE) {
+    if (sensor.com) AD013_SetTouchPin(&sensor, AD013_TOUCH_NONE);
+    AD013_SensorInit(&sensor, SensorCom);
+  }
+
+  return &sensor;
+}
+
+static AD013_Sensor * AD013_BlockingContext(Stream & SensorCom) {
+
+  AD013_Sensor * sensor = AD013_SharedSensor(SensorCom);
+  AD013_Link * link = NULL;
+
+  // Called again from one of its callbacks
+  if (sensor->com != &SensorCom || sensor->op != AD013_OP_NONE) return NULL;
+
+  // Speed, device ID and password from the last discovery
+  if ((link = AD013_LinkGet(sensor->slot)) != NULL) {
+    if (sensor->baud != (long) link->baud) AD013_SensorBaud(sensor, link->baud);
+    sensor->baud = link->baud;
+    memcpy(sensor->devId, link->devId, sizeof(sensor->devId));
+    memcpy(sensor->passwd, link->passwd, sizeof(sensor->passwd));
+  } else {
+    sensor->baud = 0;
+    memcpy(sensor->devId, AD013_def_devid, sizeof(sensor->devId));
+    memcpy(sensor->passwd, AD013_def_passwd, sizeof(sensor->passwd));
+  }
+
+  // Global settings (see AD013_SetDefaultPolicy() and AD013_SetBaudHook())
+  sensor->policy = AD013_defPolicy;
+  sensor->baudHook = AD013_baudHook;
+
+  return sensor;
+}
+
+static int AD013_RunFlow(AD013_Sensor * sensor) {
+  // Runs the submitted flow to completion, other tasks (and the
+  // watchdog of the ESP cores) keep running
+  while (AD013_Poll(sensor) == AD013_ASYNC_BUSY) yield();
+  return sensor->result;
+}
+
+int AD013_FindSensor(Stream     & SensorCom,
+                   long         serSpeed,
+                   AD013_Params * params) {
+  // Let's Check we have a sensor attached and we can
+  // verify the password. Use the params to modify the
+  // defaults
+
+  AD013_Sensor * sensor;
+    // Context for the discovery flow (shared)
+
+  if ((sensor = AD013_BlockingContext(SensorCom)) == NULL) return -1;
+
+  // Sets the Default Timeout
+  SensorCom.setTimeout(AD013_DEFAULT_TIMEOUT);
+
+  if (AD013_SubmitFindSensor(sensor, serSpeed, params) < 0)
+    return -1;
+
+  // Runs the flow to completion
+  AD013_RunFlow(sensor);
+
+  // All Done
+  return sensor->result;
+}
+
+int AD013_UpgradeBaud(Stream & SensorCom,
+                      long     targetBaud) {
+
+  AD013_Sensor * sensor;
+    // Context for the upgrade flow (shared)
+
+  if ((sensor = AD013_BlockingContext(SensorCom)) == NULL) return -1;
+
+  // Needs the speed, device ID and password of a discovery
+  if (sensor->baud <= 0) return -1;
+
+  // Already there
+  if (sensor->baud == targetBaud) return 1;
+
+  if (AD013_SubmitUpgradeBaud(sensor, targetBaud) < 0)
+    return -1;
+
+  // Runs the flow to completion
+  AD013_RunFlow(sensor);
+
+  return sensor->result;
+}
+
+int AD013_SearchTemplate (Stream & SensorCom,
+                        int      timeOut,
+                        int      threashold,
+                        bool     SecurityOfficerOnly,
+                        AD013_SearchResult * result) {
+
+  AD013_Sensor * sensor;
+    // Context for the identify flow (shared)
+
+  if ((sensor = AD013_BlockingContext(SensorCom)) == NULL) return -1;
+
+  if (AD013_SubmitIdentify(sensor, timeOut, threashold, SecurityOfficerOnly) < 0)
+    return -1;
+
+  // Runs the flow to completion
+  AD013_RunFlow(sensor);
+
+  if (result) *result = sensor->match;
+
+  return sensor->result;
+}
+
+int AD013_AutoIdentify(Stream & SensorCom,
+                       int      timeOut,
+                       int      securityLevel,
+                       AD013_SearchResult * result) {
+
+  AD013_Sensor * sensor;
+    // Context for the auto-identify flow (shared)
+
+  if ((sensor = AD013_BlockingContext(SensorCom)) == NULL) return -1;
+
+  if (AD013_SubmitAutoIdentify(sensor, timeOut, securityLevel) < 0)
+    return -1;
+
+  // Runs the flow to completion
+  AD013_RunFlow(sensor);
+
+  if (result) *result = sensor->match;
+
+  return sensor->result;
+}
+
+int AD013_Verify(Stream & SensorCom,
+                 int      claimedId,
+                 int      timeOut,
+                 int      threashold,
+                 AD013_SearchResult * result) {
+
+  AD013_Sensor * sensor;
+    // Context for the verify flow (shared)
+
+  if ((sensor = AD013_BlockingContext(SensorCom)) == NULL) return -1;
+
+  if (AD013_SubmitVerify(sensor, claimedId, timeOut, threashold) < 0)
+    return -1;
+
+  // Runs the flow to completion
+  AD013_RunFlow(sensor);
+
+  if (result) *result = sensor->match;
+
+  return sensor->result;
+}
+
+int AD013_LoadIndex(Stream & SensorCom) {
+
+  AD013_Sensor * sensor;
+    // Context for the index flow (shared)
+
+  if ((sensor = AD013_BlockingContext(SensorCom)) == NULL) return -1;
+
+  if (AD013_SubmitLoadIndex(sensor) < 0)
+    return -1;
+
+  // Runs the flow to completion
+  AD013_RunFlow(sensor);
+
+  return sensor->result;
+}
+
+int AD013_UploadTemplate(Stream         & SerialPort,
+                         int              templateId,
+                         AD013_DataSink   sink,
+                         void           * sinkCtx) {
+
+  AD013_Sensor * sensor;
+    // Context for the transfer flow (shared)
+
+  if ((sensor = AD013_BlockingContext(SerialPort)) == NULL) return -1;
+
+  if (AD013_SubmitUploadTemplate(sensor, templateId, sink, sinkCtx) < 0)
+    return -1;
+
+  // Runs the flow to completion
+  AD013_RunFlow(sensor);
+
+  return sensor->result == 1 ? (int) sensor->dataBytes : AD013_FlowError(sensor);
+}
+
+int AD013_DownloadTemplate(Stream           & SerialPort,
+                           int                templateId,
+                           long               size,
+                           AD013_DataSource   source,
+                           void             * sourceCtx) {
+
+  AD013_Sensor * sensor;
+    // Context for the transfer flow (shared)
+
+  if ((sensor = AD013_BlockingContext(SerialPort)) == NULL) return -1;
+
+  if (AD013_SubmitDownloadTemplate(sensor, templateId, size, source, sourceCtx) < 0)
+    return -1;
+
+  // Runs the flow to completion
+  AD013_RunFlow(sensor);
+
+  return sensor->result == 1 ? (int) sensor->dataBytes : AD013_FlowError(sensor);
+}
+
+int AD013_UploadImage(Stream         & SerialPort,
+                      long             imageSize,
+                      AD013_DataSink   sink,
+                      void           * sinkCtx,
+                      AD013_TransferStats * stats) {
+
+  AD013_Sensor * sensor;
+    // Context for the transfer flow (shared)
+
+  static byte ring[AD013_IMAGE_RING_SIZE];
+    // Between the UART and the sink (not on the stack)
+
+  if ((sensor = AD013_BlockingContext(SerialPort)) == NULL) return -1;
+
+  if (AD013_SubmitUploadImage(sensor, ring, sizeof(ring), imageSize, sink, sinkCtx) < 0)
+    return -1;
+
+  // Runs the flow to completion
+  AD013_RunFlow(sensor);
+
+  if (stats) {
+    stats->bytes = sensor->dataBytes;
+    stats->packets = sensor->dataPackets;
+    stats->resyncs = sensor->dataResyncs;
+    stats->elapsed = millis() - sensor->dataAt;
+  }
+
+  if (sensor->result == AD013_PARTIAL) return AD013_PARTIAL;
+
+  return sensor->result == 1 ? (int) sensor->dataBytes : AD013_FlowError(sensor);
+}
+
+                        // ============================
+                        // Template DB Backup Functions
+                        // ============================
+
+// Container Format (big endian, see AD013_BackupDB())
+#define AD013_BACKUP_MAGIC          "AD13"
+#define AD013_BACKUP_VERSION           3
+#define AD013_BACKUP_HEADER_SIZE       8
+#define AD013_BACKUP_ENTRY_SIZE        8   // Index entry (ID, size, hash)
+#define AD013_BACKUP_RECORD_SIZE       6   // Record trailer (size, hash)
+#define AD013_BACKUP_TRAILER_SIZE      4
+#define AD013_BACKUP_MAX_RECORD   0xFFFF
+
+// FNV-1a (32 bits)
+#define AD013_FNV_OFFSET      2166136261UL
+#define AD013_FNV_PRIME         16777619UL
+
+// Backup/Restore Stream State
+typedef struct backup_io_st {
+  AD013_DataSink     sink;
+  AD013_DataSource   source;
+  void             * ctx;
+  AD013_Sensor     * sensor;   // Transfer context (restore)
+  uint32_t           sum;      // Container checksum
+  uint32_t           hash;     // Current template hash
+  long               size;     // Template bytes so far
+  uint16_t           chunk;    // Bytes left in the chunk (restore)
+  bool               ended;    // Record end read (restore)
+} AD013_BackupIO;
+
+static uint32_t AD013_Hash32(uint32_t hash, const byte * data, int size) {
+  for (int i = 0; i < size; i++) hash = (hash ^ data[i]) * AD013_FNV_PRIME;
+  return hash;
+}
+
+static void AD013_Put32(byte * buff, uint32_t val) {
+  buff[0] = val >> 24;
+  buff[1] = (val >> 16) & 0xFF;
+  buff[2] = (val >> 8) & 0xFF;
+  buff[3] = val & 0xFF;
+}
+
+static uint32_t AD013_Get32(const byte * buff) {
+  return ((uint32_t) buff[0] << 24) | ((uint32_t) buff[1] << 16) |
+         ((uint32_t) buff[2] << 8) | buff[3];
+}
+
+static int AD013_HashSink(void * ctx, const byte * data, int size) {
+  AD013_BackupIO * io = (AD013_BackupIO *) ctx;
+  io->hash = AD013_Hash32(io->hash, data, size);
+  io->size += size;
+  return size;
+}
+
+static int AD013_SlotHash(AD013_Sensor * sensor, int id, uint32_t * hash, long * size) {
+
+  AD013_BackupIO io;
+
+  // Known since the last backup or restore (no transfer)
+  if (AD013_HashGet(sensor, id, hash, size)) return 1;
+
+  // Reads the template for its hash only
+  memset(&io, 0, sizeof(io));
+  io.hash = AD013_FNV_OFFSET;
+  if (AD013_SubmitUploadTemplate(sensor, id, AD013_HashSink, &io) < 0 ||
+      AD013_RunFlow(sensor) != 1)
+    return AD013_FlowError(sensor);
+  if (io.size == 0 || io.size > AD013_BACKUP_MAX_RECORD) return -1;
+
+  *hash = io.hash;
+  *size = io.size;
+  AD013_HashSet(sensor, id, io.hash, io.size);
+
+  return 1;
+}
+
+static int AD013_BackupWrite(void * ctx, const byte * data, int size) {
+
+  AD013_BackupIO * io = (AD013_BackupIO *) ctx;
+
+  io->sum = AD013_Hash32(io->sum, data, size);
+
+  // The sink must take the whole packet
+  return io->sink(io->ctx, data, size) == size ? size : -1;
+}
+
+static int AD013_BackupData(void * ctx, const byte * data, int size) {
+
+  byte len[2] = { (byte)(size >> 8), (byte)(size & 0xFF) };
+
+  // One chunk per data packet
+  AD013_HashSink(ctx, data, size);
+  if (AD013_BackupWrite(ctx, len, 2) < 0) return -1;
+  return AD013_BackupWrite(ctx, data, size);
+}
+
+static int AD013_BackupRead(AD013_BackupIO * io, byte * data, int size) {
+
+  int count = 0;
+
+  // Reads exactly size bytes
+  while (count < size) {
+    int ret = io->source(io->ctx, data + count, size - count);
+    if (ret <= 0) return -1;
+    count += ret;
+  }
+  io->sum = AD013_Hash32(io->sum, data, size);
+
+  return size;
+}
+
+static int AD013_RestoreChunk(AD013_BackupIO * io) {
+
+  byte len[2];
+
+  // Next chunk length, 0 ends the record data
+  if (AD013_BackupRead(io, len, 2) < 0) return -1;
+  io->chunk = (len[0] << 8) | len[1];
+  io->ended = io->chunk == 0;
+
+  return 1;
+}
+
+static int AD013_RestoreTrailer(AD013_BackupIO * io) {
+
+  byte tail[AD013_BACKUP_RECORD_SIZE];
+
+  // Record Trailer: size and hash (checked before PS_StoreChar)
+  if (io->size == 0 || AD013_BackupRead(io, tail, AD013_BACKUP_RECORD_SIZE) < 0) return -1;
+  if (((tail[0] << 8) | tail[1]) != io->size || AD013_Get32(tail + 2) != io->hash) {
+    if (AD013_DEBUG_IS_ENABLED) printf("ERROR: Template hash mismatch\n");
+    return -1;
+  }
+
+  return 1;
+}
+
+static int AD013_RestoreData(void * ctx, byte * data, int size) {
+
+  AD013_BackupIO * io = (AD013_BackupIO *) ctx;
+  int got = 0;
+
+  // Packets are filled from the chunks, whatever their size
+  while (got < size && !io->ended) {
+    int len = size - got < io->chunk ? size - got : io->chunk;
+    if (len > 0) {
+      if (AD013_BackupRead(io, data + got, len) < 0) return -1;
+      io->chunk -= len;
+      got += len;
+    }
+    if (io->chunk == 0 && AD013_RestoreChunk(io) < 0) return -1;
+  }
+
+  io->hash = AD013_Hash32(io->hash, data, got);
+  io->size += got;
+  if (!io->ended) return io->size < AD013_BACKUP_MAX_RECORD ? got : -1;
+
+  // Last packet
+  if (got == 0 || AD013_RestoreTrailer(io) < 0) return -1;
+  io->sensor->dataLeft = got;
+
+  return got;
+}
+
+static int AD013_RestoreSkip(AD013_BackupIO * io) {
+
+  byte buff[16];
+
+  // Record already in its slot: read (and checked) but not sent
+  while (!io->ended) {
+    int len = io->chunk < sizeof(buff) ? io->chunk : sizeof(buff);
+    if (len > 0) {
+      if (AD013_BackupRead(io, buff, len) < 0) return -1;
+      io->hash = AD013_Hash32(io->hash, buff, len);
+      io->size += len;
+      io->chunk -= len;
+    }
+    if (io->size > AD013_BACKUP_MAX_RECORD) return -1;
+    if (io->chunk == 0 && AD013_RestoreChunk(io) < 0) return -1;
+  }
+
+  return AD013_RestoreTrailer(io);
+}
+
+int AD013_BackupDB(Stream            & SerialPort,
+                   AD013_DataSink      sink,
+                   void              * sinkCtx,
+                   AD013_BackupStats * stats) {
+
+  AD013_Sensor * sensor;
+    // Context for the transfer flows (shared)
+
+  AD013_BackupIO io;
+  AD013_BackupStats local;
+  byte head[AD013_BACKUP_HEADER_SIZE];
+  uint32_t hash = 0;
+  long size = 0;
+  int count = 0;
+
+  if (!sink) return -1;
+  if (!stats) stats = &local;
+
+  memset(stats, 0, sizeof(AD013_BackupStats));
+  memset(&io, 0, sizeof(io));
+  io.sink = sink;
+  io.ctx = sinkCtx;
+  io.sum = AD013_FNV_OFFSET;
+
+  unsigned long start = millis();
+
+  if ((sensor = AD013_BlockingContext(SerialPort)) == NULL) return -1;
+
+  // Occupied Slots
+  if (AD013_IndexRangeEmpty(sensor, 0, 0) == AD013_INDEX_UNKNOWN &&
+      (AD013_SubmitLoadIndex(sensor) < 0 || AD013_RunFlow(sensor) != 1))
+    return AD013_FlowError(sensor);
+
+  for (int id = 0; id < AD013_MAX_TEMPLATES; id++)
+    if (AD013_IndexRangeEmpty(sensor, id, id) == 0) count++;
+
+  // Header
+  memcpy(head, AD013_BACKUP_MAGIC, 4);
+  head[4] = AD013_BACKUP_VERSION;
+  head[5] = 0;
+  head[6] = count >> 8;
+  head[7] = count & 0xFF;
+  if (AD013_BackupWrite(&io, head, AD013_BACKUP_HEADER_SIZE) < 0) return -1;
+
+  // Hash Index (the hashes not known yet cost one more upload)
+  for (int id = 0; id < AD013_MAX_TEMPLATES; id++) {
+
+    if (AD013_IndexRangeEmpty(sensor, id, id) != 0) continue;
+    if (AD013_SlotHash(sensor, id, &hash, &size) < 0) return -1;
+
+    head[0] = id >> 8;
+    head[1] = id & 0xFF;
+    head[2] = size >> 8;
+    head[3] = size & 0xFF;
+    AD013_Put32(head + 4, hash);
+    if (AD013_BackupWrite(&io, head, AD013_BACKUP_ENTRY_SIZE) < 0) return -1;
+  }
+
+  for (int id = 0; id < AD013_MAX_TEMPLATES; id++) {
+
+    if (AD013_IndexRangeEmpty(sensor, id, id) != 0) continue;
+
+    // Template ID
+    head[0] = id >> 8;
+    head[1] = id & 0xFF;
+    if (AD013_BackupWrite(&io, head, 2) < 0) return -1;
+
+    // Template Data (one upload, straight to the sink)
+    io.hash = AD013_FNV_OFFSET;
+    io.size = 0;
+    if (AD013_SubmitUploadTemplate(sensor, id, AD013_BackupData, &io) < 0 ||
+        AD013_RunFlow(sensor) != 1)
+      return AD013_FlowError(sensor);
+
+    // Must still be the template of the index entry
+    if (AD013_HashGet(sensor, id, &hash, &size) && (io.hash != hash || io.size != size))
+      return -1;
+
+    // End of the data and Record Trailer
+    head[0] = 0;
+    head[1] = 0;
+    head[2] = io.size >> 8;
+    head[3] = io.size & 0xFF;
+    AD013_Put32(head + 4, io.hash);
+    if (AD013_BackupWrite(&io, head, 2 + AD013_BACKUP_RECORD_SIZE) < 0) return -1;
+
+    stats->templates++;
+    stats->bytes += io.size;
+  }
+
+  // Trailer
+  AD013_Put32(head, io.sum);
+  if (sink(sinkCtx, head, AD013_BACKUP_TRAILER_SIZE) != AD013_BACKUP_TRAILER_SIZE)
+    return -1;
+
+  stats->elapsed = millis() - start;
+
+  return stats->templates;
+}
+
+int AD013_RestoreDB(Stream            & SerialPort,
+                    AD013_DataSource    source,
+                    void              * sourceCtx,
+                    AD013_BackupStats * stats) {
+
+  AD013_Sensor * sensor;
+    // Context for the transfer flows (shared)
+
+  AD013_BackupIO io;
+  AD013_BackupStats local;
+  byte head[AD013_BACKUP_HEADER_SIZE];
+  uint8_t skip[(AD013_MAX_TEMPLATES + 7) / 8];
+  uint32_t hash = 0;
+  uint32_t sum = 0;
+  long size = 0;
+  int count = 0;
+
+  if (!source) return -1;
+  if (!stats) stats = &local;
+
+  memset(stats, 0, sizeof(AD013_BackupStats));
+  memset(&io, 0, sizeof(io));
+  memset(skip, 0, sizeof(skip));
+  io.source = source;
+  io.ctx = sourceCtx;
+  io.sum = AD013_FNV_OFFSET;
+
+  unsigned long start = millis();
+
+  if ((sensor = AD013_BlockingContext(SerialPort)) == NULL) return -1;
+  io.sensor = sensor;
+
+  // Header
+  if (AD013_BackupRead(&io, head, AD013_BACKUP_HEADER_SIZE) < 0 ||
+      memcmp(head, AD013_BACKUP_MAGIC, 4) != 0 || head[4] != AD013_BACKUP_VERSION) {
+    if (AD013_DEBUG_IS_ENABLED) printf("ERROR: Not an AD013 backup\n");
+    return -1;
+  }
+  count = (head[6] << 8) | head[7];
+  if (count > AD013_MAX_TEMPLATES) return -1;
+
+  // Occupied Slots (for the skip check)
+  if (AD013_IndexRangeEmpty(sensor, 0, 0) == AD013_INDEX_UNKNOWN &&
+      (AD013_SubmitLoadIndex(sensor) < 0 || AD013_RunFlow(sensor) != 1))
+    return AD013_FlowError(sensor);
+
+  // Hash Index: the slots that already hold their record are skipped
+  for (int i = 0; i < count; i++) {
+
+    int id = 0;
+
+    if (AD013_BackupRead(&io, head, AD013_BACKUP_ENTRY_SIZE) < 0) return -1;
+    id = (head[0] << 8) | head[1];
+    if (id >= AD013_MAX_TEMPLATES) return -1;
+
+    if (AD013_IndexRangeEmpty(sensor, id, id) == 0 &&
+        AD013_SlotHash(sensor, id, &hash, &size) > 0 &&
+        size == ((head[2] << 8) | head[3]) && hash == AD013_Get32(head + 4))
+      skip[i >> 3] |= (1 << (i & 0x07));
+  }
+
+  for (int i = 0; i < count; i++) {
+
+    int id = 0;
+
+    // Template ID
+    if (AD013_BackupRead(&io, head, 2) < 0) return -1;
+    id = (head[0] << 8) | head[1];
+    if (id >= AD013_MAX_TEMPLATES) return -1;
+
+    // Template Data (the size is known at the record end)
+    io.hash = AD013_FNV_OFFSET;
+    io.size = 0;
+    io.ended = false;
+    if (AD013_RestoreChunk(&io) < 0 || io.ended) return -1;
+
+    if (skip[i >> 3] & (1 << (i & 0x07))) {
+      if (AD013_RestoreSkip(&io) < 0) return -1;
+      stats->skipped++;
+    } else {
+      if (AD013_SubmitDownloadTemplate(sensor, id, AD013_BACKUP_MAX_RECORD,
+                                       AD013_RestoreData, &io) < 0 ||
+          AD013_RunFlow(sensor) != 1)
+        return AD013_FlowError(sensor);
+      AD013_HashSet(sensor, id, io.hash, io.size);
+      stats->bytes += io.size;
+    }
+
+    stats->templates++;
+  }
+
+  // Trailer
+  sum = io.sum;
+  if (AD013_BackupRead(&io, head, AD013_BACKUP_TRAILER_SIZE) < 0 ||
+      AD013_Get32(head) != sum) {
+    if (AD013_DEBUG_IS_ENABLED) printf("ERROR: Backup checksum mismatch\n");
+    return -1;
+  }
+
+  stats->elapsed = millis() - start;
+
+  return stats->templates;
+}
+
+#if defined(__linux__)
+
+int AD013_MmapSinkOpen(AD013_MmapSink * sink, const char * path, size_t maxSize) {
+
+  if (!sink || !path || maxSize == 0) return -1;
+
+  memset(sink, 0, sizeof(AD013_MmapSink));
+
+  if ((sink->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+    return -1;
+
+  // Sizes the file for the mapping
+  if (ftruncate(sink->fd, maxSize) < 0) {
+    close(sink->fd);
+    return -1;
+  }
+
+  sink->map = (byte *) mmap(NULL, maxSize, PROT_READ | PROT_WRITE, MAP_SHARED, sink->fd, 0);
+  if (sink->map == MAP_FAILED) {
+    close(sink->fd);
+    sink->map = NULL;
+    return -1;
+  }
+  sink->size = maxSize;
+
+  return 1;
+}
+
+int AD013_MmapSinkWrite(void * ctx, const byte * data, int size) {
+
+  AD013_MmapSink * sink = (AD013_MmapSink *) ctx;
+
+  if (!sink || !sink->map || sink->pos + size > sink->size)
+    return -1;
+
+  memcpy(sink->map + sink->pos, data, size);
+  sink->pos += size;
+
+  return size;
+}
+
+int AD013_MmapSinkClose(AD013_MmapSink * sink) {
+
+  int ret = 1;
+
+  if (!sink || !sink->map) return -1;
+
+  // Flushes the pages, then drops the unused tail
+  if (msync(sink->map, sink->size, MS_SYNC) < 0) ret = -1;
+  munmap(sink->map, sink->size);
+  if (ftruncate(sink->fd, sink->pos) < 0) ret = -1;
+  close(sink->fd);
+
+  sink->map = NULL;
+
+  return ret;
+}
+
+int AD013_MmapSourceOpen(AD013_MmapSource * source, const char * path) {
+
+  struct stat st;
+
+  if (!source || !path) return -1;
+
+  memset(source, 0, sizeof(AD013_MmapSource));
+
+  if ((source->fd = open(path, O_RDONLY)) < 0)
+    return -1;
+
+  if (fstat(source->fd, &st) < 0 || st.st_size == 0) {
+    close(source->fd);
+    return -1;
+  }
+
+  source->map = (byte *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, source->fd, 0);
+  if (source->map == MAP_FAILED) {
+    close(source->fd);
+    source->map = NULL;
+    return -1;
+  }
+  source->size = st.st_size;
+
+  return 1;
+}
+
+int AD013_MmapSourceRead(void * ctx, byte * data, int size) {
+
+  AD013_MmapSource * source = (AD013_MmapSource *) ctx;
+
+  if (!source || !source->map) return -1;
+
+  if ((size_t) size > source->size - source->pos)
+    size = source->size - source->pos;
+
+  memcpy(data, source->map + source->pos, size);
+  source->pos += size;
+
+  return size;
+}
+
+int AD013_MmapSourceClose(AD013_MmapSource * source) {
+
+  if (!source || !source->map) return -1;
+
+  munmap(source->map, source->size);
+  close(source->fd);
+
+  source->map = NULL;
+
+  return 1;
+}
+
+#endif
+
+/* !\brief Clears one template from the fingerprint DB */
+
+int AD013_ClearTemplates (Stream & SerialPort,
+					    int      rangeStart,
+					    int      rangeEnd,
+					    int    * framesSent) {
+
+  AD013_Sensor * sensor;
+    // Context for the delete flow (shared)
+
+  int frames = 0;
+
+  if ((sensor = AD013_BlockingContext(SerialPort)) == NULL) return -1;
+
+  // The index turns the range into the fewest commands (worst case,
+  // one PS_DeletChar of the whole range, if it cannot be read)
+  if (AD013_IndexRangeEmpty(sensor, 0, 0) == AD013_INDEX_UNKNOWN &&
+      AD013_SubmitLoadIndex(sensor) > 0) {
+    AD013_RunFlow(sensor);
+    frames = sensor->frames;
+  }
+
+  if (AD013_SubmitClear(sensor, rangeStart, rangeEnd) < 0)
+    return -1;
+
+  // Runs the flow to completion
+  AD013_RunFlow(sensor);
+
+  if (framesSent) *framesSent = frames + sensor->frames;
+
+  return sensor->result == 1 ? 1 : AD013_FlowError(sensor);
+}
+
+                      
+/* !\brief Clears all user templates from the fingerprint DB */
+
+int AD013_ClearUserTemplates (Stream & SerialPort, int * framesSent) {
+  return AD013_ClearTemplates(SerialPort, AD013_SO_TEMPLATES,
+    AD013_MAX_TEMPLATES - 1, framesSent);
+}
+
+
+/* !\brief Clears all the Security Officer (SO) templates from the
+           fingerprint DB */
+
+int AD013_ClearSOTemplates(Stream & SerialPort, int * framesSent) {
+  return AD013_ClearTemplates(SerialPort, 0, AD013_SO_TEMPLATES - 1, framesSent);
 }
 
 /* !\brief Enrolls a new Finger into the Sensor's DB */
 
-int AD013_Enroll(Stream & SerialPort, bool isSecurityOfficer) {
+int AD013_Enroll(Stream & SerialPort,
+                 bool     isSecurityOfficer,
+                 int      timeOut,
+                 AD013_EnrollResult * result) {
+
+  AD013_Sensor * sensor;
+    // Context for the enroll flow (shared)
+
+  if ((sensor = AD013_BlockingContext(SerialPort)) == NULL) return -1;
+
+  if (AD013_SubmitEnroll(sensor, isSecurityOfficer, -1, timeOut) < 0)
+    return -1;
+
+  // Runs the flow to completion
+  AD013_RunFlow(sensor);
+
+  if (result) *result = sensor->enroll;
 
-	// DEBUG: PLACEHOLDER: MISSING CODE
-	if (AD013_DEBUG_IS_ENABLED) printf("AD013_Enroll() Not Implemented, yet.\n");
-	return -1;
+  return sensor->result;
 }
@@ -1,9 +1,106 @@
 #ifndef AD013_FINGERPRINT_SENSOR_HEADER
 #define AD013_FINGERPRINT_SENSOR_HEADER
 
+// Arduino Core (Stream, millis, byte)
+#include <Arduino.h>
+
 // Use different max sizes if needed
 #define AD013_MAX_PARAMS_SIZE     20
 
+// Default Serial Timeout (ms)
+#define AD013_DEFAULT_TIMEOUT   1000
+
+// Probe Timeout used while scanning speeds (ms)
+#define AD013_PROBE_TIMEOUT      200
+
+// Max Packet Payload (Code/Data, Sum excluded). Data packets
+// carry up to 128 bytes with the default sensor packet size
+#ifndef AD013_MAX_PAYLOAD_SIZE
+#define AD013_MAX_PAYLOAD_SIZE   128
+#endif
+
+// Sensor's Data Packet Size (must fit AD013_MAX_PAYLOAD_SIZE)
+#ifndef AD013_DEFAULT_PACKET_SIZE
+#define AD013_DEFAULT_PACKET_SIZE 128
+#endif
+
+// Image Upload Ring (blocking version)
+#ifndef AD013_IMAGE_RING_SIZE
+#define AD013_IMAGE_RING_SIZE     (2 * AD013_DEFAULT_PACKET_SIZE)
+#endif
+
+// Packet Flags
+#define AD013_FLAG_COMMAND      0x01
+#define AD013_FLAG_DATA         0x02
+#define AD013_FLAG_ACK          0x07
+#define AD013_FLAG_DATA_END     0x08
+
+// Template DB Layout (Security Officer templates first)
+#ifndef AD013_MAX_TEMPLATES
+#define AD013_MAX_TEMPLATES      100
+#endif
+#define AD013_SO_TEMPLATES        20
+
+// Template Hash Cache (see AD013_RestoreDB(), 6 bytes per template
+// and link slot)
+#ifndef AD013_HASH_CACHE
+#if defined(__AVR__)
+#define AD013_HASH_CACHE           0
+#else
+#define AD013_HASH_CACHE           1
+#endif
+#endif
+
+// Search Planner Sizes
+#ifndef AD013_HOT_SIZE
+#define AD013_HOT_SIZE             4   // Recently matched IDs (LRU)
+#endif
+#define AD013_MAX_SEARCH_TIERS     4   // Configured tiers (after the hot tier)
+#define AD013_MAX_SEARCH_RANGES   (2 * AD013_HOT_SIZE + AD013_MAX_SEARCH_TIERS)  // Hot tier, tiers and splits
+
+// Recent Match Cache (see AD013_SetMatchCacheTTL())
+#ifndef AD013_MATCH_CACHE_TTL
+#define AD013_MATCH_CACHE_TTL   1000   // Max gap between two finger checks (ms)
+#endif
+
+// Touch Detection Modes (see AD013_SetTouchPin())
+#define AD013_TOUCH_NONE          -1
+#define AD013_TOUCH_EXTERNAL      -2
+
+// Wake Timeout (sensor boot after PS_Sleep, see AD013_SubmitWake())
+#ifndef AD013_WAKE_TIMEOUT
+#define AD013_WAKE_TIMEOUT      1000
+#endif
+
+// Async Status Values
+#define AD013_ASYNC_IDLE           0
+#define AD013_ASYNC_BUSY           1
+
+// Timeout Status (no reply, or the policy deadline was reached). The
+// functions return it in place of -1 when the failure is a timeout
+#define AD013_TIMEOUT             -4
+
+// Partial Image Status (corrupted data packets were replaced by
+// zeros, see AD013_SubmitUploadImage())
+#define AD013_PARTIAL             -5
+
+// Default Transaction Policy (see AD013_SetDefaultPolicy())
+#ifndef AD013_DEFAULT_RETRIES
+#define AD013_DEFAULT_RETRIES      2   // Retransmits per command
+#endif
+#ifndef AD013_DEFAULT_BACKOFF
+#define AD013_DEFAULT_BACKOFF     10   // First retransmit delay (ms, doubled each time)
+#endif
+
+// Last Command Frame (header, code, params and sum)
+#define AD013_MAX_CMD_FRAME_SIZE  (AD013_MAX_PARAMS_SIZE + 12)
+
+// Parser Return Values
+#define AD013_PARSE_MORE           0
+#define AD013_PARSE_DONE           1
+#define AD013_PARSE_OVERFLOW      -2
+#define AD013_PARSE_BAD_SUM      -99
+
 // Static Parameters Buffer
 typedef struct params_st {
   char buff[AD013_MAX_PARAMS_SIZE];
@@ -11,6 +108,1037 @@ typedef struct params_st {
   int size;
 } AD013_Params;
 
+// Search Result (filled by the identify flows)
+typedef struct search_result_st {
+  int           status;      // AD013_CODE of the search (negative for link errors)
+  int           templateId;  // Matched Template ID (-1 if none)
+  int           score;       // Match Score (from the sensor)
+  int           quality;     // Capture Quality (AD013_CODE from PS_GenChar)
+  unsigned long elapsed;     // From submission to result (ms)
+} AD013_SearchResult;
+
+// Enroll Captures (one char buffer each) and Retries
+#define AD013_ENROLL_CAPTURES      5
+#ifndef AD013_ENROLL_MAX_RETRIES
+#define AD013_ENROLL_MAX_RETRIES   3   // Per capture
+#endif
+
+// Enroll Status (finger already enrolled)
+#define AD013_ENROLL_DUPLICATE    -3
+
+// Enroll Result (filled by the enroll flow)
+typedef struct enroll_result_st {
+  int           status;      // AD013_CODE (or AD013_ENROLL_DUPLICATE, negative for link errors)
+  int           templateId;  // Stored Template ID (-1 if none)
+  int           duplicateId; // Matching Template ID (if already enrolled)
+  uint8_t       captures;    // Accepted Captures
+  uint8_t       retries;     // Rejected Captures (all)
+  uint8_t       captureRetries[AD013_ENROLL_CAPTURES]; // Rejected Captures per capture
+  unsigned long elapsed;     // From submission to result (ms)
+} AD013_EnrollResult;
+
+// Search Range (one PS_Search command)
+typedef struct search_range_st {
+  uint16_t start;
+  uint16_t count;
+} AD013_SearchRange;
+
+// Search Planner Statistics (tier 0 is the hot tier)
+typedef struct search_stats_st {
+  uint32_t searches;                             // Completed searches
+  uint32_t matches;                              // Searches with a match
+  uint32_t commands;                             // PS_Search commands sent
+  uint32_t totalMs;                              // Sum of the search latencies
+  uint32_t tierHits[AD013_MAX_SEARCH_TIERS + 1]; // Matches per tier
+  uint32_t tierMs[AD013_MAX_SEARCH_TIERS + 1];   // Sum of the latencies per tier hit
+  uint32_t suppressed;                           // Searches answered by the recent match
+} AD013_SearchStats;
+
+// Link Metrics (on by default, build with -DAD013_METRICS=0 to
+// compile them out, see AD013_GetMetrics())
+#ifndef AD013_METRICS
+#define AD013_METRICS              1
+#endif
+
+// Metrics Sizes. The opcodes are a fixed set (the identify, verify
+// and discovery commands), all the others share the last slot
+#define AD013_METRICS_OPCODES      8   // 0x01 0x02 0x03 0x04 0x13 0x1F 0x32, others
+#define AD013_METRICS_OTHER     0xFF   // Code of the last slot
+#define AD013_METRICS_HIST_SIZE   13   // RTT buckets: < 1, 2, 4 ... 2048 ms, above
+#define AD013_METRICS_CODES       33   // AD013_CODE 0x00-0x1F, others
+
+// Per-Opcode Metrics (round trip in microseconds, the sum wraps
+// after about 71 minutes of round trips: reset after each scrape)
+typedef struct op_metrics_st {
+  uint8_t  code;                 // Command code (AD013_METRICS_OTHER for the rest)
+  uint32_t calls;                // Commands sent
+  uint32_t replies;              // Replies received (timed)
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint32_t totalUs;              // avg = totalUs / replies
+} AD013_OpMetrics;
+
+// Link Metrics
+typedef struct metrics_st {
+  AD013_OpMetrics ops[AD013_METRICS_OPCODES];
+  uint32_t rttHist[AD013_METRICS_HIST_SIZE];
+  uint32_t codes[AD013_METRICS_CODES];  // Sensor replies by AD013_CODE
+  uint32_t badSums;              // Checksum failures (-99)
+  uint32_t shortReads;           // Timeouts with a partial reply
+  uint32_t timeouts;             // Timeouts with no reply at all
+  uint32_t badDevIds;            // Replies from another device
+  uint32_t retransmits;          // Commands sent again (bad sum, short read)
+  uint32_t deadlines;            // Operations cut at the policy deadline
+} AD013_Metrics;
+
+// Binary Trace Ring (build with -DAD013_TRACE, see AD013_TraceDump())
+#ifndef AD013_TRACE_SIZE
+#define AD013_TRACE_SIZE         512
+#endif
+#ifndef AD013_TRACE_MAX_DATA
+#define AD013_TRACE_MAX_DATA      32   // Frame bytes kept per record
+#endif
+#define AD013_TRACE_VERSION        1
+
+// Trace Record Types
+#define AD013_TRACE_TX           'T'   // Frame sent (raw bytes)
+#define AD013_TRACE_RX           'R'   // Packet received (aux: flag, payload)
+#define AD013_TRACE_ERR          'E'   // Failed read (aux: reason, partial payload)
+
+// Trace Error Reasons
+#define AD013_TRACE_TIMEOUT        1
+#define AD013_TRACE_BAD_SUM        2
+#define AD013_TRACE_BAD_DEVID      3
+
+// Incremental Packet Parser States
+typedef enum {
+  AD013_PARSER_HEADER_HI = 0,
+  AD013_PARSER_HEADER_LO,
+  AD013_PARSER_DEVID,
+  AD013_PARSER_FLAG,
+  AD013_PARSER_LENGTH,
+  AD013_PARSER_PAYLOAD,
+  AD013_PARSER_SUM,
+  AD013_PARSER_DONE
+} AD013_PARSER_STATE;
+
+// Incremental Packet Parser
+typedef struct parser_st {
+  volatile uint8_t state;
+  uint8_t  flag;
+  char     devId[4];
+  uint16_t length;       // Payload + Sum (from the header)
+  uint16_t pos;          // Bytes received for the current field
+  uint16_t sum;          // Running sum (flag to end of payload)
+  uint16_t recv_sum;     // Sum from the packet
+  byte     payload[AD013_MAX_PAYLOAD_SIZE];
+  uint16_t payload_len;
+} AD013_Parser;
+
+
+/*! \brief Resets the parser to hunt for the next packet header
+ */
+void AD013_ParserInit(AD013_Parser * parser);
+
+
+/*! \brief Feeds one received byte into the packet parser
+ * 
+ * The parser hunts for the 0xEF01 header, then collects the
+ * devId, flag, length, payload and sum one byte at a time, so
+ * it can be fed from a UART ISR or from available() polling.
+ * 
+ * The function returns AD013_PARSE_MORE while the packet is
+ * incomplete and AD013_PARSE_DONE when a packet with a valid
+ * checksum is available in the parser (flag, devId, payload).
+ * The packet stays available until the next byte is fed.
+ * 
+ * On a bad checksum (AD013_PARSE_BAD_SUM) or a packet larger
+ * than AD013_MAX_PAYLOAD_SIZE (AD013_PARSE_OVERFLOW) the packet
+ * is dropped and the parser resyncs on the next header.
+ */
+int AD013_ParserFeed(AD013_Parser * parser, byte val);
+
+
+/*! \brief Feeds all the available bytes from the Stream
+ * 
+ * Never blocks: the function returns as soon as a packet is
+ * complete (or an error is detected), or when no more bytes
+ * are available. Return values are the same as for the
+ * AD013_ParserFeed() function.
+ */
+int AD013_ParserPoll(AD013_Parser * parser, Stream & SensorCom);
+
+
+
+// Async Operations
+typedef enum {
+  AD013_OP_NONE = 0,
+  AD013_OP_COMMAND,
+  AD013_OP_FIND_SENSOR,
+  AD013_OP_IDENTIFY,
+  AD013_OP_SET_BAUD,
+  AD013_OP_AUTO_IDENTIFY,
+  AD013_OP_VERIFY,
+  AD013_OP_LOAD_INDEX,
+  AD013_OP_CLEAR,
+  AD013_OP_ENROLL,
+  AD013_OP_UPLOAD,
+  AD013_OP_DOWNLOAD,
+  AD013_OP_UPLOAD_IMAGE,
+  AD013_OP_SLEEP,
+  AD013_OP_WAKE
+} AD013_OP;
+
+// Transfer Statistics (image uploads)
+typedef struct transfer_stats_st {
+  unsigned long bytes;       // Bytes passed to the sink
+  unsigned long packets;     // Data packets received
+  unsigned long resyncs;     // Packets lost to checksum errors (zero-filled)
+  unsigned long elapsed;     // From the first data packet to the end (ms)
+} AD013_TransferStats;
+
+// Template Index Lookups (cache not loaded)
+#define AD013_INDEX_UNKNOWN       -2
+
+// Link Record (last-good speed, device ID and password).
+// The record is kept in persistent storage so that the
+// discovery can try it first on the next boot
+typedef struct link_st {
+  uint16_t magic;
+  uint8_t  version;
+  char     devId[4];
+  char     passwd[4];
+  uint32_t baud;
+  uint8_t  sum;
+} AD013_Link;
+
+// Persistent Storage Callbacks (slot selects the record, one
+// per sensor). Both return the number of bytes transferred
+typedef int (*AD013_StorageRead)(int slot, void * data, int size);
+typedef int (*AD013_StorageWrite)(int slot, const void * data, int size);
+
+// Data Stream Callbacks (template transfers). The sink gets each
+// data packet as it arrives, the source fills the next packet to
+// send. Both return the number of bytes handled (negative aborts)
+typedef int (*AD013_DataSink)(void * ctx, const byte * data, int size);
+typedef int (*AD013_DataSource)(void * ctx, byte * data, int size);
+
+// Baud Change Hook (switches the host side of the link)
+typedef void (*AD013_BaudHook)(Stream & com, long baud);
+
+// Serial Port with its own speed control (e.g. AD013_LinuxSerial),
+// see AD013_PortBaudHook()
+class AD013_Port : public Stream {
+  public:
+    virtual void setBaud(long baud) = 0;
+};
+
+// Transaction Policy (per context, see AD013_SetPolicy()). The
+// frame timeout bounds each reply, corrupted (bad sum) or short
+// replies to a command are retransmitted up to 'retries' times
+// after backoff, 2 x backoff ... ms, and the whole operation is
+// cut at the deadline
+typedef struct policy_st {
+  unsigned long deadline;        // Operation budget (ms, 0 for none)
+  unsigned long frameTimeout;    // Per-reply timeout (ms)
+  uint8_t       retries;         // Retransmits per command
+  unsigned long backoff;         // First retransmit delay (ms)
+} AD013_Policy;
+
+struct sensor_st;
+
+// Completion Callback (result is operation specific)
+typedef void (*AD013_Callback)(struct sensor_st * sensor, int result, void * ctx);
+
+// Sensor Context (one per attached sensor)
+typedef struct sensor_st {
+  Stream         * com;          // Serial Interface
+  char             devId[4];     // Device ID
+  char             passwd[4];    // Password (for re-verification)
+  long             baud;         // Current Speed (0 if not known)
+  long             prevBaud;     // Speed before an upgrade
+  int              slot;         // Link Record Slot
+  AD013_BaudHook   baudHook;     // Host speed change (see AD013_SetBaudHook())
+  AD013_Policy     policy;       // Timeouts and Retransmits
+
+  // Current Operation
+  uint8_t          op;           // AD013_OP value
+  uint8_t          step;         // Operation specific step
+  uint8_t          waiting;      // Command sent, waiting for the ACK
+  uint8_t          lastOp;       // Last completed operation
+  int              result;       // Operation result (valid once idle)
+  unsigned long    startedAt;    // Operation submitted at (millis)
+  unsigned long    deadline;     // Operation deadline (millis)
+  unsigned long    wakeAt;       // Next step not before (millis)
+  unsigned long    sentAt;       // Last command sent at (millis)
+  unsigned long    sentUs;       // Last command sent at (micros)
+  uint8_t          timing;       // First reply not received yet
+  unsigned long    replyTimeout; // Timeout for the pending reply (ms)
+  unsigned long    expiresAt;    // Policy deadline (millis)
+  uint8_t          retry;        // Retransmits of the last command
+  uint8_t          resend;       // Retransmit due at wakeAt
+  uint8_t          timedOut;     // Last reply wait timed out
+  byte             txFrame[AD013_MAX_CMD_FRAME_SIZE]; // Last command (for retransmits)
+  uint8_t          txLen;
+
+  // Operation Arguments
+  int              speedIdx;
+  long             serSpeed;
+  int              threashold;
+  int              securityLevel;
+  int              targetId;
+  bool             soOnly;
+
+  // Last Search (and Enroll) Result
+  AD013_SearchResult match;
+  AD013_EnrollResult enroll;
+  uint8_t          capture;      // Current enroll capture
+
+  // Search (or Delete) Plan, built when the flow starts
+  AD013_SearchRange plan[AD013_MAX_SEARCH_RANGES];
+  uint8_t          planTier[AD013_MAX_SEARCH_RANGES];
+  uint8_t          planLen;
+  uint8_t          planIdx;
+  unsigned long    searchAt;     // First PS_Search sent at (millis)
+
+  // Finger Detection
+  int              touchPin;     // Touch Output Pin (or AD013_TOUCH_*)
+  uint8_t          touchLevel;   // Active level of the touch output
+  volatile uint8_t touched;      // Set by the touch interrupt
+  volatile unsigned long touchedAt; // First touch at (millis)
+  unsigned long    pollPeriod;   // Current PS_GetImage poll period
+  unsigned long    lastPollAt;   // Last PS_GetImage sent at (millis)
+  unsigned long    captureLatency; // Touch to captured image (ms)
+
+  // Low Power
+  uint8_t          asleep;       // PS_Sleep accepted (a touch wakes it)
+  uint8_t          waking;       // Wake probe (password) pending
+  unsigned long    wakeLatency;  // Touch (or wake request) to link ready (ms)
+
+  // Data Streams (one packet at a time, never the whole data)
+  uint16_t         packetSize;   // Sensor's data packet size (bytes)
+  uint8_t          dataIn;       // Data packets expected
+  long             dataLeft;     // Bytes left to send
+  unsigned long    dataBytes;    // Bytes transferred
+  unsigned long    dataAt;       // Data transfer started at (millis)
+  unsigned long    dataPackets;  // Data packets received
+  unsigned long    dataResyncs;  // Data packets lost to checksum errors
+  long             dataSize;     // Expected bytes (0 if not known)
+  AD013_DataSink   sink;
+  AD013_DataSource source;
+  void           * dataCtx;
+  byte           * ring;         // Ring between the UART and the sink
+  uint16_t         ringSize;
+  uint16_t         ringHead;
+  uint16_t         ringLen;
+
+  // Command Parameters and Reply
+  AD013_Params     params;
+  int              code;         // Last command code
+  uint16_t         dbStart;      // Templates stored/deleted by the
+  uint16_t         dbCount;      //   last command (for the index)
+  uint16_t         frames;       // Frames sent by the current operation
+  AD013_Parser     parser;       // Reply (data in payload + 1)
+
+  // Completion
+  AD013_Callback   callback;
+  void           * ctx;
+} AD013_Sensor;
+
+
+// Sensor Pool Sizes (up to 8 sensors, see AD013_Pool::armed)
+#ifndef AD013_MAX_POOL_SENSORS
+#define AD013_MAX_POOL_SENSORS     4
+#endif
+#ifndef AD013_POOL_QUEUE_SIZE
+#define AD013_POOL_QUEUE_SIZE      8
+#endif
+
+// Pool Event (one per completed operation)
+typedef struct pool_event_st {
+  uint8_t            sensor;     // Sensor index in the pool
+  uint8_t            op;         // Completed operation (AD013_OP)
+  int                result;     // Operation result
+  AD013_SearchResult match;      // Search result (identify flows)
+  unsigned long      at;         // Completed at (millis)
+} AD013_PoolEvent;
+
+// Sensor Pool (owns the contexts, one event queue for all)
+typedef struct pool_st {
+  AD013_Sensor       sensors[AD013_MAX_POOL_SENSORS];
+  uint8_t            count;
+  uint8_t            next;       // Round-robin start
+  uint8_t            armed;      // Continuous identify (bit per sensor)
+  int                timeOut;    // Continuous identify arguments
+  int                threashold;
+  AD013_PoolEvent    queue[AD013_POOL_QUEUE_SIZE];
+  uint8_t            head;
+  uint8_t            len;
+  unsigned long      dropped;    // Events lost (queue full)
+  unsigned long      identified; // Identify results queued
+} AD013_Pool;
+
+
+/*! \brief Initializes a sensor context on the provided Stream
+ * 
+ * The context uses the default device ID. The Stream must stay
+ * valid for as long as the context is used.
+ */
+void AD013_SensorInit(AD013_Sensor * sensor, Stream & SensorCom);
+
+
+/*! \brief Returns the context of the blocking functions
+ * 
+ * The blocking functions (e.g., AD013_SearchTemplate()) share one
+ * static context. It is initialized on the first call for a Stream
+ * and kept afterwards, so the touch pin (see AD013_SetTouchPin()),
+ * the sleep state and the last match carry over from one call to
+ * the next. Each call takes the speed, device ID and password from
+ * the last discovery (link record), the default policy and the
+ * default baud hook.
+ * 
+ * The functions run one at a time and yield() while they wait.
+ * They fail (-1) when called from the callbacks of another blocking
+ * call. Using another Stream re-initializes the context.
+ */
+AD013_Sensor * AD013_SharedSensor(Stream & SensorCom);
+
+
+/*! \brief Sets the persistent storage for the link records
+ * 
+ * By default the records are stored in the EEPROM when the
+ * library is built with AD013_USE_EEPROM, in the file named by
+ * AD013_LINK_FILE when a Linux build defines it, and only in RAM
+ * otherwise. Nothing is written to the working directory unless
+ * asked for. Use NULL callbacks to go back to the defaults.
+ */
+void AD013_SetStorage(AD013_StorageRead  readCb,
+                      AD013_StorageWrite writeCb);
+
+
+/*! \brief Sets the default baud hook for the new contexts
+ * 
+ * The hook changes the host side speed while scanning or upgrading
+ * the link, and only it knows the real type of the Stream. There is
+ * no default: use AD013_SoftSerialBaudHook() for SoftwareSerial,
+ * AD013_PortBaudHook() for the ports derived from AD013_Port, or a
+ * function calling begin() on the right HardwareSerial. The hook
+ * can also be set per context (sensor->baudHook).
+ * 
+ * Without a hook the discovery and the speed upgrade fail with -1,
+ * and the other calls keep the port at the speed it was opened with.
+ */
+void AD013_SetBaudHook(AD013_BaudHook hook);
+
+
+/*! \brief Baud hook for the AD013_Port streams (calls setBaud())
+ */
+void AD013_PortBaudHook(Stream & com, long baud);
+
+
+/*! \brief Baud hook for the SoftwareSerial streams (calls begin())
+ */
+void AD013_SoftSerialBaudHook(Stream & com, long baud);
+
+
+#if AD013_METRICS
+
+/*! \brief Returns a snapshot of the link metrics
+ * 
+ * The metrics are collected unless built with AD013_METRICS set to
+ * 0 (a few counters per command): per-opcode calls and min/avg/max
+ * round trip, a round trip histogram, the sensor replies by
+ * AD013_CODE, and the checksum failures, short reads, timeouts and
+ * foreign replies.
+ */
+void AD013_GetMetrics(AD013_Metrics * snapshot);
+
+
+/*! \brief Resets the link metrics
+ */
+void AD013_ResetMetrics(void);
+
+
+/*! \brief Prints the link metrics (one "ad013 ..." line each)
+ * 
+ * Use it to scrape the metrics over a debug serial port. Only the
+ * non-zero counters are printed. Returns the number of lines.
+ */
+int AD013_PrintMetrics(Print & out);
+
+#else
+
+// Metrics are compiled out
+static inline void AD013_GetMetrics(AD013_Metrics * snapshot) {
+  if (snapshot) memset(snapshot, 0, sizeof(*snapshot));
+}
+static inline void AD013_ResetMetrics(void) { }
+static inline int AD013_PrintMetrics(Print & out) { (void) out; return 0; }
+
+#endif
+
+
+#if defined(AD013_TRACE)
+
+/*! \brief Writes the trace ring (binary) to the output
+ *
+ * The dump starts with "ADTR", the version, the bytes kept per frame
+ * (AD013_TRACE_MAX_DATA), the records dropped (4 bytes) and the size
+ * of the records (2 bytes). Each record is its type, aux byte, frame
+ * size (2 bytes) and timestamp (micros(), 4 bytes), followed by up to
+ * AD013_TRACE_MAX_DATA bytes of the frame. All fields are big endian,
+ * oldest record first. Decode it with extras/ad013_trace.py.
+ *
+ * Returns the number of bytes written.
+ */
+int AD013_TraceDump(Print & out);
+
+
+/*! \brief Empties the trace ring
+ */
+void AD013_TraceReset(void);
+
+#else
+
+// Tracing is compiled out
+static inline int AD013_TraceDump(Print & out) { (void) out; return 0; }
+static inline void AD013_TraceReset(void) { }
+
+#endif
+
+
+/*! \brief Returns the duration (ms) of the last sensor discovery
+ * 
+ * Use this value to track the boot latency: it covers the whole
+ * AD013_FindSensor() (or AD013_SubmitFindSensor()) flow, from
+ * the submission to the verified password (or failure).
+ */
+unsigned long AD013_DiscoveryTime(void);
+
+
+/*! \brief Enables the touch-driven finger detection
+ * 
+ * The AD-013 touch output goes active when a finger is on the
+ * sensor. When the touch pin is set, the identify flows do not
+ * send PS_GetImage until the interrupt fires, freeing the UART
+ * (and saving power) while no finger is present.
+ * 
+ * Use AD013_TOUCH_EXTERNAL when the touch events come from a
+ * different source (e.g., an event loop on the host build) and
+ * call AD013_TouchNotify() from it. Use AD013_TOUCH_NONE to go
+ * back to the (adaptive) PS_GetImage polling.
+ * 
+ * A touch from before the flow is submitted is kept for it, and the
+ * pin is read when the flow starts so that a finger that is already
+ * on (no edge) is captured right away.
+ * 
+ * The mode is the interrupt mode (RISING for an active high
+ * output). The function returns -1 if no more interrupt slots
+ * are available (see AD013_MAX_TOUCH_PINS).
+ */
+int AD013_SetTouchPin(AD013_Sensor * sensor,
+                      int            pin,
+                      int            mode = RISING);
+
+
+/*! \brief Signals a touch on the sensor
+ * 
+ * Safe to call from an interrupt handler. Only the first touch
+ * (until the finger is captured or lifted) is recorded, but every
+ * touch drops the recent match (see AD013_SetMatchCacheTTL()).
+ */
+void AD013_TouchNotify(AD013_Sensor * sensor);
+
+
+/*! \brief Returns the touch-to-capture latency (ms) of the last capture
+ * 
+ * With touch detection this is the time from the interrupt to the
+ * successful PS_GetImage, when polling it is the time since the
+ * last poll that found no finger (an upper bound).
+ */
+unsigned long AD013_CaptureLatency(void);
+
+
+/*! \brief Configures the search tiers
+ * 
+ * The identify flow searches the hot tier (the most recently
+ * matched templates of the sensor's link slot) first, then each
+ * of the configured ranges in order, and stops at the first match.
+ * The default tiers are the Security Officer range (0-19) and then
+ * the users' range. The hot IDs are left out of the configured
+ * ranges (split around them), so no template is searched twice.
+ * 
+ * A finger that misses the hot tier pays for it: up to
+ * AD013_HOT_SIZE extra PS_Search round trips for the hot tier
+ * (adjacent IDs share one) and as many again for the splits of
+ * the configured tiers. The hot tier pays off when a few users
+ * account for most of the touches, see the search scenario of
+ * ad013_bench and AD013_GetSearchStats() for the hit rates on a
+ * real workload.
+ * 
+ * Use NULL to restore the default tiers. The function returns -1
+ * if more than AD013_MAX_SEARCH_TIERS tiers are provided.
+ */
+int AD013_SetSearchTiers(const AD013_SearchRange * tiers, int count);
+
+
+/*! \brief Returns a snapshot of the search planner statistics
+ * 
+ * The tier hits show how often the early tiers end the search
+ * and the average latency is totalMs / searches (tierMs for the
+ * searches that ended in each tier).
+ */
+void AD013_GetSearchStats(AD013_SearchStats * stats);
+
+
+/*! \brief Resets the search planner statistics
+ */
+void AD013_ResetSearchStats(void);
+
+
+/*! \brief Sets the lifetime of the recent match
+ * 
+ * After a match, the identify flow keeps returning the same result
+ * (no PS_GenChar or PS_Search, just PS_GetImage) for as long as the
+ * finger stays on the sensor (e.g., AD013_SearchTemplate() called in
+ * a loop). The recent match is dropped when the sensor reports
+ * AD013_CODE_NO_FINGER, or when the finger has not been checked for
+ * more than ttl ms, and with touch detection (see AD013_SetTouchPin())
+ * also on every new touch.
+ * 
+ * With PS_GetImage polling (AD013_TOUCH_NONE) only the captures can
+ * tell that the finger left: a finger swapped within ttl ms, with no
+ * capture in between, gets the previous result. Keep the ttl short
+ * when polling, or use touch detection.
+ * 
+ * The answered searches are counted in the suppressed search
+ * statistics. Use 0 to disable the cache.
+ */
+void AD013_SetMatchCacheTTL(unsigned long ttl);
+
+
+/*! \brief Sets the transaction policy of a context
+ * 
+ * The policy applies from the next submitted operation. Operations
+ * that run out of time (no reply within the frame timeout, after the
+ * retransmits, or past the deadline) end with AD013_TIMEOUT. A
+ * deadline cuts the operation wherever it is, so keep it above the
+ * timeOut of the flows that wait for a finger.
+ * 
+ * Only corrupted or partial replies are retransmitted (a reply that
+ * never starts may follow a command that did run), and a retransmit
+ * costs the frame timeout, the backoff and the command again. The
+ * frame timeout must cover the slowest reply (PS_GenChar or a long
+ * PS_Search range, 90-130 ms on the host simulator and more on some
+ * sensors), so a short deadline leaves no room for it: an identify
+ * takes about 270 ms at 57600 baud, and a retransmitted PS_GenChar
+ * adds at least 130 + 10 + 90 ms, past a 500 ms deadline whatever
+ * the defaults. Keep deadlines for the operations without a finger
+ * wait, or above twice their usual time.
+ */
+void AD013_SetPolicy(AD013_Sensor * sensor, const AD013_Policy * policy);
+
+
+/*! \brief Sets the policy for the contexts initialized afterwards
+ * 
+ * The blocking functions (e.g., AD013_SearchTemplate()) follow this
+ * policy on each call (see AD013_SharedSensor()). NULL restores the
+ * defaults (AD013_DEFAULT_TIMEOUT per reply, AD013_DEFAULT_RETRIES
+ * retransmits, AD013_DEFAULT_BACKOFF ms and no deadline).
+ */
+void AD013_SetDefaultPolicy(const AD013_Policy * policy);
+
+
+/*! \brief Advances the current asynchronous operation
+ * 
+ * Call this function from the main loop. It never blocks: it
+ * consumes the available bytes, sends the next command when
+ * one is due, and invokes the completion callback when the
+ * operation ends.
+ * 
+ * The function returns AD013_ASYNC_BUSY while an operation is
+ * in progress and AD013_ASYNC_IDLE otherwise (sensor->result
+ * then holds the result of the last operation).
+ */
+int AD013_Poll(AD013_Sensor * sensor);
+
+
+/*! \brief Submits a single command
+ * 
+ * The params (if any) are copied into the context. The result
+ * passed to the callback is the code from the sensor's ACK or
+ * a negative value for communication errors. The reply data
+ * (after the code) is available in sensor->parser.payload + 1
+ * (sensor->parser.payload_len - 1 bytes) during the callback.
+ * 
+ * The function returns 1 if the command was accepted and -1 if
+ * the sensor is busy with another operation.
+ */
+int AD013_SubmitCommand(AD013_Sensor   * sensor,
+                        int              code,
+                        AD013_Params   * params   = NULL,
+                        AD013_Callback   callback = NULL,
+                        void           * ctx      = NULL);
+
+
+/*! \brief Submits the sensor discovery flow
+ * 
+ * Asynchronous version of AD013_FindSensor(). The result is '1'
+ * if the sensor has been found and the password was verified,
+ * and negative values for errors.
+ * 
+ * When scanning (serSpeed is -1), the last-good speed and device
+ * ID from the link record (sensor->slot) are tried first and the
+ * full scan is used as the fallback. The record is updated after
+ * a successful discovery. The flow is refused (-1) when the context
+ * has no baud hook.
+ */
+int AD013_SubmitFindSensor(AD013_Sensor   * sensor,
+                           long             serSpeed = -1,
+                           AD013_Params   * params   = NULL,
+                           AD013_Callback   callback = NULL,
+                           void           * ctx      = NULL);
+
+
+/*! \brief Submits the speed upgrade flow
+ * 
+ * Use this function after a successful discovery to move the link
+ * to a faster speed: the sensor's baud register is written (the
+ * speed must be a multiple of 9600, up to 115200), the Stream is
+ * switched to the new speed and the password is verified.
+ * 
+ * If the verification fails, the register is written back and
+ * the Stream returns to the previous speed. The result is '1' if
+ * the link runs at the new speed, '-1' if the link was rolled
+ * back (or the speed is not valid) and '-2' if the link was lost
+ * (sensor->baud is then 0, run the discovery again). The flow is
+ * refused (-1) when the context has no baud hook.
+ */
+int AD013_SubmitUpgradeBaud(AD013_Sensor   * sensor,
+                            long             targetBaud = 115200,
+                            AD013_Callback   callback   = NULL,
+                            void           * ctx        = NULL);
+
+
+/*! \brief Submits the identify (1:N search) flow
+ * 
+ * Asynchronous version of AD013_SearchTemplate(). The result is
+ * the ID of the matched template, or '-1' if no template was
+ * matched (or on errors and timeouts). The details are in the
+ * sensor->match search result.
+ */
+int AD013_SubmitIdentify(AD013_Sensor   * sensor,
+                         int              timeOut             = 5000,
+                         int              threashold          = 50,
+                         bool             SecurityOfficerOnly = false,
+                         AD013_Callback   callback            = NULL,
+                         void           * ctx                 = NULL);
+
+
+/*! \brief Submits the auto-identify flow (single command)
+ * 
+ * Uses the sensor's auto-identify command (0x32): capture, feature
+ * extraction and 1:N search run on the sensor and the stage status
+ * packets are streamed back, saving the host round trips (and the
+ * host-side polling) of the three-step identify flow.
+ * 
+ * The securityLevel (1-5) is the sensor's matching level. The result
+ * is the ID of the matched template, or '-1' if no template was
+ * matched (or on errors and timeouts). The details are in the
+ * sensor->match search result.
+ */
+int AD013_SubmitAutoIdentify(AD013_Sensor   * sensor,
+                             int              timeOut       = 5000,
+                             int              securityLevel = 3,
+                             AD013_Callback   callback      = NULL,
+                             void           * ctx           = NULL);
+
+
+/*! \brief Submits the verify (1:1 match) flow
+ * 
+ * Use this function when the identity is already claimed (e.g.,
+ * from an RFID badge): the claimed template is loaded into the
+ * sensor's second char buffer and matched against the fresh
+ * capture, instead of searching the whole DB.
+ * 
+ * The result is the claimedId if the finger matches (with a score
+ * not lower than the threashold) and '-1' otherwise. The details
+ * are in the sensor->match search result.
+ */
+int AD013_SubmitVerify(AD013_Sensor   * sensor,
+                       int              claimedId,
+                       int              timeOut    = 5000,
+                       int              threashold = 50,
+                       AD013_Callback   callback   = NULL,
+                       void           * ctx        = NULL);
+
+
+/*! \brief Loads the template index (occupancy bitmap) from the sensor
+ * 
+ * The index is read once with PS_ReadIndexTable and then kept up to
+ * date on every store, delete or DB clear sent to the sensor. It is
+ * dropped when the sensor reports a template DB error and must be
+ * loaded again. The index is kept per link slot (sensor->slot), so
+ * it outlives the context.
+ * 
+ * The result is '1' on success and a negative error code otherwise.
+ */
+int AD013_SubmitLoadIndex(AD013_Sensor   * sensor,
+                          AD013_Callback   callback = NULL,
+                          void           * ctx      = NULL);
+
+
+/*! \brief Returns the first free template ID in the range
+ * 
+ * The lookup uses the template index only (no traffic to the
+ * sensor). The range includes both the start and end IDs.
+ * 
+ * The function returns -1 if the range is full and AD013_INDEX_UNKNOWN
+ * if the index is not loaded (see AD013_SubmitLoadIndex()).
+ */
+int AD013_IndexFindFree(AD013_Sensor * sensor, int start, int end);
+
+
+/*! \brief Checks if a range of template IDs is empty
+ * 
+ * The function returns '1' if no template is stored in the range
+ * (start and end included), '0' if at least one is, and
+ * AD013_INDEX_UNKNOWN if the index is not loaded.
+ */
+int AD013_IndexRangeEmpty(AD013_Sensor * sensor, int start, int end);
+
+
+/*! \brief Drops the template index of the sensor
+ * 
+ * Use this function when the template DB is changed by other
+ * means (e.g. another host).
+ */
+void AD013_IndexInvalidate(AD013_Sensor * sensor);
+
+
+/*! \brief Deletes a range of templates from the sensor's DB
+ * 
+ * The range (start and end included) goes out as a single PS_DeletChar
+ * command. When the template index is loaded (see AD013_SubmitLoadIndex())
+ * an already empty range sends nothing, and a range holding all the
+ * stored templates is cleared with a single PS_Empty command.
+ * 
+ * The result is '1' on success and the sensor's error code otherwise.
+ * The number of frames sent is in sensor->frames.
+ */
+int AD013_SubmitClear(AD013_Sensor   * sensor,
+                      int              start,
+                      int              end,
+                      AD013_Callback   callback = NULL,
+                      void           * ctx      = NULL);
+
+
+/*! \brief Enrolls a new finger (asynchronous version)
+ * 
+ * The template is built from AD013_ENROLL_CAPTURES captures, each
+ * one generated in its own char buffer from a separate press: after
+ * each accepted capture the flow waits for the finger to be lifted
+ * (touch output released, or PS_GetImage reporting no finger) before
+ * the next one. A capture rejected for its quality (dry, wet,
+ * amorphous or too few minutiae) is retaken alone, up to
+ * AD013_ENROLL_MAX_RETRIES times.
+ * 
+ * The first capture is searched in the whole DB before the others
+ * are taken: a finger already enrolled (score at or above the
+ * threashold) ends the flow with AD013_ENROLL_DUPLICATE.
+ * 
+ * Use templateId -1 to store the template in the first free ID of
+ * the Security Officer (0-19) or users' range, the template index
+ * is loaded first if needed (see AD013_SubmitLoadIndex()).
+ * 
+ * The result is the stored Template ID or '-1', the details are in
+ * sensor->enroll.
+ */
+int AD013_SubmitEnroll(AD013_Sensor   * sensor,
+                       bool             isSecurityOfficer,
+                       int              templateId = -1,
+                       int              timeOut    = 20000,
+                       int              threashold = 50,
+                       AD013_Callback   callback   = NULL,
+                       void           * ctx        = NULL);
+
+
+/*! \brief Streams a template from the sensor's DB to the host
+ * 
+ * The template is loaded into char buffer (1) and uploaded with
+ * PS_UpChar. Each data packet is passed to the sink as soon as it
+ * is received (straight from the reply buffer), so the template is
+ * never held in RAM as a whole.
+ * 
+ * The result is '1' on success and an error code otherwise. The
+ * bytes transferred are in sensor->dataBytes, the transfer started
+ * at sensor->dataAt.
+ */
+int AD013_SubmitUploadTemplate(AD013_Sensor   * sensor,
+                               int              templateId,
+                               AD013_DataSink   sink,
+                               void           * sinkCtx,
+                               AD013_Callback   callback = NULL,
+                               void           * ctx      = NULL);
+
+
+/*! \brief Streams a template from the host to the sensor's DB
+ * 
+ * The template (size bytes) is downloaded into char buffer (1)
+ * with PS_DownChar and stored as templateId. The source fills one
+ * data packet (sensor->packetSize bytes, the last one can be
+ * shorter) at a time.
+ * 
+ * The result is '1' on success and an error code otherwise.
+ */
+int AD013_SubmitDownloadTemplate(AD013_Sensor     * sensor,
+                                 int                templateId,
+                                 long               size,
+                                 AD013_DataSource   source,
+                                 void             * sourceCtx,
+                                 AD013_Callback     callback = NULL,
+                                 void             * ctx      = NULL);
+
+
+/*! \brief Streams the sensor's image buffer to the host
+ * 
+ * The image (e.g. the last capture that failed with a quality error)
+ * is uploaded with PS_UpImage. The data packets go through the
+ * caller's ring buffer (a few packets are enough) so that a sink that
+ * accepts less than offered (returns fewer bytes) does not stall the
+ * UART.
+ * 
+ * Each packet's checksum is verified: a corrupted packet is replaced
+ * by packetSize zero bytes (the image layout is kept) and the parser
+ * resyncs on the next packet, the transfer is not restarted. Use
+ * imageSize (0 if not known) to complete the transfer when the last
+ * packet is lost.
+ * 
+ * The result is '1' on success, AD013_PARTIAL if the whole image went
+ * to the sink but some packets were zero-filled, and an error code
+ * otherwise. The counters are in sensor->dataBytes, dataPackets and
+ * dataResyncs (the zero-filled packets).
+ */
+int AD013_SubmitUploadImage(AD013_Sensor   * sensor,
+                            byte           * ring,
+                            uint16_t         ringSize,
+                            long             imageSize,
+                            AD013_DataSink   sink,
+                            void           * sinkCtx,
+                            AD013_Callback   callback = NULL,
+                            void           * ctx      = NULL);
+
+
+/*! \brief Puts the sensor to sleep (PS_Sleep)
+ * 
+ * The sensor only wakes up on a touch, so the context must have touch
+ * detection (see AD013_SetTouchPin()). Once asleep, every operation
+ * waits for the touch before its first command (up to the timeOut of
+ * the finger flows, AD013_WAKE_TIMEOUT for the others), checks the
+ * link (password at the cached speed, no scan) as soon as the sensor
+ * answers and then goes on, e.g. the identify flow captures right
+ * away. sensor->wakeLatency is the touch to link ready time and
+ * sensor->captureLatency the touch to first capture time.
+ * 
+ * The result is '1' on success and the sensor's code otherwise (e.g.
+ * AD013_CODE_LOW_POWER_MODE_ERROR with a finger on the sensor). The
+ * function returns -1 if the context has no touch detection.
+ */
+int AD013_SubmitSleep(AD013_Sensor   * sensor,
+                      AD013_Callback   callback = NULL,
+                      void           * ctx      = NULL);
+
+
+/*! \brief Wakes the sensor up without a capture
+ * 
+ * Use it before the flows that do not wait for a finger (e.g., a
+ * template upload). The password is sent at the cached speed until
+ * the sensor answers or the timeout expires. The result is '1' once
+ * the link is ready (AD013_TIMEOUT otherwise).
+ */
+int AD013_SubmitWake(AD013_Sensor   * sensor,
+                     int              timeOut  = AD013_WAKE_TIMEOUT,
+                     AD013_Callback   callback = NULL,
+                     void           * ctx      = NULL);
+
+
+/*! \brief Returns the wake-to-ready latency (ms) of the last wake up
+ * 
+ * From the touch (or the AD013_SubmitWake() call) to the first
+ * reply from the sensor. The touch to first capture time is then
+ * AD013_CaptureLatency().
+ */
+unsigned long AD013_WakeLatency(void);
+
+
+/*! \brief Initializes an empty sensor pool
+ */
+void AD013_PoolInit(AD013_Pool * pool);
+
+
+/*! \brief Adds a sensor to the pool
+ * 
+ * The context is initialized on the Stream with the devId (NULL for
+ * the default one) and the known speed (0 if not known). The sensor
+ * uses the link record and template index slot of its index.
+ * 
+ * The function returns the sensor index or -1 if the pool is full.
+ */
+int AD013_PoolAdd(AD013_Pool * pool,
+                  Stream     & SensorCom,
+                  const char * devId = NULL,
+                  long         baud  = 0);
+
+
+/*! \brief Returns the context of a pooled sensor (NULL if none)
+ * 
+ * Use it to submit any operation with AD013_PoolCallback() and the
+ * pool as the callback context, the result is then queued as an
+ * event.
+ */
+AD013_Sensor * AD013_PoolSensor(AD013_Pool * pool, int idx);
+
+
+/*! \brief Completion callback queuing the result as a pool event
+ */
+void AD013_PoolCallback(AD013_Sensor * sensor, int result, void * ctx);
+
+
+/*! \brief Keeps an identify flow armed on every pooled sensor
+ * 
+ * Each idle sensor is re-armed as soon as its previous flow ends,
+ * so a finger on any sensor is captured right away (use the touch
+ * outputs, see AD013_SetTouchPin(), to keep the UARTs quiet). Only
+ * the identifications (match or not) are queued, the flows that end
+ * without a finger are re-armed silently. Use AD013_PoolStop() to
+ * stop re-arming.
+ */
+int AD013_PoolIdentifyAll(AD013_Pool * pool,
+                          int          timeOut    = 5000,
+                          int          threashold = 50);
+
+
+/*! \brief Stops re-arming the continuous identify flows
+ */
+void AD013_PoolStop(AD013_Pool * pool);
+
+
+/*! \brief Advances all the pooled sensors
+ * 
+ * Call this function from the main loop. Each sensor is polled once
+ * (round-robin, never blocks) and the idle ones are re-armed. The
+ * function returns the number of busy sensors.
+ */
+int AD013_PoolPoll(AD013_Pool * pool);
+
+
+/*! \brief Pops the oldest pool event
+ * 
+ * Returns 1 if an event was copied into ev and 0 if the queue is
+ * empty.
+ */
+int AD013_PoolNextEvent(AD013_Pool * pool, AD013_PoolEvent * ev);
+
 
 /*! \brief Establishes a connection with the sensor
  * 
@@ -20,7 +1148,9 @@ typedef struct params_st {
  * Use '-1' for the serSpeed for looking for the
  * configured speed for the sensor. The default value
  * is 57600, however with SoftwareSerial the library
- * does not seem to support more than 19200 baud.
+ * does not seem to support more than 19200 baud. The
+ * last-good speed (see AD013_SetStorage()) is tried
+ * first, use AD013_DiscoveryTime() for the time spent.
  * 
  * For HardwareSerial use, speeds have been successfully
  * tested up to 115200 baud.
@@ -32,52 +1162,284 @@ typedef struct params_st {
  * Serial (if it exists). If none exist, an error code is
  * returned.
  * 
+ * The speed of the Stream is set by the baud hook, the
+ * function returns -1 if none is set (see AD013_SetBaudHook()).
+ * 
  * This function returns '1' if the sensor has been found
  * and the password was correctly verified. The function
- * returns negative values for error conditions.
+ * returns negative values for error conditions (AD013_TIMEOUT
+ * when the sensor did not reply).
  * 
  */
 int AD013_FindSensor(Stream     & mySerial,
-                   int          serSpeed = -1,
+                   long         serSpeed = -1,
                    AD013_Params * params   = NULL);
 
 
+/*! \brief Upgrades the link to a faster speed
+ * 
+ * Use this function after AD013_FindSensor() to move the sensor
+ * (and the Stream) to the targetBaud speed (opt-in). Bulk transfers
+ * (templates and images) benefit the most from the faster link.
+ * 
+ * The current speed, device ID and password are taken from the
+ * last-good link record. The function returns '1' if the link runs at the
+ * new speed and negative values if the link has been rolled back
+ * or lost (AD013_TIMEOUT if no reply came, see
+ * AD013_SubmitUpgradeBaud()).
+ */
+int AD013_UpgradeBaud(Stream & SensorCom,
+                      long     targetBaud = 115200);
+
+
 /*
  * !\brief Searches for a Match in the Fingerprint Database
  * 
  * This function searches for a match in the Fingerprint Database and
- * returned the matched template. This function returns '-1' if no
- * templates were matched.
+ * returns the ID of the matched template. This function returns
+ * AD013_TIMEOUT if no finger was captured within timeOut (or the
+ * sensor stopped replying), and '-1' if no template was matched or
+ * any other error occurs.
+ * 
+ * This function blocks until the identify flow completes, use the
+ * AD013_SubmitIdentify() and AD013_Poll() functions to keep the
+ * main loop running while the sensor captures and matches.
  * 
  * The default timeout is 5000 ms.
  * 
- * The default threashold is 65.
+ * The default threashold is 50. The threashold is applied on the
+ * host: matches with a lower score are rejected (status is
+ * AD013_CODE_FINGER_NOT_FOUND), but the sensor's best candidate
+ * and its score are still reported in the result.
  * 
- * The default SerialPort is (Serial1) if present, or (Serial) if present.
+ * When provided, the result is filled with the status, the matched
+ * template ID, the score, the capture quality and the elapsed time.
  * 
  * The default for SecurityOfficerOnly is (false). Use True to limit the
  * matching operations to the first twenty (0-19) Templates ID (usually
  * reserved for the Security Officer).
  * 
+ * The DB is searched in tiers, recently matched templates first (see
+ * AD013_SetSearchTiers()), and the search stops at the first match.
+ * 
  */
-int AD013_SearchTemplate (int      timeOut             = 5000,
+int AD013_SearchTemplate (Stream & SerialPort,
+                        int      timeOut             = 5000,
                         int      threashold          = 50,
-                        Stream * SerialPort          = NULL,
-                        bool     SecurityOfficerOnly = false);
+                        bool     SecurityOfficerOnly = false,
+                        AD013_SearchResult * result  = NULL);
 
 
-/* !\brief Clears one template from the fingerprint DB
+/*
+ * !\brief Searches for a Match using the sensor's auto-identify mode
+ * 
+ * Same as AD013_SearchTemplate(), but the whole capture and search
+ * is a single command on the sensor (see AD013_SubmitAutoIdentify()).
+ * The function returns the ID of the matched template, AD013_TIMEOUT
+ * if the sensor did not reply in time, or '-1', and fills the result
+ * (if provided).
+ */
+int AD013_AutoIdentify(Stream & SerialPort,
+                       int      timeOut       = 5000,
+                       int      securityLevel = 3,
+                       AD013_SearchResult * result = NULL);
+
+
+/*
+ * !\brief Verifies a finger against a claimed template (1:1)
+ * 
+ * Blocking version of AD013_SubmitVerify(). The function returns the
+ * claimedId if the finger matches, AD013_TIMEOUT if no finger was
+ * captured within timeOut (or the sensor stopped replying) and '-1'
+ * otherwise, and fills the result (if provided).
+ */
+int AD013_Verify(Stream & SerialPort,
+                 int      claimedId,
+                 int      timeOut    = 5000,
+                 int      threashold = 50,
+                 AD013_SearchResult * result = NULL);
+
+
+/*! \brief Loads the template index from the sensor
+ * 
+ * Blocking version of AD013_SubmitLoadIndex() for the default
+ * link slot (0). The function returns '1' on success, AD013_TIMEOUT
+ * if the sensor did not reply in time and -1 otherwise.
+ */
+int AD013_LoadIndex(Stream & SerialPort);
+
+
+/*! \brief Uploads a template from the sensor to the host
+ * 
+ * Blocking version of AD013_SubmitUploadTemplate(). The function
+ * returns the number of bytes passed to the sink, AD013_TIMEOUT if
+ * the sensor did not reply in time, or -1 if any other error occurs.
+ */
+int AD013_UploadTemplate(Stream         & SerialPort,
+                         int              templateId,
+                         AD013_DataSink   sink,
+                         void           * sinkCtx = NULL);
+
+
+/*! \brief Downloads a template from the host to the sensor
+ * 
+ * Blocking version of AD013_SubmitDownloadTemplate(). The function
+ * returns the number of bytes sent, AD013_TIMEOUT if the sensor did
+ * not reply in time, or -1 if any other error occurs.
+ */
+int AD013_DownloadTemplate(Stream           & SerialPort,
+                           int                templateId,
+                           long               size,
+                           AD013_DataSource   source,
+                           void             * sourceCtx = NULL);
+
+
+/*! \brief Uploads the sensor's image buffer to the host
+ * 
+ * Blocking version of AD013_SubmitUploadImage() with a static ring
+ * of AD013_IMAGE_RING_SIZE bytes. The function returns the number of
+ * bytes passed to the sink, AD013_PARTIAL if some packets were
+ * corrupted (zero-filled, the count is in stats->resyncs),
+ * AD013_TIMEOUT if the sensor did not reply in time, or -1 if any
+ * other error occurs. The stats (if provided) are filled in all cases.
+ */
+int AD013_UploadImage(Stream         & SerialPort,
+                      long             imageSize,
+                      AD013_DataSink   sink,
+                      void           * sinkCtx = NULL,
+                      AD013_TransferStats * stats = NULL);
+
+
+// Backup Statistics
+typedef struct backup_stats_st {
+  int           templates;   // Templates in the container
+  int           skipped;     // Already on the sensor (restore only)
+  unsigned long bytes;       // Template bytes transferred
+  unsigned long elapsed;     // Whole backup/restore (ms)
+} AD013_BackupStats;
+
+/*! \brief Backs up the sensor's template DB into a container
+ * 
+ * The occupied slots (from the template index) are uploaded one at a
+ * time and streamed into the sink with the AD013 container format
+ * (big endian):
+ * 
+ *   Header  : "AD13", Version (3), Flags (1), Template Count (2)
+ *   Index   : Template ID (2), Size (2), Hash (4), one per record
+ *   Record  : Template ID (2), Chunks, End (2, zero), Size (2), Hash (4)
+ *   Chunk   : Length (2), Template Data (one data packet)
+ *   Trailer : Checksum (4) of the header, the index and all the records
+ * 
+ * Hashes and checksum are FNV-1a (32 bits). The templates go to the
+ * sink packet by packet, so they are never held in RAM. The index
+ * comes first, so a template whose hash is not known on the host
+ * yet (see AD013_HASH_CACHE) is read twice: once for the index and
+ * once for its record. The function returns the number of templates
+ * saved, AD013_TIMEOUT if the sensor did not reply in time, or -1 if
+ * any other error occurs.
+ */
+int AD013_BackupDB(Stream            & SerialPort,
+                   AD013_DataSink      sink,
+                   void              * sinkCtx = NULL,
+                   AD013_BackupStats * stats   = NULL);
+
+/*! \brief Restores a template DB backup into the sensor
+ * 
+ * The index is read first and compared with the templates already in
+ * their slots: a record that is already there is skipped (read from
+ * the source and checked, but not sent to the sensor). The hashes of
+ * the templates saved or restored on this host are kept per link slot
+ * (AD013_HASH_CACHE, until the slot or the index changes), so those
+ * slots cost no transfer at all. Others are uploaded once for their
+ * hash, still less than a download and PS_StoreChar.
+ * 
+ * The other records are downloaded into their slots as they come. A
+ * record whose data does not match its size and hash is not stored.
+ * 
+ * The stream is read once: a corrupted record (or a bad checksum at
+ * the end) stops the restore with the records before it already
+ * stored. Restoring the same backup again skips them.
+ * 
+ * The function returns the number of templates restored (skipped ones
+ * included), AD013_TIMEOUT if the sensor did not reply in time, or -1
+ * if any other error occurs (including a bad checksum).
+ */
+int AD013_RestoreDB(Stream            & SerialPort,
+                    AD013_DataSource    source,
+                    void              * sourceCtx = NULL,
+                    AD013_BackupStats * stats     = NULL);
+
+
+#if defined(__linux__)
+
+// Memory-Mapped File Sink (host builds)
+typedef struct mmap_sink_st {
+  int      fd;
+  byte   * map;
+  size_t   size;     // Mapped size (max bytes)
+  size_t   pos;      // Bytes written
+} AD013_MmapSink;
+
+/*! \brief Opens a memory-mapped file to be used as a data sink
+ * 
+ * The file is mapped with maxSize bytes, use AD013_MmapSinkWrite()
+ * as the sink and the AD013_MmapSink as its context. Returns 1 on
+ * success and -1 otherwise.
+ */
+int AD013_MmapSinkOpen(AD013_MmapSink * sink, const char * path, size_t maxSize);
+
+/*! \brief Data sink writing into the memory-mapped file */
+int AD013_MmapSinkWrite(void * ctx, const byte * data, int size);
+
+/*! \brief Unmaps the file and truncates it to the bytes written */
+int AD013_MmapSinkClose(AD013_MmapSink * sink);
+
+// Memory-Mapped File Source (host builds)
+typedef struct mmap_source_st {
+  int      fd;
+  byte   * map;
+  size_t   size;     // File size
+  size_t   pos;      // Bytes read
+} AD013_MmapSource;
+
+/*! \brief Maps a file to be used as a data source
+ * 
+ * Use AD013_MmapSourceRead() as the source and the AD013_MmapSource
+ * as its context. Returns 1 on success and -1 otherwise.
+ */
+int AD013_MmapSourceOpen(AD013_MmapSource * source, const char * path);
+
+/*! \brief Data source reading from the memory-mapped file */
+int AD013_MmapSourceRead(void * ctx, byte * data, int size);
+
+/*! \brief Unmaps the file */
+int AD013_MmapSourceClose(AD013_MmapSource * source);
+
+#endif
+
+
+/* !\brief Clears a range of templates from the fingerprint DB
  *  
- * Use this function to remove a single template. The templateNumber parameter
- * provides the number of the template to be removed (0-39).
+ * Use this function to remove the templates from startTemplateNumber to
+ * endTemplateNumber (both included, 0-99). The template index is loaded
+ * first if needed (one PS_ReadIndexTable), so that an empty range sends
+ * nothing and a range holding all the stored templates goes with one
+ * PS_Empty (see AD013_SubmitClear()). If the index cannot be read the
+ * whole range goes out as one PS_DeletChar.
  * 
  * The default SerialPort is (Serial1) if present, or (Serial) if present.
  * 
- * The function returns 1 in case of success and -1 if any error occurs.
+ * The framesSent (if provided) is set to the number of command frames
+ * sent to the sensor, the index load included (0 if the range is known
+ * to be empty).
+ * 
+ * The function returns 1 in case of success, AD013_TIMEOUT if the
+ * sensor did not reply in time, and -1 if any other error occurs.
  */
 int AD013_ClearTemplates(Stream & SerialPort,
 	                   int      startTemplateNumber =  0,
-	                   int      endTemplateNumber   = 99);
+	                   int      endTemplateNumber   = AD013_MAX_TEMPLATES - 1,
+	                   int    * framesSent          = NULL);
                       
 /* !\brief Clears all user templates from the fingerprint DB
  *  
@@ -86,9 +1448,9 @@ int AD013_ClearTemplates(Stream & SerialPort,
  * 
  * The default SerialPort is (Serial1) if present, or (Serial) if present.
  * 
- * The function returns 1 in case of success and -1 if any error occurs.
+ * The function returns the same values as AD013_ClearTemplates().
  */
-int AD013_ClearUserTemplates(Stream & SerialPort);
+int AD013_ClearUserTemplates(Stream & SerialPort, int * framesSent = NULL);
 
 /* !\brief Clears all the Security Officer (SO) templates from the fingerprint DB
  *  
@@ -97,20 +1459,28 @@ int AD013_ClearUserTemplates(Stream & SerialPort);
  * 
  * The default SerialPort is (Serial1) if present, or (Serial) if present.
  * 
- * The function returns 1 in case of success and -1 if any error occurs.
+ * The function returns the same values as AD013_ClearTemplates().
  */
-int AD013_ClearSecurityOfficerTemplates(Stream & SerialPort);
+int AD013_ClearSOTemplates(Stream & SerialPort, int * framesSent = NULL);
 
 
 /* !\brief Enrolls a new Finger in the Sensor's DB
  *  
  * Use this function to generate and store a new Template (5 different chars
- * compose a single Template; The AD-013 can store up to 40 Templates).
+ * compose a single Template; The AD-013 can store up to 100 Templates).
+ * See AD013_SubmitEnroll() for the captures and the duplicate check.
  * 
  * The function returns the ID of the storage buffer where the new Template
- * has successfully been saved. In case of errors, the function returns -1.
+ * has successfully been saved. The function returns AD013_TIMEOUT if a
+ * capture did not happen within timeOut (or the sensor stopped replying),
+ * and -1 in case of other errors.
+ * The result (if provided) reports the status, the retries and the time
+ * spent.
  *
  */
-int AD013_Enroll(Stream & SerialPort, bool isSecurityOfficer);
+int AD013_Enroll(Stream & SerialPort,
+                 bool     isSecurityOfficer,
+                 int      timeOut = 20000,
+                 AD013_EnrollResult * result = NULL);
 
 #endif // AD013_FINGERPRINT_SENSOR_HEADER
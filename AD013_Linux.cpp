@@ -0,0 +1,212 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library         
+//   (c) 2020 by Massimiliano Pala and CableLabs   
+//   All Rights Reserved                           
+//                                                 
+// Linux (termios) Transport                       
+// ================================================
+
+#if defined(__linux__)
+
+// Local Include
+#include "AD013_Linux.h"
+
+// POSIX Serial and Event APIs
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+// Write Timeout when the tty buffer is full (ms)
+#define AD013_LINUX_WRITE_TIMEOUT  AD013_DEFAULT_TIMEOUT
+
+                        // =========================
+                        // Linux Transport Functions
+                        // =========================
+
+static speed_t AD013_LinuxSpeed(long baud) {
+
+  switch (baud) {
+    case   9600: return B9600;
+    case  19200: return B19200;
+    case  38400: return B38400;
+    case  57600: return B57600;
+    case 115200: return B115200;
+#ifdef B230400
+    case 230400: return B230400;
+#endif
+    default: return B0;
+  }
+}
+
+AD013_LinuxSerial::AD013_LinuxSerial() : _fd(-1), _rxPos(0), _rxLen(0) { }
+
+AD013_LinuxSerial::~AD013_LinuxSerial() {
+  close();
+}
+
+int AD013_LinuxSerial::open(const char * path, long baud) {
+
+  struct termios tty;
+
+  if (!path || _fd >= 0 || AD013_LinuxSpeed(baud) == B0)
+    return -1;
+
+  if ((_fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC)) < 0)
+    return -1;
+
+  if (tcgetattr(_fd, &tty) < 0) {
+    close();
+    return -1;
+  }
+
+  // Raw 8N1, no flow control, reads never block
+  cfmakeraw(&tty);
+  tty.c_cflag |= (CLOCAL | CREAD);
+  tty.c_cflag &= ~(CSTOPB | CRTSCTS);
+  tty.c_cc[VMIN] = 0;
+  tty.c_cc[VTIME] = 0;
+
+  if (tcsetattr(_fd, TCSANOW, &tty) < 0) {
+    close();
+    return -1;
+  }
+
+  setBaud(baud);
+  tcflush(_fd, TCIOFLUSH);
+
+  return 1;
+}
+
+void AD013_LinuxSerial::close() {
+  if (_fd >= 0) ::close(_fd);
+  _fd = -1;
+  _rxPos = _rxLen = 0;
+}
+
+int AD013_LinuxSerial::watch(int epollFd, void * data) {
+
+  struct epoll_event ev;
+
+  if (_fd < 0) return -1;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  if (data) ev.data.ptr = data;
+  else ev.data.fd = _fd;
+
+  return epoll_ctl(epollFd, EPOLL_CTL_ADD, _fd, &ev) < 0 ? -1 : 1;
+}
+
+int AD013_LinuxSerial::wait(int timeoutMs) {
+
+  struct pollfd pfd = { _fd, POLLIN, 0 };
+  int ret = 0;
+
+  if (_fd < 0) return -1;
+  if (_rxPos < _rxLen) return 1;
+
+  do {
+    ret = poll(&pfd, 1, timeoutMs);
+  } while (ret < 0 && errno == EINTR);
+
+  return ret < 0 ? -1 : (ret > 0 ? 1 : 0);
+}
+
+void AD013_LinuxSerial::setBaud(long baud) {
+
+  struct termios tty;
+  speed_t speed = AD013_LinuxSpeed(baud);
+
+  if (_fd < 0 || speed == B0 || tcgetattr(_fd, &tty) < 0)
+    return;
+
+  // Pending output goes at the old speed
+  tcdrain(_fd);
+
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+  tcsetattr(_fd, TCSANOW, &tty);
+
+  // Bytes received at the old speed are garbage
+  tcflush(_fd, TCIFLUSH);
+  _rxPos = _rxLen = 0;
+}
+
+int AD013_LinuxSerial::fill() {
+
+  ssize_t ret = 0;
+
+  if (_rxPos < _rxLen) return _rxLen - _rxPos;
+  if (_fd < 0) return 0;
+
+  do {
+    ret = ::read(_fd, _rx, sizeof(_rx));
+  } while (ret < 0 && errno == EINTR);
+
+  _rxPos = 0;
+  _rxLen = ret > 0 ? (int) ret : 0;
+
+  return _rxLen;
+}
+
+int AD013_LinuxSerial::available() {
+
+  int pending = 0;
+
+  if (_fd < 0) return 0;
+
+  // Buffered bytes first, then the tty queue
+  if (_rxPos < _rxLen) return _rxLen - _rxPos;
+  if (ioctl(_fd, FIONREAD, &pending) < 0) pending = 0;
+
+  return pending;
+}
+
+int AD013_LinuxSerial::read() {
+  if (fill() <= 0) return -1;
+  return _rx[_rxPos++];
+}
+
+int AD013_LinuxSerial::peek() {
+  if (fill() <= 0) return -1;
+  return _rx[_rxPos];
+}
+
+void AD013_LinuxSerial::flush() {
+  if (_fd >= 0) tcdrain(_fd);
+}
+
+size_t AD013_LinuxSerial::write(uint8_t val) {
+  return write(&val, 1);
+}
+
+size_t AD013_LinuxSerial::write(const uint8_t * buff, size_t size) {
+
+  size_t count = 0;
+  struct pollfd pfd = { _fd, POLLOUT, 0 };
+
+  if (_fd < 0) return 0;
+
+  while (count < size) {
+    ssize_t ret = ::write(_fd, buff + count, size - count);
+    if (ret > 0) {
+      count += ret;
+    } else if (ret < 0 && errno == EINTR) {
+      continue;
+    } else if (ret < 0 && errno == EAGAIN) {
+      // Output queue full, waits for room
+      if (poll(&pfd, 1, AD013_LINUX_WRITE_TIMEOUT) <= 0) break;
+    } else {
+      break;
+    }
+  }
+
+  return count;
+}
+
+#endif // __linux__
@@ -0,0 +1,79 @@
+#ifndef AD013_LINUX_TRANSPORT_HEADER
+#define AD013_LINUX_TRANSPORT_HEADER
+
+// Linux (termios) Transport for USB-UART attached sensors. The
+// file compiles to nothing on the other platforms
+#if defined(__linux__)
+
+#include "AD013.h"
+
+// Read Buffer (bytes pulled from the tty per read call)
+#ifndef AD013_LINUX_RX_SIZE
+#define AD013_LINUX_RX_SIZE       64
+#endif
+
+// Native Serial Port (non-blocking, raw 8N1)
+//
+// The port implements the Stream surface used by the library and
+// never blocks on reads. Register its file descriptor with epoll
+// (see watch()) and call AD013_Poll() when it becomes readable or
+// when the next timeout is due. Set AD013_PortBaudHook() as the
+// baud hook so the speed scan and upgrade reach the tty.
+class AD013_LinuxSerial : public AD013_Port {
+
+  public:
+    AD013_LinuxSerial();
+    ~AD013_LinuxSerial();
+
+    /*! \brief Opens the tty (e.g. /dev/ttyUSB0) at the given speed
+     *
+     * Returns 1 on success and -1 otherwise (unsupported speed
+     * included).
+     */
+    int open(const char * path, long baud = 57600);
+
+    /*! \brief Closes the tty */
+    void close();
+
+    /*! \brief Returns the file descriptor (-1 if not open) */
+    int fd() const { return _fd; }
+
+    /*! \brief Adds the port to an epoll set (EPOLLIN)
+     *
+     * The data is stored in the event (e.g. the sensor context).
+     * Returns 1 on success and -1 otherwise.
+     */
+    int watch(int epollFd, void * data = NULL);
+
+    /*! \brief Waits until the port is readable (or timeoutMs)
+     *
+     * Returns 1 if data is available, 0 on timeout and -1 on
+     * errors.
+     */
+    int wait(int timeoutMs);
+
+    // Speed Control (termios)
+    void setBaud(long baud);
+    void begin(long baud) { setBaud(baud); }
+
+    // Stream Interface
+    int available();
+    int read();
+    int peek();
+    void flush();
+    size_t write(uint8_t val);
+    size_t write(const uint8_t * buff, size_t size);
+    using Print::write;
+
+  private:
+    int  fill();
+
+    int  _fd;
+    byte _rx[AD013_LINUX_RX_SIZE];
+    int  _rxPos;
+    int  _rxLen;
+};
+
+#endif // __linux__
+
+#endif // AD013_LINUX_TRANSPORT_HEADER
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+#
+# AD013 Trace Decoder
+#   (c) 2020 by Massimiliano Pala and CableLabs
+#   All Rights Reserved
+#
+# Decodes the binary trace ring written by AD013_TraceDump() (library
+# built with -DAD013_TRACE). The input can be a raw capture of the
+# debug port: the dump is found by its "ADTR" marker.
+#
+#   usage: ad013_trace.py capture.bin
+#
+
+import struct
+import sys
+
+FLAGS = {0x01: "CMD", 0x02: "DATA", 0x07: "ACK", 0x08: "END"}
+ERRORS = {1: "timeout", 2: "bad sum", 3: "bad devid"}
+
+
+def frame_text(data, size):
+    text = " ".join("%02X" % b for b in data)
+    if size > len(data):
+        text += " ... (%d bytes)" % size
+    return text
+
+
+def decode(blob):
+    at = blob.find(b"ADTR")
+    if at < 0:
+        raise ValueError("no trace dump found")
+
+    version, max_data, dropped, length = struct.unpack_from(">BBIH", blob, at + 4)
+    if version != 1:
+        raise ValueError("unsupported trace version %d" % version)
+
+    pos = at + 12
+    end = pos + length
+    if end > len(blob):
+        raise ValueError("truncated trace dump")
+
+    print("# %d records dropped, %d bytes kept per frame" % (dropped, max_data))
+
+    first = None
+    while pos < end:
+        kind, aux, size, stamp = struct.unpack_from(">BBHI", blob, pos)
+        pos += 8
+        data = blob[pos:pos + min(size, max_data)]
+        pos += len(data)
+
+        if first is None:
+            first = stamp
+        ms = ((stamp - first) & 0xFFFFFFFF) / 1000.0
+
+        kind = chr(kind)
+        if kind == "T":
+            what = "TX"
+            if len(data) > 9:
+                what += " %-4s" % FLAGS.get(data[6], "%02X" % data[6])
+        elif kind == "R":
+            what = "RX %-4s" % FLAGS.get(aux, "%02X" % aux)
+        elif kind == "E":
+            what = "ERR %s" % ERRORS.get(aux, aux)
+        else:
+            raise ValueError("bad record type at offset %d" % (pos - 8))
+
+        print("%10.3f ms  %-14s %s" % (ms, what, frame_text(data, size)))
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write("usage: %s capture.bin\n" % sys.argv[0])
+        return 2
+    with open(sys.argv[1], "rb") as f:
+        decode(f.read())
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
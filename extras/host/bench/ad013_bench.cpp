@@ -0,0 +1,838 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Host Build - Latency and Throughput Benchmarks
+// ================================================
+
+// The library runs against the simulator on the virtual clock, so the
+// numbers are the protocol and line costs (plus the model processing
+// times of the simulator) and do not depend on the host machine.
+//
+//   ad013_bench [--quick] [scenario ...]
+//
+// With no scenario all of them run. --quick runs a few iterations
+// each (smoke test).
+
+#include "AD013.h"
+#include "AD013_Host.h"
+#include "AD013_Sim.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+static int AD013_benchRuns = 200;
+
+static const long AD013_benchBauds[] = { 115200, 57600, 38400, 19200, 9600 };
+#define AD013_BENCH_BAUDS  (int)(sizeof(AD013_benchBauds) / sizeof(AD013_benchBauds[0]))
+
+                        // =======
+                        // Helpers
+                        // =======
+
+// Link Records in RAM
+static AD013_Link AD013_benchLinks[AD013_MAX_POOL_SENSORS];
+
+static int AD013_BenchStorageRead(int slot, void * data, int size) {
+  if (slot < 0 || slot >= AD013_MAX_POOL_SENSORS) return 0;
+  memcpy(data, &AD013_benchLinks[slot], size);
+  return size;
+}
+
+static int AD013_BenchStorageWrite(int slot, const void * data, int size) {
+  if (slot < 0 || slot >= AD013_MAX_POOL_SENSORS) return 0;
+  memcpy(&AD013_benchLinks[slot], data, size);
+  return size;
+}
+
+static void AD013_BenchReset(void) {
+  AD013_HostReset();
+  memset(AD013_benchLinks, 0, sizeof(AD013_benchLinks));
+  AD013_SetStorage(AD013_BenchStorageRead, AD013_BenchStorageWrite);
+  AD013_SetDefaultPolicy(NULL);
+  AD013_SetBaudHook(AD013_SoftSerialBaudHook);
+  AD013_ResetMetrics();
+  AD013_ResetSearchStats();
+}
+
+static int AD013_BenchRun(AD013_Sensor * sensor) {
+  while (AD013_Poll(sensor) == AD013_ASYNC_BUSY);
+  return sensor->result;
+}
+
+// Latency Samples (us)
+struct AD013_BenchSamples {
+  std::vector<unsigned long long> us;
+  unsigned long long bytes;
+  int failed;
+
+  AD013_BenchSamples() : bytes(0), failed(0) { }
+
+  void add(unsigned long long t) { us.push_back(t); }
+
+  double pct(double p) {
+    if (us.empty()) return 0;
+    std::sort(us.begin(), us.end());
+    size_t idx = (size_t)(p / 100.0 * (us.size() - 1) + 0.5);
+    return us[idx] / 1000.0;
+  }
+
+  double total() const {
+    unsigned long long t = 0;
+    for (size_t i = 0; i < us.size(); i++) t += us[i];
+    return t / 1000.0;
+  }
+
+  // Bytes on the line (both ways) per second of operation time
+  double rate() const {
+    double ms = total();
+    return ms > 0 ? bytes * 1000.0 / ms : 0;
+  }
+};
+
+static void AD013_BenchHeader(const char * title) {
+  printf("\n%s\n", title);
+  printf("  %-22s %7s %9s %9s %9s %10s\n", "case", "baud", "p50 ms", "p90 ms", "p99 ms", "bytes/s");
+}
+
+static void AD013_BenchLine(const char * name, long baud, AD013_BenchSamples & s) {
+  printf("  %-22s %7ld %9.2f %9.2f %9.2f %10.0f", name, baud,
+         s.pct(50), s.pct(90), s.pct(99), s.rate());
+  if (s.failed) printf("  (%d failed)", s.failed);
+  printf("\n");
+}
+
+                        // ==================
+                        // Scenario: link
+                        // ==================
+
+// Commands timed one by one (params as sent by the flows)
+typedef struct bench_cmd_st {
+  const char * name;
+  uint8_t      code;
+  uint8_t      size;
+  char         params[5];
+} AD013_BenchCmd;
+
+static const AD013_BenchCmd AD013_benchCmds[] = {
+  { "VerifyPwd (0x13)",      0x13, 4, { 0, 0, 0, 0 } },
+  { "GetImage (0x01)",       0x01, 0, { 0 } },
+  { "GenChar (0x02)",        0x02, 1, { 1 } },
+  { "Search (0x04)",         0x04, 5, { 1, 0, 0, 0, 50 } },
+  { "ReadIndexTable (0x1F)", 0x1F, 1, { 0 } },
+};
+#define AD013_BENCH_CMDS  (int)(sizeof(AD013_benchCmds) / sizeof(AD013_benchCmds[0]))
+
+// Per-command latency, discovery (full scan) and identify at each speed
+static void AD013_BenchLink(void) {
+
+  AD013_BenchHeader("link: per-operation latency and line throughput");
+
+  for (int b = 0; b < AD013_BENCH_BAUDS; b++) {
+
+    long baud = AD013_benchBauds[b];
+    AD013_BenchSamples cmd[AD013_BENCH_CMDS], find, search;
+
+    AD013_BenchReset();
+
+    // Single commands, in flow order (finger on, 50 templates)
+    {
+      AD013_Sim sim(baud);
+      AD013_Sensor sensor;
+
+      AD013_SensorInit(&sensor, sim);
+      sensor.baud = baud;
+      for (int id = 0; id < 50; id++) sim.store(id, 1000 + id);
+      sim.place(1020);
+
+      for (int i = 0; i < AD013_benchRuns; i++) {
+        for (int c = 0; c < AD013_BENCH_CMDS; c++) {
+          const AD013_BenchCmd * bc = &AD013_benchCmds[c];
+          AD013_Params params;
+          unsigned long long t0 = AD013_HostNow(), b0 = sim.rxBytes + sim.txBytes;
+
+          memset(&params, 0, sizeof(params));
+          memcpy(params.buff, bc->params, bc->size);
+          memset(params.devId, 0xFF, sizeof(params.devId));
+          params.size = bc->size;
+
+          AD013_SubmitCommand(&sensor, bc->code, &params);
+          if (AD013_BenchRun(&sensor) != 0) cmd[c].failed++;
+          cmd[c].add(AD013_HostNow() - t0);
+          cmd[c].bytes += sim.rxBytes + sim.txBytes - b0;
+        }
+      }
+    }
+
+    // Discovery (no link record: full scan from 115200 down)
+    for (int i = 0; i < AD013_benchRuns / 10 + 1; i++) {
+      AD013_Sim sim(baud);
+      AD013_BenchReset();
+      unsigned long long t0 = AD013_HostNow();
+      if (AD013_FindSensor(sim) != 1) find.failed++;
+      find.add(AD013_HostNow() - t0);
+      find.bytes += sim.rxBytes + sim.txBytes;
+    }
+
+    // Identify (finger on, 50 templates, match in the users' range).
+    // Every run is a full capture and search (no recent match)
+    {
+      AD013_Sim sim(baud);
+      AD013_BenchReset();
+      AD013_SetMatchCacheTTL(0);
+      for (int id = 0; id < 50; id++) sim.store(id, 1000 + id);
+      for (int i = 0; i < AD013_benchRuns / 4 + 1; i++) {
+        AD013_SearchResult res;
+        unsigned long long t0 = AD013_HostNow(), b0 = sim.rxBytes + sim.txBytes;
+        int id = 20 + (i * 7) % 30;
+        sim.place(1000 + id);
+        if (AD013_SearchTemplate(sim, 5000, 50, false, &res) != id) search.failed++;
+        search.add(AD013_HostNow() - t0);
+        search.bytes += sim.rxBytes + sim.txBytes - b0;
+        sim.lift();
+        AD013_HostAdvance(500000);
+      }
+      AD013_SetMatchCacheTTL(AD013_MATCH_CACHE_TTL);
+    }
+
+    for (int c = 0; c < AD013_BENCH_CMDS; c++) AD013_BenchLine(AD013_benchCmds[c].name, baud, cmd[c]);
+    AD013_BenchLine("FindSensor (scan)", baud, find);
+    AD013_BenchLine("SearchTemplate", baud, search);
+  }
+}
+
+                        // ==================
+                        // Scenario: faults
+                        // ==================
+
+// Identify under the transaction policy with one injected fault per
+// run (bad sum, short, silent or late reply on a random step of the
+// flow): worst-case latency against the deadline
+static void AD013_BenchFaults(void) {
+
+  static const int codes[] = { 0x01, 0x02, 0x04 };
+  static const char * kinds[] = { "none", "bad sum", "short", "silent", "late" };
+  AD013_Policy policy = { 500, 250, 2, 10 };
+
+  printf("\nfaults: identify with one injected fault, deadline %lu ms\n", policy.deadline);
+  printf("  %-22s %7s %9s %9s %9s %9s %6s\n", "fault", "baud", "p50 ms", "p99 ms", "max ms",
+         "deadline", "found");
+
+  for (int kind = 0; kind <= AD013_SIM_FAULT_DELAY; kind++) {
+
+    AD013_BenchSamples s;
+    AD013_Sim sim(57600);
+    AD013_Sensor sensor;
+    unsigned long seed = 7;
+    int ok = 0;
+
+    AD013_BenchReset();
+    AD013_SetMatchCacheTTL(0);
+    AD013_SetDefaultPolicy(&policy);
+    for (int id = 0; id < 50; id++) sim.store(id, 1000 + id);
+    AD013_SensorInit(&sensor, sim);
+    sensor.baud = sim.baud;
+
+    for (int i = 0; i < AD013_benchRuns / 4 + 1; i++) {
+      seed = seed * 1103515245UL + 12345UL;
+      int id = (int)((seed >> 8) % 50);
+      if (kind) sim.fault(kind, 1, codes[(seed >> 4) % 3], 100000 + (seed >> 12) % 300000);
+      sim.place(1000 + id);
+
+      unsigned long long t0 = AD013_HostNow();
+      AD013_SubmitIdentify(&sensor, 5000);
+      if (AD013_BenchRun(&sensor) == id) ok++;
+      else s.failed++;
+      s.add(AD013_HostNow() - t0);
+
+      sim.clearFaults();
+      sim.lift();
+      AD013_HostAdvance(500000);
+    }
+
+    // Deadline checked on millis() (1 ms resolution)
+    printf("  %-22s %7ld %9.2f %9.2f %9.2f %9s %6d\n", kinds[kind], sim.baud,
+           s.pct(50), s.pct(99), s.pct(100),
+           s.pct(100) <= policy.deadline + 1 ? "met" : "MISSED", ok);
+
+    AD013_SetDefaultPolicy(NULL);
+    AD013_SetMatchCacheTTL(AD013_MATCH_CACHE_TTL);
+  }
+}
+
+                        // ==================
+                        // Scenario: backup
+                        // ==================
+
+// Container in RAM
+struct AD013_BenchContainer {
+  std::vector<uint8_t> data;
+  size_t               pos;
+
+  AD013_BenchContainer() : pos(0) { }
+};
+
+static int AD013_BenchContainerWrite(void * ctx, const byte * data, int size) {
+  AD013_BenchContainer * c = (AD013_BenchContainer *) ctx;
+  c->data.insert(c->data.end(), data, data + size);
+  return size;
+}
+
+static int AD013_BenchContainerRead(void * ctx, byte * data, int size) {
+  AD013_BenchContainer * c = (AD013_BenchContainer *) ctx;
+  int left = (int)(c->data.size() - c->pos);
+  if (size > left) size = left;
+  memcpy(data, &c->data[c->pos], size);
+  c->pos += size;
+  return size;
+}
+
+// Full 100-slot DB: backup, restore into an empty sensor and restore
+// of the same backup (all skipped), with the hashes known on the host
+// and after the index (and its hashes) is dropped
+static void AD013_BenchBackup(void) {
+
+  printf("\nbackup: 100-slot template DB\n");
+  printf("  %-22s %7s %9s %9s %10s %8s\n", "case", "baud", "total ms", "ms/slot", "bytes/s", "skipped");
+
+  for (int b = 0; b < 2; b++) {
+
+    long baud = AD013_benchBauds[b];
+    AD013_Sim src(baud), dst(baud);
+    AD013_BenchContainer c;
+    AD013_BackupStats stats[4];
+    unsigned long long line[4];
+    const char * names[4] = { "BackupDB", "RestoreDB (empty)", "RestoreDB (same)",
+                              "RestoreDB (same, cold)" };
+    int ret[4];
+
+    AD013_Sensor sensor;
+
+    AD013_BenchReset();
+    src.hostBaud = dst.hostBaud = baud;
+    for (int id = 0; id < 100; id++) src.store(id, 2000 + id);
+
+    // Same link slot for all the sensors, nothing known about this one
+    AD013_SensorInit(&sensor, src);
+    AD013_IndexInvalidate(&sensor);
+
+    unsigned long long b0 = src.rxBytes + src.txBytes;
+    ret[0] = AD013_BackupDB(src, AD013_BenchContainerWrite, &c, &stats[0]);
+    line[0] = src.rxBytes + src.txBytes - b0;
+
+    // Same link slot, its template index is read again
+    AD013_SensorInit(&sensor, dst);
+    AD013_IndexInvalidate(&sensor);
+    b0 = dst.rxBytes + dst.txBytes;
+    ret[1] = AD013_RestoreDB(dst, AD013_BenchContainerRead, &c, &stats[1]);
+    line[1] = dst.rxBytes + dst.txBytes - b0;
+
+    c.pos = 0;
+    b0 = dst.rxBytes + dst.txBytes;
+    ret[2] = AD013_RestoreDB(dst, AD013_BenchContainerRead, &c, &stats[2]);
+    line[2] = dst.rxBytes + dst.txBytes - b0;
+
+    c.pos = 0;
+    AD013_IndexInvalidate(&sensor);
+    b0 = dst.rxBytes + dst.txBytes;
+    ret[3] = AD013_RestoreDB(dst, AD013_BenchContainerRead, &c, &stats[3]);
+    line[3] = dst.rxBytes + dst.txBytes - b0;
+
+    for (int i = 0; i < 4; i++) {
+      printf("  %-22s %7ld %9lu %9.1f %10.0f %8d", names[i], baud,
+             stats[i].elapsed, stats[i].elapsed / 100.0,
+             stats[i].elapsed ? line[i] * 1000.0 / stats[i].elapsed : 0.0,
+             stats[i].skipped);
+      if (ret[i] != 100) printf("  (failed: %d)", ret[i]);
+      printf("\n");
+    }
+  }
+}
+
+                        // ==================
+                        // Scenario: upgrade
+                        // ==================
+
+static int AD013_BenchDiscard(void * ctx, const byte * data, int size) {
+  (void) ctx;
+  (void) data;
+  return size;
+}
+
+static int AD013_BenchTemplate(void * ctx, byte * data, int size) {
+  AD013_Sim::templateOf(*(int *) ctx, data, size);
+  return size;
+}
+
+// 512-byte template upload and download, at the discovered speed and
+// after AD013_UpgradeBaud()
+static void AD013_BenchUpgrade(void) {
+
+  static const long from[] = { 9600, 19200, 57600 };
+
+  printf("\nupgrade: 512-byte template transfer before and after AD013_UpgradeBaud()\n");
+  printf("  %-22s %7s %9s %9s %9s\n", "case", "from", "ms", "115200 ms", "speedup");
+
+  for (unsigned int f = 0; f < sizeof(from) / sizeof(from[0]); f++) {
+
+    AD013_Sim sim(from[f]);
+    AD013_BenchSamples up[2], down[2];
+    int finger = 77;
+
+    AD013_BenchReset();
+    sim.templateSize = 512;
+    sim.store(1, finger);
+    if (AD013_FindSensor(sim) != 1) {
+      printf("  discovery failed at %ld\n", from[f]);
+      continue;
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+      if (pass == 1 && AD013_UpgradeBaud(sim, 115200) != 1) {
+        printf("  upgrade failed from %ld\n", from[f]);
+        break;
+      }
+      for (int i = 0; i < AD013_benchRuns / 10 + 1; i++) {
+        unsigned long long t0 = AD013_HostNow();
+        if (AD013_UploadTemplate(sim, 1, AD013_BenchDiscard) != 512) up[pass].failed++;
+        up[pass].add(AD013_HostNow() - t0);
+
+        t0 = AD013_HostNow();
+        if (AD013_DownloadTemplate(sim, 2, 512, AD013_BenchTemplate, &finger) != 512) down[pass].failed++;
+        down[pass].add(AD013_HostNow() - t0);
+      }
+    }
+
+    printf("  %-22s %7ld %9.2f %9.2f %8.2fx\n", "UploadTemplate", from[f],
+           up[0].pct(50), up[1].pct(50), up[1].pct(50) > 0 ? up[0].pct(50) / up[1].pct(50) : 0);
+    printf("  %-22s %7ld %9.2f %9.2f %8.2fx\n", "DownloadTemplate", from[f],
+           down[0].pct(50), down[1].pct(50), down[1].pct(50) > 0 ? down[0].pct(50) / down[1].pct(50) : 0);
+    if (up[0].failed + up[1].failed + down[0].failed + down[1].failed)
+      printf("  (%d failed)\n", up[0].failed + up[1].failed + down[0].failed + down[1].failed);
+  }
+}
+
+                        // ==================
+                        // Scenario: transfer
+                        // ==================
+
+// Template upload/download and image upload payload rates against the
+// line rate (baud / 10 bytes/s, 8N1). Each data packet carries 11
+// bytes of framing, so the best possible is packetSize / (packetSize
+// + 11) of the line
+static void AD013_BenchTransfer(void) {
+
+  static const char * names[] = { "UploadTemplate", "DownloadTemplate", "UploadImage" };
+
+  printf("\ntransfer: payload rate vs line rate (%d-byte data packets, %.1f%% at best)\n",
+         AD013_DEFAULT_PACKET_SIZE, AD013_DEFAULT_PACKET_SIZE * 100.0 / (AD013_DEFAULT_PACKET_SIZE + 11));
+  printf("  %-22s %7s %9s %10s %10s %9s\n", "case", "baud", "bytes", "payload/s", "line/s", "of line");
+
+  for (int b = 0; b < AD013_BENCH_BAUDS; b++) {
+
+    long baud = AD013_benchBauds[b];
+    AD013_Sim sim(baud);
+    AD013_Sensor sensor;
+    AD013_BenchSamples s[3];
+    int finger = 55;
+    long sizes[3];
+
+    AD013_BenchReset();
+    sim.hostBaud = baud;
+    sim.store(1, finger);
+    sim.place(finger);
+    sizes[0] = sizes[1] = sim.templateSize;
+    sizes[2] = sim.imageSize;
+
+    // PS_UpImage sends the last captured image
+    AD013_SensorInit(&sensor, sim);
+    sensor.baud = baud;
+    AD013_SubmitCommand(&sensor, 0x01);
+    if (AD013_BenchRun(&sensor) != 0) printf("  capture failed at %ld\n", baud);
+
+    for (int i = 0; i < AD013_benchRuns / 20 + 1; i++) {
+      int ret[3];
+      unsigned long long t0;
+
+      t0 = AD013_HostNow();
+      ret[0] = AD013_UploadTemplate(sim, 1, AD013_BenchDiscard);
+      s[0].add(AD013_HostNow() - t0);
+
+      t0 = AD013_HostNow();
+      ret[1] = AD013_DownloadTemplate(sim, 2, sizes[1], AD013_BenchTemplate, &finger);
+      s[1].add(AD013_HostNow() - t0);
+
+      t0 = AD013_HostNow();
+      ret[2] = AD013_UploadImage(sim, sizes[2], AD013_BenchDiscard);
+      s[2].add(AD013_HostNow() - t0);
+
+      for (int k = 0; k < 3; k++) {
+        if (ret[k] != sizes[k]) s[k].failed++;
+        else s[k].bytes += sizes[k];
+      }
+    }
+
+    for (int k = 0; k < 3; k++) {
+      printf("  %-22s %7ld %9ld %10.0f %10ld %8.1f%%", names[k], baud, sizes[k],
+             s[k].rate(), baud / 10, s[k].rate() * 100.0 / (baud / 10));
+      if (s[k].failed) printf("  (%d failed)", s[k].failed);
+      printf("\n");
+    }
+  }
+}
+
+                        // ==================
+                        // Scenario: identify
+                        // ==================
+
+// Finger to ID latency: the 3-step flow polled by the host (GetImage
+// until a finger, GenChar, Search) against PS_AutoIdentify (one
+// command, the sensor waits for the finger). The finger lands at a
+// random time after the submit, the latency runs from there to the
+// result
+static void AD013_BenchIdentify(void) {
+
+  printf("\nidentify: finger to ID latency, 3-step vs auto-identify (50 templates)\n");
+  printf("  %-22s %7s %9s %9s %9s %10s\n", "flow", "baud", "p50 ms", "p90 ms", "p99 ms", "frames");
+
+  for (int b = 0; b < AD013_BENCH_BAUDS; b++) {
+
+    long baud = AD013_benchBauds[b];
+    AD013_BenchSamples s[2];
+    unsigned long frames[2] = { 0, 0 };
+    static const char * names[] = { "SearchTemplate", "AutoIdentify" };
+
+    for (int flow = 0; flow < 2; flow++) {
+
+      AD013_Sim sim(baud);
+      unsigned long seed = 11;
+
+      AD013_BenchReset();
+      AD013_SetMatchCacheTTL(0);
+      sim.hostBaud = baud;
+      for (int id = 0; id < 50; id++) sim.store(id, 1000 + id);
+
+      for (int i = 0; i < AD013_benchRuns / 4 + 1; i++) {
+        AD013_SearchResult res;
+        int id = 20 + (i * 7) % 30;
+        unsigned long f0 = sim.calls[0x01] + sim.calls[0x02] + sim.calls[0x04] + sim.calls[0x32];
+        int ret;
+
+        seed = seed * 1103515245UL + 12345UL;
+        unsigned long long at = AD013_HostNow() + 50000 + (seed >> 8) % 500000;
+        sim.placeAt(at, 1000 + id);
+
+        if (flow == 0) ret = AD013_SearchTemplate(sim, 5000, 50, false, &res);
+        else ret = AD013_AutoIdentify(sim, 5000, 3, &res);
+        if (ret != id) s[flow].failed++;
+        s[flow].add(AD013_HostNow() - at);
+
+        frames[flow] += sim.calls[0x01] + sim.calls[0x02] + sim.calls[0x04] + sim.calls[0x32] - f0;
+        sim.lift();
+        AD013_HostAdvance(500000);
+      }
+      AD013_SetMatchCacheTTL(AD013_MATCH_CACHE_TTL);
+    }
+
+    for (int flow = 0; flow < 2; flow++) {
+      printf("  %-22s %7ld %9.2f %9.2f %9.2f %10.1f", names[flow], baud,
+             s[flow].pct(50), s[flow].pct(90), s[flow].pct(99),
+             (double) frames[flow] / s[flow].us.size());
+      if (s[flow].failed) printf("  (%d failed)", s[flow].failed);
+      printf("\n");
+    }
+  }
+}
+
+                        // ==================
+                        // Scenario: verify
+                        // ==================
+
+// 1:1 verify (LoadChar and Match on the claimed ID) against the 1:N
+// search on a full DB (AD013_MAX_TEMPLATES templates), finger already
+// on. The claimed/matched IDs cycle through the whole DB
+static void AD013_BenchVerify(void) {
+
+  printf("\nverify: 1:1 verify vs 1:N search, %d templates\n", AD013_MAX_TEMPLATES);
+  printf("  %-22s %7s %9s %9s %9s %10s\n", "flow", "baud", "p50 ms", "p90 ms", "p99 ms", "bytes/s");
+
+  for (int b = 0; b < AD013_BENCH_BAUDS; b++) {
+
+    long baud = AD013_benchBauds[b];
+    AD013_BenchSamples s[2];
+    static const char * names[] = { "SearchTemplate", "Verify" };
+
+    for (int flow = 0; flow < 2; flow++) {
+
+      AD013_Sim sim(baud);
+
+      AD013_BenchReset();
+      AD013_SetMatchCacheTTL(0);
+      sim.hostBaud = baud;
+      for (int id = 0; id < AD013_MAX_TEMPLATES; id++) sim.store(id, 1000 + id);
+
+      for (int i = 0; i < AD013_benchRuns / 4 + 1; i++) {
+        AD013_SearchResult res;
+        int id = (i * 37) % AD013_MAX_TEMPLATES;
+        unsigned long long t0, b0 = sim.rxBytes + sim.txBytes;
+        int ret;
+
+        sim.place(1000 + id);
+        t0 = AD013_HostNow();
+        if (flow == 0) ret = AD013_SearchTemplate(sim, 5000, 50, false, &res);
+        else ret = AD013_Verify(sim, id, 5000, 50, &res);
+        if (ret != id) s[flow].failed++;
+        s[flow].add(AD013_HostNow() - t0);
+        s[flow].bytes += sim.rxBytes + sim.txBytes - b0;
+
+        sim.lift();
+        AD013_HostAdvance(500000);
+      }
+      AD013_SetMatchCacheTTL(AD013_MATCH_CACHE_TTL);
+    }
+
+    for (int flow = 0; flow < 2; flow++) AD013_BenchLine(names[flow], baud, s[flow]);
+  }
+}
+
+                        // ==================
+                        // Scenario: search
+                        // ==================
+
+// Regular users (AD013_HOT_SIZE of them) and how often they touch
+static const int AD013_benchRegulars[] = { 37, 52, 71, 90 };
+#define AD013_BENCH_REGULARS     (int)(sizeof(AD013_benchRegulars) / sizeof(AD013_benchRegulars[0]))
+#define AD013_BENCH_REGULAR_PCT  80
+
+// GetImage, GenChar and one Search over the whole DB (no planner)
+static int AD013_BenchFullSearch(AD013_Sensor * sensor) {
+
+  static const char search[] = { 1, 0, 0, (char)(AD013_MAX_TEMPLATES >> 8),
+                                 (char)(AD013_MAX_TEMPLATES & 0xFF) };
+  AD013_Params params;
+
+  memset(&params, 0, sizeof(params));
+  memset(params.devId, 0xFF, sizeof(params.devId));
+
+  AD013_SubmitCommand(sensor, 0x01, &params);
+  if (AD013_BenchRun(sensor) != 0) return -1;
+
+  params.buff[0] = 1;
+  params.size = 1;
+  AD013_SubmitCommand(sensor, 0x02, &params);
+  if (AD013_BenchRun(sensor) != 0) return -1;
+
+  memcpy(params.buff, search, sizeof(search));
+  params.size = sizeof(search);
+  AD013_SubmitCommand(sensor, 0x04, &params);
+  if (AD013_BenchRun(sensor) != 0) return -1;
+
+  return (sensor->parser.payload[1] << 8) | sensor->parser.payload[2];
+}
+
+// Tiered search (hot tier, SO range, users' range) against a single
+// PS_Search over the whole DB (AD013_MAX_TEMPLATES templates), finger
+// already on. Most touches come from a few regular users, the others
+// from anywhere in the DB (hot tier misses). The tier hit rates (and
+// search times, without the capture) are those at 57600 baud
+static void AD013_BenchSearch(void) {
+
+  AD013_SearchStats stats;
+
+  memset(&stats, 0, sizeof(stats));
+  printf("\nsearch: tiered vs full DB search, %d templates, %d%% of the touches by %d users\n",
+         AD013_MAX_TEMPLATES, AD013_BENCH_REGULAR_PCT, AD013_BENCH_REGULARS);
+  printf("  %-22s %7s %9s %9s %9s %10s\n", "flow", "baud", "p50 ms", "p90 ms", "p99 ms", "searches");
+
+  for (int b = 0; b < AD013_BENCH_BAUDS; b++) {
+
+    long baud = AD013_benchBauds[b];
+    AD013_BenchSamples s[2];
+    unsigned long searches[2] = { 0, 0 };
+    static const char * names[] = { "SearchTemplate (tiers)", "Search (full DB)" };
+
+    for (int flow = 0; flow < 2; flow++) {
+
+      AD013_Sim sim(baud);
+      AD013_Sensor sensor;
+      unsigned long seed = 7;
+      int warmup = AD013_HOT_SIZE * 2;
+
+      AD013_BenchReset();
+      AD013_SetMatchCacheTTL(0);
+      AD013_SensorInit(&sensor, sim);
+      sensor.baud = baud;
+      sim.hostBaud = baud;
+      for (int id = 0; id < AD013_MAX_TEMPLATES; id++) sim.store(id, 1000 + id);
+
+      for (int i = 0; i < AD013_benchRuns / 4 + 1 + warmup; i++) {
+        unsigned long long t0;
+        unsigned long c0 = sim.calls[0x04];
+        int id, ret;
+
+        seed = seed * 1103515245UL + 12345UL;
+        if ((seed >> 8) % 100 < AD013_BENCH_REGULAR_PCT)
+          id = AD013_benchRegulars[(seed >> 16) % AD013_BENCH_REGULARS];
+        else
+          id = (seed >> 16) % AD013_MAX_TEMPLATES;
+
+        // Steady state (the hot tier filled) before the samples
+        if (i == warmup) AD013_ResetSearchStats();
+
+        sim.place(1000 + id);
+        t0 = AD013_HostNow();
+        if (flow == 0) ret = AD013_SearchTemplate(sim, 5000, 50, false, NULL);
+        else ret = AD013_BenchFullSearch(&sensor);
+        if (i >= warmup) {
+          if (ret != id) s[flow].failed++;
+          s[flow].add(AD013_HostNow() - t0);
+          searches[flow] += sim.calls[0x04] - c0;
+        }
+
+        sim.lift();
+        AD013_HostAdvance(500000);
+      }
+
+      if (flow == 0 && baud == 57600) AD013_GetSearchStats(&stats);
+      AD013_SetMatchCacheTTL(AD013_MATCH_CACHE_TTL);
+    }
+
+    for (int flow = 0; flow < 2; flow++) {
+      printf("  %-22s %7ld %9.2f %9.2f %9.2f %10.2f", names[flow], baud,
+             s[flow].pct(50), s[flow].pct(90), s[flow].pct(99),
+             (double) searches[flow] / s[flow].us.size());
+      if (s[flow].failed) printf("  (%d failed)", s[flow].failed);
+      printf("\n");
+    }
+  }
+
+  printf("  tier hits (57600 baud):");
+  for (int t = 0; t < AD013_MAX_SEARCH_TIERS + 1; t++) {
+    if (!stats.tierHits[t] && t > 2) continue;
+    printf(" %s %.0f%% (%.1f ms)", t == 0 ? "hot" : t == 1 ? "SO" : t == 2 ? "users" : "other",
+           stats.matches ? 100.0 * stats.tierHits[t] / stats.matches : 0.0,
+           stats.tierHits[t] ? (double) stats.tierMs[t] / stats.tierHits[t] : 0.0);
+  }
+  printf("\n");
+}
+
+                        // ==================
+                        // Scenario: pool
+                        // ==================
+
+// Continuous identify (AD013_PoolIdentifyAll()) on 1, 2 and 4 sensors,
+// each on its own UART with a finger kept on: identifications per
+// second of the whole pool and per sensor
+static void AD013_BenchPool(void) {
+
+  static const int sizes[] = { 1, 2, 4 };
+  static const long bauds[] = { 115200, 57600 };
+  unsigned long long window = (AD013_benchRuns >= 100 ? 20 : 2) * 1000000ULL;
+
+  printf("\npool: continuous identify, %llu s per case (50 templates each)\n", window / 1000000);
+  printf("  %-22s %7s %9s %9s %9s\n", "sensors", "baud", "ident/s", "per sensor", "scaling");
+
+  for (unsigned int b = 0; b < sizeof(bauds) / sizeof(bauds[0]); b++) {
+
+    double single = 0;
+
+    for (unsigned int n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++) {
+
+      std::vector<AD013_Sim *> sims;
+      AD013_Pool pool;
+      AD013_PoolEvent ev;
+      unsigned long ok = 0, failed = 0;
+      char name[16];
+
+      AD013_BenchReset();
+      AD013_SetMatchCacheTTL(0);
+      AD013_PoolInit(&pool);
+
+      for (int i = 0; i < sizes[n]; i++) {
+        AD013_Sim * sim = new AD013_Sim(bauds[b]);
+        sim->hostBaud = sim->baud;
+        for (int id = 0; id < 50; id++) sim->store(id, 1000 * (i + 1) + id);
+        sim->place(1000 * (i + 1) + 20 + i);
+        AD013_PoolAdd(&pool, *sim, NULL, bauds[b]);
+        sims.push_back(sim);
+      }
+
+      // Every identify is a full capture and search
+      unsigned long long t0 = AD013_HostNow();
+      AD013_PoolIdentifyAll(&pool, 5000, 50);
+      while (AD013_HostNow() - t0 < window) {
+        AD013_PoolPoll(&pool);
+        while (AD013_PoolNextEvent(&pool, &ev)) {
+          if (ev.result == 20 + ev.sensor) ok++;
+          else failed++;
+        }
+      }
+      AD013_PoolStop(&pool);
+      while (AD013_PoolPoll(&pool) > 0);
+
+      double rate = ok * 1000000.0 / window;
+      if (sizes[n] == 1) single = rate;
+
+      snprintf(name, sizeof(name), "%d", sizes[n]);
+      printf("  %-22s %7ld %9.2f %9.2f %8.2fx", name, bauds[b], rate, rate / sizes[n],
+             single > 0 ? rate / single : 0);
+      if (failed) printf("  (%lu failed)", failed);
+      printf("\n");
+
+      for (size_t i = 0; i < sims.size(); i++) delete sims[i];
+      AD013_SetMatchCacheTTL(AD013_MATCH_CACHE_TTL);
+    }
+  }
+}
+
+                        // =========
+                        // Scenarios
+                        // =========
+
+typedef struct bench_st {
+  const char * name;
+  void (*fn)(void);
+} AD013_Bench;
+
+static const AD013_Bench AD013_benches[] = {
+  { "link", AD013_BenchLink },
+  { "identify", AD013_BenchIdentify },
+  { "verify", AD013_BenchVerify },
+  { "search", AD013_BenchSearch },
+  { "faults", AD013_BenchFaults },
+  { "backup", AD013_BenchBackup },
+  { "transfer", AD013_BenchTransfer },
+  { "upgrade", AD013_BenchUpgrade },
+  { "pool", AD013_BenchPool },
+};
+
+int main(int argc, char ** argv) {
+
+  int count = sizeof(AD013_benches) / sizeof(AD013_benches[0]);
+  std::vector<const char *> names;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) AD013_benchRuns = 4;
+    else names.push_back(argv[i]);
+  }
+
+  for (size_t n = 0; n < names.size(); n++) {
+    bool found = false;
+    for (int i = 0; i < count; i++) found |= strcmp(names[n], AD013_benches[i].name) == 0;
+    if (!found) {
+      printf("Unknown scenario: %s\n", names[n]);
+      return 1;
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    bool run = names.empty();
+    for (size_t n = 0; n < names.size(); n++) run |= strcmp(names[n], AD013_benches[i].name) == 0;
+    if (run) AD013_benches[i].fn();
+  }
+
+  return 0;
+}
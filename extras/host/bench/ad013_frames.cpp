@@ -0,0 +1,203 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Host Build - Command Frame Encoding Benchmark
+// ================================================
+
+// Compares the cost of building a command frame three ways:
+//
+//   runtime    - params packed by AD013_AddParamN(), then copied
+//                into the frame (AD013_SubmitCommand() path)
+//   descriptor - fields written straight into the frame from the
+//                AD013_Command<> layout (the flows)
+//   prebuilt   - the compile time frame of a command without fields
+//
+// The frame helpers and the command descriptors are internal to the
+// library, so this file builds AD013.cpp itself (not ad013_host).
+// The numbers are host CPU cycles (TSC on x86, else nanoseconds).
+//
+//   ad013_frames [--quick]
+
+// System headers first (the library poisons the heap functions)
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "AD013.cpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AD013_BENCH_UNIT  "cycles"
+static inline unsigned long long AD013_BenchTicks(void) { return __rdtsc(); }
+#else
+#define AD013_BENCH_UNIT  "ns"
+static inline unsigned long long AD013_BenchTicks(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+static long AD013_benchLoops = 1000000;
+
+// Keeps the frames from being optimized away
+static byte AD013_benchFrame[AD013_MAX_FRAME_SIZE];
+
+static inline void AD013_BenchUse(const byte * buff, int size) {
+  memcpy(AD013_benchFrame, buff, size);
+}
+
+                        // ========
+                        // Encoders
+                        // ========
+
+// PS_GetImage (no fields)
+static void AD013_RuntimeGetImage(const char * devId, uint16_t start) {
+  AD013_Params params;
+  AD013_Frame frame;
+
+  (void) start;
+  AD013_ClearParams(&params);
+  AD013_FrameBegin(&frame, devId, AD013_FLAG_COMMAND);
+  AD013_FramePut(&frame, AD013_CmdGetImage::code);
+  AD013_FramePutN(&frame, params.buff, params.size);
+  AD013_FrameEnd(&frame);
+  AD013_BenchUse(frame.buff, frame.size);
+}
+
+static void AD013_DescriptorGetImage(const char * devId, uint16_t start) {
+  AD013_Frame frame;
+
+  (void) start;
+  AD013_FrameBegin(&frame, devId, AD013_FLAG_COMMAND);
+  AD013_FramePut(&frame, AD013_CmdGetImage::code);
+  AD013_CmdGetImage::put(&frame);
+  AD013_FrameEnd(&frame);
+  AD013_BenchUse(frame.buff, frame.size);
+}
+
+static void AD013_PrebuiltGetImage(const char * devId, uint16_t start) {
+  byte buff[AD013_CONST_FRAME_SIZE];
+
+  (void) devId;
+  (void) start;
+  memcpy(buff, AD013_ConstFrame<AD013_CmdGetImage::code>::data, sizeof(buff));
+  AD013_BenchUse(buff, sizeof(buff));
+}
+
+// PS_Search (Buffer, Start, Count)
+static void AD013_RuntimeSearch(const char * devId, uint16_t start) {
+  AD013_Params params;
+  AD013_Frame frame;
+  char val[2];
+  char buffId = 1;
+
+  AD013_ClearParams(&params);
+  AD013_AddParamN(&params, &buffId, 1);
+  AD013_set_uint16_value(val, start);
+  AD013_AddParamN(&params, val, 2);
+  AD013_set_uint16_value(val, AD013_MAX_TEMPLATES);
+  AD013_AddParamN(&params, val, 2);
+
+  AD013_FrameBegin(&frame, devId, AD013_FLAG_COMMAND);
+  AD013_FramePut(&frame, AD013_CmdSearch::code);
+  AD013_FramePutN(&frame, params.buff, params.size);
+  AD013_FrameEnd(&frame);
+  AD013_BenchUse(frame.buff, frame.size);
+}
+
+static void AD013_DescriptorSearch(const char * devId, uint16_t start) {
+  AD013_Frame frame;
+
+  AD013_FrameBegin(&frame, devId, AD013_FLAG_COMMAND);
+  AD013_FramePut(&frame, AD013_CmdSearch::code);
+  AD013_CmdSearch::put(&frame, (uint8_t) 1, start, (uint16_t) AD013_MAX_TEMPLATES);
+  AD013_FrameEnd(&frame);
+  AD013_BenchUse(frame.buff, frame.size);
+}
+
+                        // =======
+                        // Harness
+                        // =======
+
+// The start field changes on each call (not folded to a constant)
+typedef void (* AD013_BenchEncoder)(const char * devId, uint16_t start);
+
+static double AD013_BenchEncode(AD013_BenchEncoder encode) {
+
+  // Through a pointer, so the calls are not folded into the loop
+  volatile AD013_BenchEncoder fn = encode;
+  const char * devId = AD013_def_devid;
+
+  for (long i = 0; i < AD013_benchLoops / 10; i++) fn(devId, (uint16_t) i);
+
+  unsigned long long t0 = AD013_BenchTicks();
+  for (long i = 0; i < AD013_benchLoops; i++) fn(devId, (uint16_t) i);
+  unsigned long long t1 = AD013_BenchTicks();
+
+  return (double)(t1 - t0) / AD013_benchLoops;
+}
+
+static void AD013_BenchRow(const char * name, AD013_BenchEncoder runtime,
+                           AD013_BenchEncoder descriptor, AD013_BenchEncoder prebuilt) {
+
+  printf("  %-10s %10.1f %10.1f ", name,
+         AD013_BenchEncode(runtime), AD013_BenchEncode(descriptor));
+  if (prebuilt) printf("%10.1f\n", AD013_BenchEncode(prebuilt));
+  else printf("%10s\n", "-");
+}
+
+static int AD013_BenchCheck(void) {
+
+  AD013_Params params;
+  AD013_Frame a, b;
+  char val[2];
+  char buffId = 1;
+
+  // The three encoders must agree on the bytes
+  AD013_FrameBegin(&a, AD013_def_devid, AD013_FLAG_COMMAND);
+  AD013_FramePut(&a, AD013_CmdGetImage::code);
+  AD013_FrameEnd(&a);
+  if (a.size != AD013_CONST_FRAME_SIZE ||
+      memcmp(a.buff, AD013_ConstFrame<AD013_CmdGetImage::code>::data, a.size) != 0)
+    return 0;
+
+  AD013_ClearParams(&params);
+  AD013_AddParamN(&params, &buffId, 1);
+  AD013_set_uint16_value(val, 0);
+  AD013_AddParamN(&params, val, 2);
+  AD013_set_uint16_value(val, AD013_MAX_TEMPLATES);
+  AD013_AddParamN(&params, val, 2);
+  AD013_FrameBegin(&a, AD013_def_devid, AD013_FLAG_COMMAND);
+  AD013_FramePut(&a, AD013_CmdSearch::code);
+  AD013_FramePutN(&a, params.buff, params.size);
+  AD013_FrameEnd(&a);
+
+  AD013_FrameBegin(&b, AD013_def_devid, AD013_FLAG_COMMAND);
+  AD013_FramePut(&b, AD013_CmdSearch::code);
+  AD013_CmdSearch::put(&b, (uint8_t) 1, (uint16_t) 0, (uint16_t) AD013_MAX_TEMPLATES);
+  AD013_FrameEnd(&b);
+
+  return a.size == b.size && memcmp(a.buff, b.buff, a.size) == 0;
+}
+
+int main(int argc, char * argv[]) {
+
+  if (argc > 1 && strcmp(argv[1], "--quick") == 0) AD013_benchLoops = 1000;
+
+  if (!AD013_BenchCheck()) {
+    printf("frames: encoders disagree\n");
+    return 1;
+  }
+
+  printf("frames: %s per command frame (%ld loops)\n", AD013_BENCH_UNIT, AD013_benchLoops);
+  printf("  %-10s %10s %10s %10s\n", "command", "runtime", "descriptor", "prebuilt");
+  AD013_BenchRow("GetImage", AD013_RuntimeGetImage, AD013_DescriptorGetImage, AD013_PrebuiltGetImage);
+  AD013_BenchRow("Search", AD013_RuntimeSearch, AD013_DescriptorSearch, NULL);
+
+  return 0;
+}
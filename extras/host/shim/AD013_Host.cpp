@@ -0,0 +1,189 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Host Build - Clock, Pins and Interrupts
+// ================================================
+
+#include "AD013_Host.h"
+#include "EEPROM.h"
+
+#include <time.h>
+#include <map>
+#include <utility>
+
+                        // ===========
+                        // Host Clock
+                        // ===========
+
+typedef std::pair<unsigned long long, unsigned long> AD013_HostKey;
+
+static unsigned long long AD013_hostNow = 0;
+static unsigned long long AD013_hostBase = 0;
+static bool               AD013_hostReal = false;
+static bool               AD013_hostFiring = false;
+static unsigned long      AD013_hostSeq = 0;
+
+// Timers by (time, sequence)
+static std::map<AD013_HostKey, std::function<void(void)> > AD013_hostTimers;
+
+// Pins and Interrupts
+static int    AD013_hostPins[AD013_HOST_MAX_PINS];
+static int    AD013_hostModes[AD013_HOST_MAX_PINS];
+static void (*AD013_hostIsrs[AD013_HOST_MAX_PINS])(void);
+
+EEPROMClass EEPROM;
+HostConsole Serial;
+
+static unsigned long long AD013_HostMonotonic(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void AD013_HostFire(unsigned long long until) {
+
+  // Timers can add timers and read the clock
+  if (AD013_hostFiring) return;
+  AD013_hostFiring = true;
+
+  while (!AD013_hostTimers.empty() && AD013_hostTimers.begin()->first.first <= until) {
+    std::map<AD013_HostKey, std::function<void(void)> >::iterator it = AD013_hostTimers.begin();
+    std::function<void(void)> fn = it->second;
+    if (!AD013_hostReal && it->first.first > AD013_hostNow) AD013_hostNow = it->first.first;
+    AD013_hostTimers.erase(it);
+    fn();
+  }
+
+  AD013_hostFiring = false;
+}
+
+void AD013_HostReset(void) {
+  AD013_hostTimers.clear();
+  AD013_hostNow = 0;
+  AD013_hostBase = AD013_HostMonotonic();
+  AD013_hostSeq = 0;
+  memset(AD013_hostPins, 0, sizeof(AD013_hostPins));
+  memset(AD013_hostModes, 0, sizeof(AD013_hostModes));
+  memset(AD013_hostIsrs, 0, sizeof(AD013_hostIsrs));
+}
+
+void AD013_HostRealClock(bool real) {
+  AD013_hostReal = real;
+  AD013_hostBase = AD013_HostMonotonic() - AD013_hostNow;
+}
+
+unsigned long long AD013_HostNow(void) {
+  if (AD013_hostReal) AD013_hostNow = AD013_HostMonotonic() - AD013_hostBase;
+  return AD013_hostNow;
+}
+
+void AD013_HostAdvance(unsigned long long us) {
+
+  if (AD013_hostReal) {
+    struct timespec ts = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000L };
+    nanosleep(&ts, NULL);
+    AD013_HostFire(AD013_HostNow());
+    return;
+  }
+
+  unsigned long long until = AD013_hostNow + us;
+  AD013_HostFire(until);
+  if (AD013_hostNow < until) AD013_hostNow = until;
+}
+
+void AD013_HostIdle(void) {
+  if (AD013_hostReal) AD013_HostFire(AD013_HostNow());
+  else AD013_HostAdvance(AD013_HOST_IDLE_US);
+}
+
+void AD013_HostAt(unsigned long long at, std::function<void(void)> fn) {
+  AD013_hostTimers[AD013_HostKey(at, AD013_hostSeq++)] = fn;
+}
+
+void AD013_HostAfter(unsigned long long us, std::function<void(void)> fn) {
+  AD013_HostAt(AD013_HostNow() + us, fn);
+}
+
+static unsigned long long AD013_HostTick(void) {
+  if (AD013_hostReal) AD013_HostFire(AD013_HostNow());
+  else AD013_HostAdvance(AD013_HOST_TICK_US);
+  return AD013_hostNow;
+}
+
+                        // ================
+                        // Arduino Time API
+                        // ================
+
+unsigned long millis(void) {
+  return (unsigned long)(AD013_HostTick() / 1000);
+}
+
+unsigned long micros(void) {
+  return (unsigned long) AD013_HostTick();
+}
+
+void delay(unsigned long ms) {
+  AD013_HostAdvance((unsigned long long) ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  AD013_HostAdvance(us);
+}
+
+void yield(void) {
+  // Nothing else runs on the host
+}
+
+                        // ====================
+                        // Pins and Interrupts
+                        // ====================
+
+void pinMode(int pin, int mode) {
+  (void) pin;
+  (void) mode;
+}
+
+int digitalRead(int pin) {
+  if (pin < 0 || pin >= AD013_HOST_MAX_PINS) return LOW;
+  return AD013_hostPins[pin];
+}
+
+void digitalWrite(int pin, int level) {
+  if (pin >= 0 && pin < AD013_HOST_MAX_PINS) AD013_hostPins[pin] = level ? HIGH : LOW;
+}
+
+int digitalPinToInterrupt(int pin) {
+  return pin;
+}
+
+void attachInterrupt(int irq, void (*isr)(void), int mode) {
+  if (irq < 0 || irq >= AD013_HOST_MAX_PINS) return;
+  AD013_hostIsrs[irq] = isr;
+  AD013_hostModes[irq] = mode;
+}
+
+void detachInterrupt(int irq) {
+  if (irq >= 0 && irq < AD013_HOST_MAX_PINS) AD013_hostIsrs[irq] = NULL;
+}
+
+void AD013_HostSetPin(int pin, int level) {
+
+  int prev = 0;
+
+  if (pin < 0 || pin >= AD013_HOST_MAX_PINS) return;
+
+  prev = AD013_hostPins[pin];
+  level = level ? HIGH : LOW;
+  AD013_hostPins[pin] = level;
+
+  if (prev == level || !AD013_hostIsrs[pin]) return;
+
+  switch (AD013_hostModes[pin]) {
+    case RISING:  if (level == HIGH) AD013_hostIsrs[pin](); break;
+    case FALLING: if (level == LOW) AD013_hostIsrs[pin](); break;
+    case CHANGE:  AD013_hostIsrs[pin](); break;
+    default: break;
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef AD013_HOST_CONTROL_HEADER
+#define AD013_HOST_CONTROL_HEADER
+
+// Host Build Controls (tests, benchmarks and the simulator only, the
+// library itself never includes this header)
+
+#include <Arduino.h>
+#include <functional>
+
+// Virtual Clock Costs (us): each clock read stands for the CPU time
+// of the code around it, a Stream poll that finds nothing for the
+// idle time of a busy loop
+#ifndef AD013_HOST_TICK_US
+#define AD013_HOST_TICK_US         1
+#endif
+#ifndef AD013_HOST_IDLE_US
+#define AD013_HOST_IDLE_US        10
+#endif
+
+#define AD013_HOST_MAX_PINS       64
+
+/*! \brief Restarts the host: clock at 0, no timers, pins low, no ISRs
+ */
+void AD013_HostReset(void);
+
+/*! \brief Switches between the virtual (default) and the real clock
+ *
+ * The real clock (CLOCK_MONOTONIC) is needed when the peer runs in
+ * another process, e.g. the pty test.
+ */
+void AD013_HostRealClock(bool real);
+
+/*! \brief Returns the host time (us since the reset)
+ *
+ * Reading the time does not advance the virtual clock.
+ */
+unsigned long long AD013_HostNow(void);
+
+/*! \brief Moves the clock forward (the due timers fire in order)
+ *
+ * Sleeps for the given time with the real clock.
+ */
+void AD013_HostAdvance(unsigned long long us);
+
+/*! \brief Accounts for a poll that found nothing to do
+ */
+void AD013_HostIdle(void);
+
+/*! \brief Runs fn once the clock reaches 'at' (us)
+ *
+ * Timers fire from the clock reads, in time order (then in the order
+ * they were added). A timer in the past fires on the next read.
+ */
+void AD013_HostAt(unsigned long long at, std::function<void(void)> fn);
+
+/*! \brief Runs fn 'us' microseconds from now
+ */
+void AD013_HostAfter(unsigned long long us, std::function<void(void)> fn);
+
+/*! \brief Drives an input pin (an edge fires the attached ISR)
+ */
+void AD013_HostSetPin(int pin, int level);
+
+#endif // AD013_HOST_CONTROL_HEADER
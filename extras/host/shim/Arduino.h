@@ -0,0 +1,112 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Host Build - Arduino Core Shim
+// ================================================
+
+#ifndef AD013_HOST_ARDUINO_SHIM_HEADER
+#define AD013_HOST_ARDUINO_SHIM_HEADER
+
+// Only the parts of the Arduino core used by the library (time,
+// pins, interrupts, Print and Stream). Time runs on the host clock
+// (see AD013_Host.h): virtual by default, so that the tests and the
+// benchmarks are deterministic and run faster than real time.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+typedef uint8_t byte;
+
+// Pin Levels and Modes
+#define LOW                 0
+#define HIGH                1
+#define INPUT               0
+#define OUTPUT              1
+#define INPUT_PULLUP        2
+
+// Interrupt Modes
+#define CHANGE              1
+#define FALLING             2
+#define RISING              3
+
+// Time (host clock)
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+
+// Pins and Interrupts (see AD013_HostSetPin())
+void pinMode(int pin, int mode);
+int  digitalRead(int pin);
+void digitalWrite(int pin, int level);
+int  digitalPinToInterrupt(int pin);
+void attachInterrupt(int irq, void (*isr)(void), int mode);
+void detachInterrupt(int irq);
+
+class Print {
+  public:
+    virtual ~Print() { }
+
+    virtual size_t write(uint8_t val) = 0;
+    virtual size_t write(const uint8_t * buff, size_t size) {
+      size_t count = 0;
+      while (count < size && write(buff[count])) count++;
+      return count;
+    }
+
+    size_t write(const char * str) {
+      return str ? write((const uint8_t *) str, strlen(str)) : 0;
+    }
+    size_t print(const char * str) { return write(str); }
+    size_t println(const char * str) { return write(str) + write('\n'); }
+    size_t println(void) { return write('\n'); }
+};
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() { }
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+
+    // Reads until size bytes or the timeout (as the Arduino core)
+    size_t readBytes(char * buff, size_t size) {
+      size_t count = 0;
+      unsigned long start = millis();
+      while (count < size && millis() - start < _timeout) {
+        int val = read();
+        if (val >= 0) buff[count++] = (char) val;
+      }
+      return count;
+    }
+    size_t readBytes(uint8_t * buff, size_t size) {
+      return readBytes((char *) buff, size);
+    }
+
+  protected:
+    unsigned long _timeout = 1000;
+};
+
+// Console (stdout, nothing to read)
+class HostConsole : public Stream {
+  public:
+    void begin(long speed) { (void) speed; }
+
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    size_t write(uint8_t val) { return putchar(val) == EOF ? 0 : 1; }
+    using Print::write;
+};
+
+extern HostConsole Serial;
+
+#endif // AD013_HOST_ARDUINO_SHIM_HEADER
@@ -0,0 +1,39 @@
+#ifndef AD013_HOST_EEPROM_SHIM_HEADER
+#define AD013_HOST_EEPROM_SHIM_HEADER
+
+#include <Arduino.h>
+
+#ifndef AD013_HOST_EEPROM_SIZE
+#define AD013_HOST_EEPROM_SIZE  1024
+#endif
+
+// Host Build: EEPROM in RAM (AD013_USE_EEPROM builds), erased to 0xFF
+class EEPROMClass {
+  public:
+    EEPROMClass() { memset(_data, 0xFF, sizeof(_data)); }
+
+    uint8_t read(int addr) const {
+      return addr >= 0 && addr < AD013_HOST_EEPROM_SIZE ? _data[addr] : 0xFF;
+    }
+    void write(int addr, uint8_t val) {
+      if (addr >= 0 && addr < AD013_HOST_EEPROM_SIZE) {
+        _data[addr] = val;
+        _writes++;
+      }
+    }
+    void update(int addr, uint8_t val) {
+      if (read(addr) != val) write(addr, val);
+    }
+    int length() const { return AD013_HOST_EEPROM_SIZE; }
+
+    // Cell writes so far (wear checks)
+    unsigned long writes() const { return _writes; }
+
+  private:
+    uint8_t       _data[AD013_HOST_EEPROM_SIZE];
+    unsigned long _writes = 0;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // AD013_HOST_EEPROM_SHIM_HEADER
@@ -0,0 +1,7 @@
+#ifndef AD013_HOST_LIBPRINTF_SHIM_HEADER
+#define AD013_HOST_LIBPRINTF_SHIM_HEADER
+
+// Host Build: printf() is the C library one
+#include <stdio.h>
+
+#endif // AD013_HOST_LIBPRINTF_SHIM_HEADER
@@ -0,0 +1,30 @@
+#ifndef AD013_HOST_SOFTWARE_SERIAL_SHIM_HEADER
+#define AD013_HOST_SOFTWARE_SERIAL_SHIM_HEADER
+
+#include <Arduino.h>
+
+// Host Build: the library switches the speed of a SoftwareSerial
+// with begin() when no baud hook is set. The simulator derives from
+// this class (begin() is virtual here) so that path is exercised too.
+class SoftwareSerial : public Stream {
+  public:
+    SoftwareSerial(int rxPin = -1, int txPin = -1) : _speed(0) {
+      (void) rxPin;
+      (void) txPin;
+    }
+
+    virtual void begin(long speed) { _speed = speed; }
+    long speed() const { return _speed; }
+
+    // Unconnected by default
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    size_t write(uint8_t val) { (void) val; return 1; }
+    using Print::write;
+
+  protected:
+    long _speed;
+};
+
+#endif // AD013_HOST_SOFTWARE_SERIAL_SHIM_HEADER
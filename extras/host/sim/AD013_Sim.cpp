@@ -0,0 +1,701 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Host Build - Scripted Sensor Simulator
+// ================================================
+
+#include "AD013_Sim.h"
+
+// Packet Layout (same as the library)
+#define AD013_SIM_HEADER_HI     0xEF
+#define AD013_SIM_HEADER_LO     0x01
+#define AD013_SIM_FLAG_COMMAND  0x01
+#define AD013_SIM_FLAG_DATA     0x02
+#define AD013_SIM_FLAG_ACK      0x07
+#define AD013_SIM_FLAG_END      0x08
+#define AD013_SIM_MAX_PACKET     300
+
+// Sensor Codes
+#define AD013_SIM_OK            0x00
+#define AD013_SIM_ERROR         0x01
+#define AD013_SIM_NO_FINGER     0x02
+#define AD013_SIM_NOT_MATCHED   0x08
+#define AD013_SIM_NOT_FOUND     0x09
+#define AD013_SIM_MERGE_FAIL    0x0A
+#define AD013_SIM_RANGE_ERROR   0x0B
+#define AD013_SIM_READ_ERROR    0x0C
+#define AD013_SIM_UPLOAD_FAIL   0x0D
+#define AD013_SIM_IMAGE_FAIL    0x0F
+#define AD013_SIM_DELETE_FAIL   0x10
+#define AD013_SIM_LOW_POWER     0x12
+#define AD013_SIM_PASSWORD      0x13
+#define AD013_SIM_INCOMPLETE    0x15
+#define AD013_SIM_REGISTER      0x1A
+
+// Template Marker (first bytes of a simulated template)
+#define AD013_SIM_MARK_HI       0x03
+#define AD013_SIM_MARK_LO       0x01
+
+                        // ===============
+                        // Set Up and Line
+                        // ===============
+
+AD013_Sim::AD013_Sim(long speed) :
+    baud(speed), hostBaud(speed), password(0), packetSize(128), templateSize(512),
+    imageSize(4096), capacity(100), touchPin(-1), touchLevel(HIGH),
+    noFingerUs(20000), searchUs(1500), bootUs(60000), distinctPresses(true),
+    rxBytes(0), txBytes(0), presses(0), lost(0), asleep(false),
+    _inFree(0), _outFree(0), _finger(-1), _image(-1), _imagePress(0),
+    _downBuffer(0), _autoPending(false), _wakeAt(0), _noise(0), _seed(1),
+    _alive(std::make_shared<int>(0)) {
+
+  memset(devId, 0xFF, sizeof(devId));
+  memset(calls, 0, sizeof(calls));
+  _db.resize(capacity);
+
+  // Processing times (us), model values
+  for (int i = 0; i < 256; i++) cmdUs[i] = 1000;
+  cmdUs[0x01] = 60000;   // GetImage (finger on)
+  cmdUs[0x02] = 90000;   // GenChar
+  cmdUs[0x03] = 20000;   // Match
+  cmdUs[0x04] = 5000;    // Search (plus searchUs per template)
+  cmdUs[0x05] = 60000;   // RegModel
+  cmdUs[0x06] = 40000;   // StoreChar
+  cmdUs[0x07] = 10000;   // LoadChar
+  cmdUs[0x08] = 2000;    // UpChar
+  cmdUs[0x09] = 2000;    // DownChar
+  cmdUs[0x0A] = 2000;    // UpImage
+  cmdUs[0x0C] = 20000;   // DeletChar
+  cmdUs[0x0D] = 60000;   // Empty
+  cmdUs[0x0E] = 2000;    // WriteReg
+  cmdUs[0x1F] = 3000;    // ReadIndexTable
+  cmdUs[0x33] = 2000;    // Sleep
+}
+
+unsigned long AD013_Sim::byteUs(long speed) const {
+  // 8N1: 10 bits per byte
+  return speed > 0 ? (unsigned long)(10000000UL / speed) : 0;
+}
+
+void AD013_Sim::at(unsigned long long when, std::function<void(void)> fn) {
+  std::weak_ptr<int> alive = _alive;
+  AD013_HostAt(when, [alive, fn]() { if (!alive.expired()) fn(); });
+}
+
+void AD013_Sim::begin(long speed) {
+  hostBaud = speed;
+}
+
+int AD013_Sim::available() {
+
+  unsigned long long now = AD013_HostNow();
+  int count = 0;
+
+  for (size_t i = 0; i < _out.size() && _out[i].first <= now; i++) count++;
+  if (!count) AD013_HostIdle();
+
+  return count;
+}
+
+int AD013_Sim::read() {
+
+  int val = -1;
+
+  if (_out.empty() || _out.front().first > AD013_HostNow()) {
+    AD013_HostIdle();
+    return -1;
+  }
+  val = _out.front().second;
+  _out.pop_front();
+
+  return val;
+}
+
+int AD013_Sim::peek() {
+  if (_out.empty() || _out.front().first > AD013_HostNow()) return -1;
+  return _out.front().second;
+}
+
+size_t AD013_Sim::write(uint8_t val) {
+  feed(&val, 1);
+  return 1;
+}
+
+size_t AD013_Sim::write(const uint8_t * buff, size_t size) {
+  feed(buff, size);
+  return size;
+}
+
+void AD013_Sim::feed(const uint8_t * data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    rxBytes++;
+    rxByte(data[i]);
+  }
+}
+
+size_t AD013_Sim::drain(uint8_t * buff, size_t size) {
+
+  unsigned long long now = AD013_HostNow();
+  size_t count = 0;
+
+  while (count < size && !_out.empty() && _out.front().first <= now) {
+    buff[count++] = _out.front().second;
+    _out.pop_front();
+  }
+
+  return count;
+}
+
+void AD013_Sim::rxByte(uint8_t val) {
+
+  unsigned long long now = AD013_HostNow();
+  unsigned long long t = (_inFree > now ? _inFree : now) + byteUs(hostBaud);
+
+  _inFree = t;
+
+  // Wrong speed (framing errors) or asleep: the byte is lost
+  if (hostBaud != baud || asleep) {
+    lost++;
+    _rx.clear();
+    return;
+  }
+
+  // Hunts for the header
+  if ((_rx.size() == 0 && val != AD013_SIM_HEADER_HI) ||
+      (_rx.size() == 1 && val != AD013_SIM_HEADER_LO)) {
+    _rx.clear();
+    if (val == AD013_SIM_HEADER_HI) _rx.push_back(val);
+    return;
+  }
+  _rx.push_back(val);
+  if (_rx.size() < 9) return;
+
+  size_t len = (_rx[7] << 8) | _rx[8];
+  if (len < 3 || len > AD013_SIM_MAX_PACKET) {
+    _rx.clear();
+    return;
+  }
+  if (_rx.size() < 9 + len) return;
+
+  // Complete packet: sum, then address
+  uint16_t sum = 0;
+  for (size_t i = 6; i < _rx.size() - 2; i++) sum += _rx[i];
+  uint16_t recv = (_rx[_rx.size() - 2] << 8) | _rx[_rx.size() - 1];
+  uint8_t flag = _rx[6];
+  bool mine = memcmp(&_rx[2], devId, 4) == 0;
+  std::vector<uint8_t> payload(_rx.begin() + 9, _rx.end() - 2);
+
+  _rx.clear();
+  if (sum != recv || !mine) return;
+
+  // Processed once the last byte is in
+  at(t, [this, flag, payload]() { process(flag, payload); });
+}
+
+                        // ====================
+                        // Template DB and Finger
+                        // ====================
+
+void AD013_Sim::templateOf(int finger, uint8_t * data, int size) {
+
+  unsigned long x = (unsigned long) finger * 2654435761UL + 12345;
+
+  for (int i = 0; i < size; i++) {
+    x = x * 1103515245UL + 12345;
+    data[i] = (x >> 16) & 0xFF;
+  }
+
+  // Marker and finger ID (matching is on the finger ID)
+  if (size >= 6) {
+    data[0] = AD013_SIM_MARK_HI;
+    data[1] = AD013_SIM_MARK_LO;
+    data[2] = (finger >> 24) & 0xFF;
+    data[3] = (finger >> 16) & 0xFF;
+    data[4] = (finger >> 8) & 0xFF;
+    data[5] = finger & 0xFF;
+  }
+}
+
+int AD013_Sim::fingerOf(const std::vector<uint8_t> & data) {
+  if (data.size() < 6 || data[0] != AD013_SIM_MARK_HI || data[1] != AD013_SIM_MARK_LO)
+    return -1;
+  return (data[2] << 24) | (data[3] << 16) | (data[4] << 8) | data[5];
+}
+
+void AD013_Sim::store(int id, int finger) {
+  if (id < 0 || id >= capacity) return;
+  if ((int) _db.size() < capacity) _db.resize(capacity);
+  _db[id].resize(templateSize);
+  templateOf(finger, &_db[id][0], templateSize);
+}
+
+void AD013_Sim::erase(int id) {
+  if (id >= 0 && id < (int) _db.size()) _db[id].clear();
+}
+
+void AD013_Sim::clear() {
+  for (size_t i = 0; i < _db.size(); i++) _db[i].clear();
+}
+
+bool AD013_Sim::stored(int id) const {
+  return id >= 0 && id < (int) _db.size() && !_db[id].empty();
+}
+
+int AD013_Sim::fingerAt(int id) const {
+  return stored(id) ? fingerOf(_db[id]) : -1;
+}
+
+int AD013_Sim::count() const {
+  int n = 0;
+  for (size_t i = 0; i < _db.size(); i++) n += !_db[i].empty();
+  return n;
+}
+
+void AD013_Sim::place(int finger) {
+
+  if (finger < 0) {
+    lift();
+    return;
+  }
+
+  _finger = finger;
+  presses++;
+  if (touchPin >= 0) AD013_HostSetPin(touchPin, touchLevel);
+
+  // A touch wakes the sensor up (boot time)
+  if (asleep && !_wakeAt) {
+    _wakeAt = AD013_HostNow() + bootUs;
+    at(_wakeAt, [this]() {
+      asleep = false;
+      _wakeAt = 0;
+      _rx.clear();
+    });
+  }
+
+  if (_autoPending && !asleep) autoCapture();
+}
+
+void AD013_Sim::lift() {
+  _finger = -1;
+  if (touchPin >= 0) AD013_HostSetPin(touchPin, !touchLevel);
+}
+
+void AD013_Sim::placeAt(unsigned long long when, int finger) {
+  at(when, [this, finger]() { place(finger); });
+}
+
+void AD013_Sim::liftAt(unsigned long long when) {
+  at(when, [this]() { lift(); });
+}
+
+int AD013_Sim::scoreOf(int finger) const {
+  std::map<int, int>::const_iterator it = _scores.find(finger);
+  return it == _scores.end() ? 100 : it->second;
+}
+
+int AD013_Sim::search(const Buffer & buff, int start, int count,
+                      int * score, int * scanned) const {
+
+  int finger = fingerOf(buff.data);
+
+  *score = 0;
+  *scanned = 0;
+
+  // Scans the stored templates of the range (first match)
+  for (int id = start; id < start + count && id < (int) _db.size(); id++) {
+    if (_db[id].empty()) continue;
+    (*scanned)++;
+    if (finger >= 0 && fingerOf(_db[id]) == finger) {
+      *score = scoreOf(finger);
+      return id;
+    }
+  }
+
+  return -1;
+}
+
+                        // ======
+                        // Faults
+                        // ======
+
+void AD013_Sim::fault(int kind, int count, int code, unsigned long arg) {
+  Fault f = { kind, count, code, arg };
+  _faults.push_back(f);
+}
+
+void AD013_Sim::failNext(int code, int status, int count) {
+  for (int i = 0; i < count; i++) _fails[code].push_back(status);
+}
+
+void AD013_Sim::noise(double rate, unsigned long seed) {
+  _noise = rate;
+  _seed = seed ? seed : 1;
+}
+
+void AD013_Sim::clearFaults() {
+  _faults.clear();
+  _fails.clear();
+  _noise = 0;
+}
+
+                        // =======
+                        // Replies
+                        // =======
+
+void AD013_Sim::packet(uint8_t flag, const std::vector<uint8_t> & payload,
+                       unsigned long procUs, int faultCode) {
+
+  unsigned long long now = AD013_HostNow();
+  unsigned long long start = now + procUs;
+  std::vector<uint8_t> frame;
+  uint16_t len = payload.size() + 2;
+  uint16_t sum = flag + (len >> 8) + (len & 0xFF);
+
+  frame.push_back(AD013_SIM_HEADER_HI);
+  frame.push_back(AD013_SIM_HEADER_LO);
+  frame.insert(frame.end(), devId, devId + 4);
+  frame.push_back(flag);
+  frame.push_back(len >> 8);
+  frame.push_back(len & 0xFF);
+  for (size_t i = 0; i < payload.size(); i++) {
+    frame.push_back(payload[i]);
+    sum += payload[i];
+  }
+  frame.push_back(sum >> 8);
+  frame.push_back(sum & 0xFF);
+
+  // Injected Faults (command replies, or the data packet picked
+  // by sendData())
+  for (size_t i = 0; (faultCode >= 0 || faultCode == AD013_SIM_DATA) && i < _faults.size(); i++) {
+    Fault & f = _faults[i];
+    if (f.count <= 0) continue;
+    if (faultCode == AD013_SIM_DATA ? f.code != AD013_SIM_DATA :
+        (f.code != AD013_SIM_ANY && f.code != faultCode)) continue;
+    f.count--;
+    switch (f.kind) {
+      case AD013_SIM_FAULT_BAD_SUM: frame.back() ^= 0x01; break;
+      case AD013_SIM_FAULT_SHORT:   frame.resize(frame.size() / 2); break;
+      case AD013_SIM_FAULT_SILENT:  frame.clear(); break;
+      case AD013_SIM_FAULT_DELAY:   start += f.arg; break;
+    }
+    break;
+  }
+
+  if (start < _outFree) start = _outFree;
+
+  for (size_t i = 0; i < frame.size(); i++) {
+    uint8_t val = frame[i];
+    // Wrong speed on the host side: garbage
+    if (hostBaud != baud) val ^= 0x55;
+    if (_noise > 0) {
+      _seed = _seed * 1103515245UL + 12345;
+      if (((_seed >> 8) & 0xFFFF) < _noise * 65536) val ^= 0x10;
+    }
+    start += byteUs(baud);
+    _out.push_back(std::make_pair(start, val));
+    txBytes++;
+  }
+  if (!frame.empty()) _outFree = start;
+}
+
+void AD013_Sim::ack(uint8_t code, uint8_t status, const std::vector<uint8_t> & data,
+                    unsigned long procUs) {
+
+  std::vector<uint8_t> payload;
+
+  payload.reserve(data.size() + 1);
+  payload.push_back(status);
+  for (size_t i = 0; i < data.size(); i++) payload.push_back(data[i]);
+  packet(AD013_SIM_FLAG_ACK, payload, procUs, code);
+
+  if (onReply) onReply(code, status);
+}
+
+void AD013_Sim::sendData(const std::vector<uint8_t> & data, unsigned long procUs) {
+
+  for (size_t pos = 0; pos < data.size(); pos += packetSize) {
+    size_t len = data.size() - pos < packetSize ? data.size() - pos : packetSize;
+    std::vector<uint8_t> chunk(data.begin() + pos, data.begin() + pos + len);
+    int faultCode = -1;
+
+    // Data packet faults (by packet number)
+    for (size_t i = 0; i < _faults.size(); i++) {
+      if (_faults[i].code == AD013_SIM_DATA && _faults[i].count > 0 &&
+          _faults[i].arg == pos / packetSize)
+        faultCode = AD013_SIM_DATA;
+    }
+
+    packet(pos + len < data.size() ? AD013_SIM_FLAG_DATA : AD013_SIM_FLAG_END,
+           chunk, pos ? 0 : procUs, faultCode);
+  }
+}
+
+                        // ========
+                        // Commands
+                        // ========
+
+void AD013_Sim::process(uint8_t flag, const std::vector<uint8_t> & payload) {
+
+  // Data packets (PS_DownChar)
+  if (flag == AD013_SIM_FLAG_DATA || flag == AD013_SIM_FLAG_END) {
+    if (!_downBuffer) return;
+    _down.insert(_down.end(), payload.begin(), payload.end());
+    if (flag == AD013_SIM_FLAG_END) {
+      _buffers[_downBuffer].data = _down;
+      _buffers[_downBuffer].press = 0;
+      _downBuffer = 0;
+    }
+    return;
+  }
+
+  if (flag != AD013_SIM_FLAG_COMMAND || payload.empty()) return;
+
+  uint8_t code = payload[0];
+  calls[code]++;
+  log.push_back(code);
+
+  // Forced status (no side effects)
+  std::map<int, std::deque<int> >::iterator it = _fails.find(code);
+  if (it != _fails.end() && !it->second.empty()) {
+    int status = it->second.front();
+    it->second.pop_front();
+    ack(code, status, std::vector<uint8_t>(), cmdUs[code]);
+    return;
+  }
+
+  command(code, payload.size() > 1 ? &payload[1] : NULL, payload.size() - 1);
+}
+
+void AD013_Sim::autoCapture(void) {
+
+  Buffer & buff = _buffers[1];
+  int score = 0, scanned = 0, id = -1;
+  unsigned long captureUs = cmdUs[0x01];
+
+  _autoPending = false;
+  _image = _finger;
+  _imagePress = presses;
+  buff.data.resize(templateSize);
+  templateOf(_finger, &buff.data[0], templateSize);
+  buff.press = presses;
+
+  // Stage 1 (image), then stage 5 (search result)
+  ack(0x32, AD013_SIM_OK, std::vector<uint8_t>{ 0x01, 0, 0, 0, 0 }, captureUs);
+
+  id = search(buff, 0, capacity, &score, &scanned);
+  unsigned long resultUs = captureUs + cmdUs[0x02] + cmdUs[0x04] + scanned * searchUs;
+  if (id >= 0) {
+    ack(0x32, AD013_SIM_OK, std::vector<uint8_t>{ 0x05, (uint8_t)(id >> 8), (uint8_t) id,
+      (uint8_t)(score >> 8), (uint8_t) score }, resultUs);
+  } else {
+    ack(0x32, AD013_SIM_NOT_FOUND, std::vector<uint8_t>{ 0x05, 0, 0, 0, 0 }, resultUs);
+  }
+}
+
+void AD013_Sim::command(uint8_t code, const uint8_t * p, int len) {
+
+  std::vector<uint8_t> none;
+  unsigned long proc = cmdUs[code];
+
+  switch (code) {
+
+    case 0x13: {  // VerifyPwd (Password)
+      uint32_t pwd = len >= 4 ?
+        ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3] : 0;
+      ack(code, len >= 4 && pwd == password ? AD013_SIM_OK : AD013_SIM_PASSWORD, none, proc);
+    } break;
+
+    case 0x01: {  // GetImage
+      if (_finger < 0) {
+        ack(code, AD013_SIM_NO_FINGER, none, noFingerUs);
+        break;
+      }
+      _image = _finger;
+      _imagePress = presses;
+      ack(code, AD013_SIM_OK, none, proc);
+    } break;
+
+    case 0x02: {  // GenChar (Buffer)
+      int buff = len >= 1 ? p[0] : 0;
+      if (buff < 1 || buff > 5) {
+        ack(code, AD013_SIM_ERROR, none, proc);
+        break;
+      }
+      if (_image < 0) {
+        ack(code, AD013_SIM_INCOMPLETE, none, proc);
+        break;
+      }
+      _buffers[buff].data.resize(templateSize);
+      templateOf(_image, &_buffers[buff].data[0], templateSize);
+      _buffers[buff].press = _imagePress;
+      ack(code, AD013_SIM_OK, none, proc);
+    } break;
+
+    case 0x03: {  // Match (Buffer 1 vs 2)
+      int a = fingerOf(_buffers[1].data), b = fingerOf(_buffers[2].data);
+      int score = (a >= 0 && a == b) ? scoreOf(a) : 0;
+      ack(code, score ? AD013_SIM_OK : AD013_SIM_NOT_MATCHED,
+          std::vector<uint8_t>{ (uint8_t)(score >> 8), (uint8_t) score }, proc);
+    } break;
+
+    case 0x04: {  // Search (Buffer, Start, Count)
+      int buff = len >= 5 ? p[0] : 0;
+      int start = len >= 5 ? (p[1] << 8) | p[2] : 0;
+      int count = len >= 5 ? (p[3] << 8) | p[4] : 0;
+      int score = 0, scanned = 0, id = -1;
+      if (buff < 1 || buff > 5 || start + count > capacity) {
+        ack(code, AD013_SIM_RANGE_ERROR, std::vector<uint8_t>(4, 0), proc);
+        break;
+      }
+      id = search(_buffers[buff], start, count, &score, &scanned);
+      proc += scanned * searchUs;
+      if (id < 0) {
+        ack(code, AD013_SIM_NOT_FOUND, std::vector<uint8_t>(4, 0), proc);
+      } else {
+        ack(code, AD013_SIM_OK, std::vector<uint8_t>{ (uint8_t)(id >> 8), (uint8_t) id,
+          (uint8_t)(score >> 8), (uint8_t) score }, proc);
+      }
+    } break;
+
+    case 0x05: {  // RegModel (Buffers 1-5)
+      int finger = fingerOf(_buffers[1].data);
+      bool ok = finger >= 0;
+      for (int i = 2; ok && i <= 5; i++) {
+        ok = fingerOf(_buffers[i].data) == finger;
+        // The same press five times has no new minutiae
+        for (int j = 1; ok && distinctPresses && j < i; j++)
+          ok = _buffers[i].press != _buffers[j].press;
+      }
+      if (ok) _buffers[2] = _buffers[1];
+      ack(code, ok ? AD013_SIM_OK : AD013_SIM_MERGE_FAIL, none, proc);
+    } break;
+
+    case 0x06: {  // StoreChar (Buffer, ID)
+      int buff = len >= 3 ? p[0] : 0;
+      int id = len >= 3 ? (p[1] << 8) | p[2] : -1;
+      if (id < 0 || id >= capacity) {
+        ack(code, AD013_SIM_RANGE_ERROR, none, proc);
+      } else if (buff < 1 || buff > 5 || _buffers[buff].data.empty()) {
+        ack(code, AD013_SIM_ERROR, none, proc);
+      } else {
+        if ((int) _db.size() < capacity) _db.resize(capacity);
+        _db[id] = _buffers[buff].data;
+        ack(code, AD013_SIM_OK, none, proc);
+      }
+    } break;
+
+    case 0x07: {  // LoadChar (Buffer, ID)
+      int buff = len >= 3 ? p[0] : 0;
+      int id = len >= 3 ? (p[1] << 8) | p[2] : -1;
+      if (id < 0 || id >= capacity || buff < 1 || buff > 5) {
+        ack(code, AD013_SIM_RANGE_ERROR, none, proc);
+      } else if (!stored(id)) {
+        ack(code, AD013_SIM_READ_ERROR, none, proc);
+      } else {
+        _buffers[buff].data = _db[id];
+        _buffers[buff].press = 0;
+        ack(code, AD013_SIM_OK, none, proc);
+      }
+    } break;
+
+    case 0x08: {  // UpChar (Buffer), data packets follow
+      int buff = len >= 1 ? p[0] : 0;
+      if (buff < 1 || buff > 5 || _buffers[buff].data.empty()) {
+        ack(code, AD013_SIM_UPLOAD_FAIL, none, proc);
+        break;
+      }
+      ack(code, AD013_SIM_OK, none, proc);
+      sendData(_buffers[buff].data, 0);
+    } break;
+
+    case 0x09: {  // DownChar (Buffer), data packets follow
+      int buff = len >= 1 ? p[0] : 0;
+      if (buff < 1 || buff > 5) {
+        ack(code, AD013_SIM_ERROR, none, proc);
+        break;
+      }
+      _downBuffer = buff;
+      _down.clear();
+      ack(code, AD013_SIM_OK, none, proc);
+    } break;
+
+    case 0x0A: {  // UpImage, data packets follow
+      if (_image < 0) {
+        ack(code, AD013_SIM_IMAGE_FAIL, none, proc);
+        break;
+      }
+      std::vector<uint8_t> image(imageSize);
+      templateOf(_image + 0x10000, &image[0], imageSize);
+      ack(code, AD013_SIM_OK, none, proc);
+      sendData(image, 0);
+    } break;
+
+    case 0x0C: {  // DeletChar (ID, Count)
+      int id = len >= 4 ? (p[0] << 8) | p[1] : -1;
+      int count = len >= 4 ? (p[2] << 8) | p[3] : 0;
+      if (id < 0 || count <= 0 || id + count > capacity) {
+        ack(code, AD013_SIM_DELETE_FAIL, none, proc);
+        break;
+      }
+      for (int i = id; i < id + count; i++) erase(i);
+      ack(code, AD013_SIM_OK, none, proc);
+    } break;
+
+    case 0x0D: {  // Empty
+      clear();
+      ack(code, AD013_SIM_OK, none, proc);
+    } break;
+
+    case 0x0E: {  // WriteReg (Register, Value)
+      int reg = len >= 2 ? p[0] : -1;
+      int val = len >= 2 ? p[1] : 0;
+      if (reg != 4 || val < 1 || val > 12) {
+        ack(code, AD013_SIM_REGISTER, none, proc);
+        break;
+      }
+      // Replies at the old speed, then switches
+      ack(code, AD013_SIM_OK, none, proc);
+      long speed = val * 9600L;
+      at(_outFree, [this, speed]() { baud = speed; _rx.clear(); });
+    } break;
+
+    case 0x1F: {  // ReadIndexTable (Page)
+      int page = len >= 1 ? p[0] : 0;
+      std::vector<uint8_t> bits(32, 0);
+      for (int i = 0; i < 256; i++) {
+        if (stored(page * 256 + i)) bits[i >> 3] |= 1 << (i & 0x07);
+      }
+      ack(code, AD013_SIM_OK, bits, proc);
+    } break;
+
+    case 0x30: {  // Cancel
+      _autoPending = false;
+      ack(code, AD013_SIM_OK, none, proc);
+    } break;
+
+    case 0x32: {  // AutoIdentify (Level, ID, Param), stage packets follow
+      int level = len >= 1 ? p[0] : 0;
+      if (level < 1 || level > 5) {
+        ack(code, AD013_SIM_ERROR, std::vector<uint8_t>(5, 0), proc);
+        break;
+      }
+      ack(code, AD013_SIM_OK, std::vector<uint8_t>(5, 0), proc);
+      _autoPending = true;
+      if (_finger >= 0) autoCapture();
+    } break;
+
+    case 0x33: {  // Sleep (fails with a finger on)
+      if (_finger >= 0) {
+        ack(code, AD013_SIM_LOW_POWER, none, proc);
+        break;
+      }
+      ack(code, AD013_SIM_OK, none, proc);
+      at(_outFree, [this]() { asleep = true; _rx.clear(); });
+    } break;
+
+    default:
+      ack(code, AD013_SIM_ERROR, none, proc);
+  }
+}
@@ -0,0 +1,168 @@
+#ifndef AD013_SIM_HEADER
+#define AD013_SIM_HEADER
+
+// Scripted AD-013 Sensor (host build)
+//
+// The simulator answers the library's frames the way the sensor does
+// (ACK packets, data packets, stage packets) from a template DB and a
+// finger model, on the host clock (see AD013_Host.h): every byte takes
+// 10 bits at the line rate and each command its processing time. The
+// timings are model values (cmdUs[], searchUs, bootUs), tune them to
+// match a given sensor. Faults (corrupted, short, silent or late
+// replies, line noise) are injected per command.
+//
+// The host side is the Stream interface (the library talks to the
+// simulator directly), or feed()/drain() to put it behind a real
+// transport (e.g. the master side of a pty).
+
+#include <Arduino.h>
+#include <SoftwareSerial.h>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "AD013_Host.h"
+
+// Fault Kinds (see AD013_Sim::fault())
+#define AD013_SIM_FAULT_BAD_SUM    1   // Sum of the reply flipped
+#define AD013_SIM_FAULT_SHORT      2   // Only the first half of the reply
+#define AD013_SIM_FAULT_SILENT     3   // No reply at all
+#define AD013_SIM_FAULT_DELAY      4   // Reply delayed by 'arg' us
+
+#define AD013_SIM_ANY             -1   // Fault on any command
+#define AD013_SIM_DATA            -2   // Fault on a data packet (arg: its number)
+
+class AD013_Sim : public SoftwareSerial {
+
+  public:
+    AD013_Sim(long baud = 57600);
+
+    // Host Side (Stream)
+    void begin(long speed);
+    int available();
+    int read();
+    int peek();
+    size_t write(uint8_t val);
+    size_t write(const uint8_t * buff, size_t size);
+    using Print::write;
+
+    // Host Side (transport neutral): bytes from the host, and the
+    // bytes due to the host so far
+    void feed(const uint8_t * data, size_t size);
+    size_t drain(uint8_t * buff, size_t size);
+
+    // Template DB
+    void store(int id, int finger);
+    void erase(int id);
+    void clear();
+    bool stored(int id) const;
+    int  fingerAt(int id) const;
+    int  count() const;
+
+    // Finger Model (finger IDs are >= 0), each placement is a new
+    // press. The touch output (touchPin) follows the finger
+    void place(int finger);
+    void lift();
+    void placeAt(unsigned long long at, int finger);
+    void liftAt(unsigned long long at);
+    bool present() const { return _finger >= 0; }
+    int  finger() const { return _finger; }
+    void score(int finger, int value) { _scores[finger] = value; }
+
+    // Faults: the next 'count' replies to 'code' (or AD013_SIM_ANY).
+    // With AD013_SIM_DATA, data packet 'arg' (0 for the first) of the
+    // next 'count' transfers (no AD013_SIM_FAULT_DELAY)
+    void fault(int kind, int count = 1, int code = AD013_SIM_ANY, unsigned long arg = 0);
+    void failNext(int code, int status, int count = 1);
+    void noise(double rate, unsigned long seed = 1);
+    void clearFaults();
+
+    // Template and image data of a finger (deterministic)
+    static void templateOf(int finger, uint8_t * data, int size);
+    static int  fingerOf(const std::vector<uint8_t> & data);
+
+    // Sensor Configuration
+    long          baud;            // Sensor speed
+    long          hostBaud;        // Host side speed (begin())
+    uint8_t       devId[4];
+    uint32_t      password;
+    uint16_t      packetSize;      // Data packet payload
+    uint16_t      templateSize;
+    long          imageSize;
+    int           capacity;        // Template DB slots
+    int           touchPin;        // Touch output (-1 for none)
+    int           touchLevel;      // Touch output active level
+    unsigned long cmdUs[256];      // Processing time per command
+    unsigned long noFingerUs;      // PS_GetImage without a finger
+    unsigned long searchUs;        // Per stored template searched
+    unsigned long bootUs;          // Touch to ready after PS_Sleep
+    bool          distinctPresses; // PS_RegModel rejects a single press
+
+    // Observers
+    unsigned long        calls[256];  // Commands received per code
+    std::vector<uint8_t> log;         // Command codes, in order
+    unsigned long        rxBytes;     // Bytes from the host
+    unsigned long        txBytes;     // Bytes to the host
+    unsigned long        presses;     // Finger placements
+    unsigned long        lost;        // Bytes lost (speed mismatch, asleep)
+    bool                 asleep;
+    std::function<void(uint8_t code, int status)> onReply;
+
+  private:
+    struct Buffer {
+      std::vector<uint8_t> data;
+      unsigned long        press;
+    };
+
+    struct Fault {
+      int           kind;
+      int           count;
+      int           code;
+      unsigned long arg;
+    };
+
+    unsigned long byteUs(long speed) const;
+    void at(unsigned long long when, std::function<void(void)> fn);
+    void rxByte(uint8_t val);
+    void process(uint8_t flag, const std::vector<uint8_t> & payload);
+    void command(uint8_t code, const uint8_t * p, int len);
+    void ack(uint8_t code, uint8_t status, const std::vector<uint8_t> & data,
+             unsigned long procUs);
+    void packet(uint8_t flag, const std::vector<uint8_t> & payload,
+                unsigned long procUs, int faultCode);
+    void sendData(const std::vector<uint8_t> & data, unsigned long procUs);
+    void autoCapture(void);
+    int  search(const Buffer & buff, int start, int count, int * score, int * scanned) const;
+    int  scoreOf(int finger) const;
+
+    // Sensor side parser
+    std::vector<uint8_t> _rx;
+    unsigned long long   _inFree;    // Line from the host busy until
+    unsigned long long   _outFree;   // Line to the host busy until
+
+    // Bytes to the host (arrival time, value)
+    std::deque<std::pair<unsigned long long, uint8_t> > _out;
+
+    std::vector<std::vector<uint8_t> > _db;
+    Buffer             _buffers[6];
+    int                _finger;
+    int                _image;       // Captured finger (-1 if none)
+    unsigned long      _imagePress;
+    std::map<int, int> _scores;
+    int                _downBuffer;  // PS_DownChar target (0 if none)
+    std::vector<uint8_t> _down;
+    bool               _autoPending;
+    unsigned long long _wakeAt;
+    std::vector<Fault> _faults;
+    std::map<int, std::deque<int> > _fails;
+    double             _noise;
+    unsigned long      _seed;
+
+    // Timers do not outlive the simulator
+    std::shared_ptr<int> _alive;
+};
+
+#endif // AD013_SIM_HEADER
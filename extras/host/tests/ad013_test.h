@@ -0,0 +1,115 @@
+#ifndef AD013_TEST_HEADER
+#define AD013_TEST_HEADER
+
+// Host Tests: a test is a function registered with AD013_TEST(), the
+// CHECK macros count the failures and the runner returns non-zero if
+// any check failed (one executable per test file, see CMakeLists.txt).
+
+#include "AD013.h"
+#include "AD013_Host.h"
+#include "AD013_Sim.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+typedef void (*AD013_TestFn)(void);
+
+struct AD013_TestCase {
+  const char * name;
+  AD013_TestFn fn;
+};
+
+static std::vector<AD013_TestCase> & AD013_TestCases(void) {
+  static std::vector<AD013_TestCase> cases;
+  return cases;
+}
+
+static int AD013_testFailures = 0;
+
+struct AD013_TestAdd {
+  AD013_TestAdd(const char * name, AD013_TestFn fn) {
+    AD013_TestCase tc = { name, fn };
+    AD013_TestCases().push_back(tc);
+  }
+};
+
+#define AD013_TEST(name) \
+  static void name(void); \
+  static AD013_TestAdd name##_add(#name, name); \
+  static void name(void)
+
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    AD013_testFailures++; \
+  } } while (0)
+
+#define CHECK_EQ(a, b) do { \
+  long long _a = (long long)(a), _b = (long long)(b); \
+  if (_a != _b) { \
+    printf("  %s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", \
+           __FILE__, __LINE__, #a, #b, _a, _b); \
+    AD013_testFailures++; \
+  } } while (0)
+
+// Link Records in RAM (never the default file or EEPROM)
+static AD013_Link AD013_testLinks[8];
+
+static int AD013_TestStorageRead(int slot, void * data, int size) {
+  if (slot < 0 || slot >= 8 || size != sizeof(AD013_Link)) return 0;
+  memcpy(data, &AD013_testLinks[slot], size);
+  return size;
+}
+
+static int AD013_TestStorageWrite(int slot, const void * data, int size) {
+  if (slot < 0 || slot >= 8 || size != sizeof(AD013_Link)) return 0;
+  memcpy(&AD013_testLinks[slot], data, size);
+  return size;
+}
+
+// Clean host: virtual clock at 0, empty link records, default
+// policy, SoftwareSerial baud hook (the sims), metrics and search
+// statistics
+static void AD013_TestReset(void) {
+  AD013_HostReset();
+  AD013_HostRealClock(false);
+  memset(AD013_testLinks, 0, sizeof(AD013_testLinks));
+  AD013_SetStorage(AD013_TestStorageRead, AD013_TestStorageWrite);
+  AD013_SetDefaultPolicy(NULL);
+  AD013_SetBaudHook(AD013_SoftSerialBaudHook);
+  AD013_ResetMetrics();
+  AD013_ResetSearchStats();
+}
+
+// Runs an operation to completion, returns the result
+static inline int AD013_TestRun(AD013_Sensor * sensor) {
+  while (AD013_Poll(sensor) == AD013_ASYNC_BUSY);
+  return sensor->result;
+}
+
+// Context on the simulator at its speed (no discovery)
+static inline void AD013_TestAttach(AD013_Sensor * sensor, AD013_Sim & sim) {
+  AD013_SensorInit(sensor, sim);
+  sensor->baud = sim.baud;
+  sim.hostBaud = sim.baud;
+}
+
+static int AD013_TestMain(void) {
+
+  std::vector<AD013_TestCase> & cases = AD013_TestCases();
+
+  for (size_t i = 0; i < cases.size(); i++) {
+    int before = AD013_testFailures;
+    AD013_TestReset();
+    cases[i].fn();
+    printf("%s %s\n", AD013_testFailures == before ? "PASS" : "FAIL", cases[i].name);
+  }
+
+  printf("%d check(s) failed\n", AD013_testFailures);
+  return AD013_testFailures ? 1 : 0;
+}
+
+#define AD013_TEST_MAIN() int main(void) { return AD013_TestMain(); }
+
+#endif // AD013_TEST_HEADER
@@ -0,0 +1,71 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Host Tests - Link Records File (built with -DAD013_LINK_FILE)
+// ================================================
+
+#include "ad013_test.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Default storage (the file), reloaded as after a restart
+static void Restart(void) {
+  AD013_SetStorage(NULL, NULL);
+}
+
+AD013_TEST(record_lands_in_the_file) {
+
+  AD013_Sim sim(38400);
+  struct stat st;
+
+  unlink(AD013_LINK_FILE);
+  Restart();
+
+  CHECK_EQ(AD013_FindSensor(sim), 1);
+  CHECK_EQ(stat(AD013_LINK_FILE, &st), 0);
+  CHECK(st.st_size >= (off_t) sizeof(AD013_Link));
+}
+
+AD013_TEST(record_survives_a_restart) {
+
+  AD013_Sim sim(38400);
+
+  unlink(AD013_LINK_FILE);
+  Restart();
+  CHECK_EQ(AD013_FindSensor(sim), 1);
+
+  // New process: straight to the saved speed, no probe timeouts
+  Restart();
+  AD013_Sim again(38400);
+  again.hostBaud = 9600;
+  unsigned long t0 = millis();
+  CHECK_EQ(AD013_FindSensor(again), 1);
+  CHECK(millis() - t0 < AD013_PROBE_TIMEOUT);
+  CHECK_EQ(again.calls[0x13], 1);
+  CHECK_EQ(again.hostBaud, 38400);
+}
+
+AD013_TEST(no_file_means_a_full_scan) {
+
+  AD013_Sim sim(38400);
+
+  Restart();
+  CHECK_EQ(AD013_FindSensor(sim), 1);
+
+  // File gone before the restart: the speeds are scanned again
+  unlink(AD013_LINK_FILE);
+  Restart();
+  AD013_Sim again(38400);
+  again.hostBaud = 9600;
+  unsigned long t0 = millis();
+  CHECK_EQ(AD013_FindSensor(again), 1);
+  CHECK(millis() - t0 >= 2 * AD013_PROBE_TIMEOUT);
+  CHECK_EQ(again.hostBaud, 38400);
+
+  unlink(AD013_LINK_FILE);
+}
+
+AD013_TEST_MAIN()
@@ -0,0 +1,182 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Host Tests - Binary Trace Ring (built with -DAD013_TRACE)
+// ================================================
+
+#include "ad013_test.h"
+
+#include <unistd.h>
+
+// Dump in RAM
+struct Capture : public Print {
+  std::vector<uint8_t> data;
+
+  size_t write(uint8_t val) { data.push_back(val); return 1; }
+  using Print::write;
+};
+
+// Decoded record
+struct Record {
+  char                 type;
+  uint8_t              aux;
+  uint16_t             size;
+  uint32_t             stamp;
+  std::vector<uint8_t> data;
+};
+
+static uint32_t Get(const std::vector<uint8_t> & data, size_t pos, int len) {
+  uint32_t val = 0;
+  for (int i = 0; i < len; i++) val = (val << 8) | data[pos + i];
+  return val;
+}
+
+// Same layout as ad013_trace.py: ">BBIH" after "ADTR" for the header
+// and ">BBHI" for each record, followed by the kept frame bytes
+static bool Decode(const Capture & c, uint32_t * dropped, std::vector<Record> & records) {
+
+  size_t pos = 12;
+
+  if (c.data.size() < 12 || memcmp(&c.data[0], "ADTR", 4) != 0) return false;
+  if (c.data[4] != AD013_TRACE_VERSION || c.data[5] != AD013_TRACE_MAX_DATA) return false;
+  if (12 + Get(c.data, 10, 2) != c.data.size()) return false;
+  *dropped = Get(c.data, 6, 4);
+
+  while (pos < c.data.size()) {
+    Record r;
+    if (pos + 8 > c.data.size()) return false;
+    r.type = (char) c.data[pos];
+    r.aux = c.data[pos + 1];
+    r.size = (uint16_t) Get(c.data, pos + 2, 2);
+    r.stamp = Get(c.data, pos + 4, 4);
+    pos += 8;
+
+    size_t kept = r.size < AD013_TRACE_MAX_DATA ? r.size : AD013_TRACE_MAX_DATA;
+    if (pos + kept > c.data.size()) return false;
+    r.data.assign(c.data.begin() + pos, c.data.begin() + pos + kept);
+    pos += kept;
+
+    records.push_back(r);
+  }
+
+  return true;
+}
+
+AD013_TEST(trace_records_the_frames) {
+
+  AD013_Sim sim;
+  Capture c;
+  std::vector<Record> records;
+  uint32_t dropped = 1;
+
+  AD013_TraceReset();
+  CHECK_EQ(AD013_LoadIndex(sim), 1);
+
+  CHECK_EQ(AD013_TraceDump(c), (int) c.data.size());
+  CHECK(Decode(c, &dropped, records));
+  CHECK_EQ(dropped, 0);
+  CHECK_EQ(records.size(), 2);
+  if (records.size() != 2) return;
+
+  // The command frame as sent, then its reply
+  CHECK_EQ(records[0].type, AD013_TRACE_TX);
+  CHECK_EQ(records[0].data[0], 0xEF);
+  CHECK_EQ(records[0].data[1], 0x01);
+  CHECK_EQ(records[0].data[9], 0x1F);
+  CHECK_EQ(records[1].type, AD013_TRACE_RX);
+  CHECK_EQ(records[1].aux, AD013_FLAG_ACK);
+  CHECK(records[1].stamp > records[0].stamp);
+}
+
+AD013_TEST(trace_records_the_errors) {
+
+  AD013_Sim sim;
+  Capture c;
+  std::vector<Record> records;
+  uint32_t dropped = 1;
+
+  AD013_TraceReset();
+  sim.fault(AD013_SIM_FAULT_BAD_SUM, 1, 0x1F);
+  CHECK_EQ(AD013_LoadIndex(sim), 1);
+
+  AD013_TraceDump(c);
+  CHECK(Decode(c, &dropped, records));
+  CHECK_EQ(records.size(), 4);
+  if (records.size() != 4) return;
+
+  // Corrupted reply, then the retransmit and its reply
+  CHECK_EQ(records[1].type, AD013_TRACE_ERR);
+  CHECK_EQ(records[1].aux, AD013_TRACE_BAD_SUM);
+  CHECK_EQ(records[2].type, AD013_TRACE_TX);
+  CHECK(records[2].data == records[0].data);
+  CHECK_EQ(records[3].type, AD013_TRACE_RX);
+}
+
+AD013_TEST(trace_ring_keeps_the_latest_records) {
+
+  AD013_Sim sim;
+  Capture c;
+  std::vector<Record> records;
+  uint32_t dropped = 0;
+
+  AD013_TraceReset();
+  for (int i = 0; i < 20; i++) CHECK_EQ(AD013_LoadIndex(sim), 1);
+
+  AD013_TraceDump(c);
+  CHECK(Decode(c, &dropped, records));
+  CHECK(c.data.size() - 12 <= AD013_TRACE_SIZE);
+  CHECK(dropped > 0);
+  CHECK_EQ(dropped + records.size(), 40);
+
+  // Whole records, oldest first, ending on the last reply
+  for (size_t i = 1; i < records.size(); i++)
+    CHECK(records[i].stamp >= records[i - 1].stamp);
+  CHECK(!records.empty() && records.back().type == AD013_TRACE_RX);
+}
+
+AD013_TEST(dump_decodes_with_the_script) {
+
+  AD013_Sim sim;
+  Capture c;
+  char path[] = "/tmp/ad013_trace_XXXXXX";
+  char cmd[512];
+  char line[256];
+  int fd = -1;
+  int tx = 0, rx = 0, err = 0;
+
+  if (system("python3 -c '' > /dev/null 2>&1") != 0) {
+    printf("  (no python3, decoder not run)\n");
+    return;
+  }
+
+  AD013_TraceReset();
+  sim.fault(AD013_SIM_FAULT_BAD_SUM, 1, 0x1F);
+  CHECK_EQ(AD013_LoadIndex(sim), 1);
+  AD013_TraceDump(c);
+
+  // Some console noise ahead of the dump (as on a debug port)
+  CHECK((fd = mkstemp(path)) >= 0);
+  CHECK_EQ(write(fd, "boot\n", 5), 5);
+  CHECK_EQ(write(fd, &c.data[0], c.data.size()), (ssize_t) c.data.size());
+  close(fd);
+
+  snprintf(cmd, sizeof(cmd), "python3 %s %s", AD013_TRACE_SCRIPT, path);
+  FILE * out = popen(cmd, "r");
+  CHECK(out != NULL);
+  if (!out) return;
+  while (fgets(line, sizeof(line), out)) {
+    if (strstr(line, " TX ")) tx++;
+    if (strstr(line, " RX ACK ")) rx++;
+    if (strstr(line, " ERR bad sum ")) err++;
+  }
+  CHECK_EQ(pclose(out), 0);
+  unlink(path);
+
+  CHECK_EQ(tx, 2);
+  CHECK_EQ(rx, 1);
+  CHECK_EQ(err, 1);
+}
+
+AD013_TEST_MAIN()
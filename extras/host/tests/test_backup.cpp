@@ -0,0 +1,290 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Host Tests - Template DB Backup and Restore
+// ================================================
+
+#include "ad013_test.h"
+
+#include <unistd.h>
+
+// Container in RAM
+struct Container {
+  std::vector<uint8_t> data;
+  size_t               pos;
+
+  Container() : pos(0) { }
+};
+
+static int ContainerWrite(void * ctx, const byte * data, int size) {
+  Container * c = (Container *) ctx;
+  c->data.insert(c->data.end(), data, data + size);
+  return size;
+}
+
+static int ContainerRead(void * ctx, byte * data, int size) {
+  Container * c = (Container *) ctx;
+  int left = (int)(c->data.size() - c->pos);
+  if (size > left) size = left;
+  memcpy(data, &c->data[c->pos], size);
+  c->pos += size;
+  return size;
+}
+
+// The template index is kept per link slot, across the tests
+static void IndexInvalidate(AD013_Sim & sim) {
+  AD013_Sensor sensor;
+  AD013_SensorInit(&sensor, sim);
+  AD013_IndexInvalidate(&sensor);
+}
+
+AD013_TEST(backup_hashes_each_template_once) {
+
+  AD013_Sim sim;
+  Container c, again;
+  AD013_BackupStats stats;
+
+  sim.hostBaud = sim.baud;
+  sim.store(0, 10);
+  sim.store(7, 11);
+  sim.store(42, 12);
+
+  IndexInvalidate(sim);
+
+  // Hashes not known yet: index pass, then the records
+  CHECK_EQ(AD013_BackupDB(sim, ContainerWrite, &c, &stats), 3);
+  CHECK_EQ(sim.calls[0x08], 6);
+  CHECK_EQ(stats.templates, 3);
+  CHECK_EQ(stats.bytes, 3 * sim.templateSize);
+
+  // Header, index, records (one chunk per packet) and trailer
+  int chunks = (sim.templateSize + sim.packetSize - 1) / sim.packetSize;
+  CHECK_EQ(c.data.size(), 8 + 3 * 8 + 3 * (2 + chunks * 2 + sim.templateSize + 8) + 4);
+  CHECK(memcmp(&c.data[0], "AD13", 4) == 0);
+  CHECK_EQ(c.data[4], 3);
+
+  // Known now, each template is read once
+  CHECK_EQ(AD013_BackupDB(sim, ContainerWrite, &again), 3);
+  CHECK_EQ(sim.calls[0x08], 9);
+  CHECK(again.data == c.data);
+}
+
+AD013_TEST(restore_into_an_empty_sensor) {
+
+  AD013_Sim src, dst;
+  Container c;
+  AD013_BackupStats stats;
+
+  src.hostBaud = src.baud;
+  dst.hostBaud = dst.baud;
+  src.store(3, 20);
+  src.store(99, 21);
+  IndexInvalidate(src);
+  CHECK_EQ(AD013_BackupDB(src, ContainerWrite, &c), 2);
+
+  IndexInvalidate(dst);
+  CHECK_EQ(AD013_RestoreDB(dst, ContainerRead, &c, &stats), 2);
+  CHECK_EQ(stats.skipped, 0);
+  CHECK_EQ(dst.fingerAt(3), 20);
+  CHECK_EQ(dst.fingerAt(99), 21);
+  CHECK_EQ(dst.count(), 2);
+  CHECK_EQ(dst.calls[0x09], 2);
+  CHECK_EQ(dst.calls[0x06], 2);
+}
+
+AD013_TEST(chunks_are_repacked_on_restore) {
+
+  AD013_Sim src, dst;
+  Container c;
+
+  // Backup from a sensor with shorter data packets
+  src.hostBaud = src.baud;
+  dst.hostBaud = dst.baud;
+  src.packetSize = 100;
+  src.store(8, 50);
+  IndexInvalidate(src);
+  CHECK_EQ(AD013_BackupDB(src, ContainerWrite, &c), 1);
+
+  IndexInvalidate(dst);
+  CHECK_EQ(AD013_RestoreDB(dst, ContainerRead, &c), 1);
+  CHECK_EQ(dst.fingerAt(8), 50);
+}
+
+AD013_TEST(restore_skips_the_same_template) {
+
+  AD013_Sim sim;
+  Container c;
+  AD013_BackupStats stats;
+
+  sim.hostBaud = sim.baud;
+  sim.store(1, 30);
+  sim.store(2, 31);
+  IndexInvalidate(sim);
+  CHECK_EQ(AD013_BackupDB(sim, ContainerWrite, &c), 2);
+
+  // Slot 2 now holds another finger (changed by another host)
+  sim.erase(2);
+  sim.store(2, 32);
+  IndexInvalidate(sim);
+
+  // Hashes dropped with the index: each slot is read for its hash,
+  // only slot 2 is sent
+  unsigned long ups = sim.calls[0x08], downs = sim.calls[0x09];
+  unsigned long stores = sim.calls[0x06];
+  CHECK_EQ(AD013_RestoreDB(sim, ContainerRead, &c, &stats), 2);
+  CHECK_EQ(stats.skipped, 1);
+  CHECK_EQ(stats.bytes, sim.templateSize);
+  CHECK_EQ(sim.calls[0x08] - ups, 2);
+  CHECK_EQ(sim.calls[0x09] - downs, 1);
+  CHECK_EQ(sim.calls[0x06] - stores, 1);
+  CHECK_EQ(sim.fingerAt(1), 30);
+  CHECK_EQ(sim.fingerAt(2), 31);
+}
+
+AD013_TEST(known_hashes_skip_all_transfers) {
+
+  AD013_Sim sim, other;
+  Container c, o;
+  AD013_BackupStats stats;
+
+  // Another backup of slot 2 (the sensors share the link slot)
+  other.hostBaud = other.baud;
+  other.store(2, 32);
+  IndexInvalidate(other);
+  CHECK_EQ(AD013_BackupDB(other, ContainerWrite, &o), 1);
+
+  sim.hostBaud = sim.baud;
+  sim.store(1, 30);
+  sim.store(2, 31);
+  IndexInvalidate(sim);
+  CHECK_EQ(AD013_BackupDB(sim, ContainerWrite, &c), 2);
+
+  // Same DB, hashes kept since the backup
+  unsigned long long bytes = sim.rxBytes + sim.txBytes;
+  CHECK_EQ(AD013_RestoreDB(sim, ContainerRead, &c, &stats), 2);
+  CHECK_EQ(stats.skipped, 2);
+  CHECK_EQ(stats.bytes, 0);
+  CHECK_EQ(sim.rxBytes + sim.txBytes, bytes);
+
+  // The other backup into slot 2, its hash follows
+  CHECK_EQ(AD013_RestoreDB(sim, ContainerRead, &o, &stats), 1);
+  CHECK_EQ(stats.skipped, 0);
+  CHECK_EQ(sim.fingerAt(2), 32);
+
+  // Slot 2 is sent again, nothing is read for the hashes
+  unsigned long ups = sim.calls[0x08];
+  c.pos = 0;
+  CHECK_EQ(AD013_RestoreDB(sim, ContainerRead, &c, &stats), 2);
+  CHECK_EQ(stats.skipped, 1);
+  CHECK_EQ(sim.calls[0x08], ups);
+  CHECK_EQ(sim.fingerAt(2), 31);
+}
+
+AD013_TEST(corrupted_record_is_not_stored) {
+
+  AD013_Sim src, dst;
+  Container c;
+  AD013_BackupStats stats;
+
+  src.hostBaud = src.baud;
+  dst.hostBaud = dst.baud;
+  src.store(5, 40);
+  src.store(6, 41);
+  IndexInvalidate(src);
+  CHECK_EQ(AD013_BackupDB(src, ContainerWrite, &c), 2);
+
+  // A data byte of the second record
+  c.data[c.data.size() - 4 - 8 - 10] ^= 0x55;
+
+  IndexInvalidate(dst);
+  CHECK_EQ(AD013_RestoreDB(dst, ContainerRead, &c, &stats), -1);
+
+  // Stops there, the first record is already stored
+  CHECK_EQ(stats.templates, 1);
+  CHECK_EQ(dst.fingerAt(5), 40);
+  CHECK(!dst.stored(6));
+}
+
+AD013_TEST(truncated_container_fails) {
+
+  AD013_Sim src, dst;
+  Container c;
+
+  src.hostBaud = src.baud;
+  dst.hostBaud = dst.baud;
+  src.store(5, 40);
+  IndexInvalidate(src);
+  CHECK_EQ(AD013_BackupDB(src, ContainerWrite, &c), 1);
+
+  c.data.resize(c.data.size() / 2);
+  IndexInvalidate(dst);
+  CHECK_EQ(AD013_RestoreDB(dst, ContainerRead, &c), -1);
+  CHECK(!dst.stored(5));
+}
+
+AD013_TEST(round_trip_through_mapped_files) {
+
+  AD013_Sim src, dst;
+  AD013_MmapSink sink;
+  AD013_MmapSource source;
+  AD013_BackupStats stats;
+  char path[] = "/tmp/ad013_backup_XXXXXX";
+  int fd = mkstemp(path);
+
+  CHECK(fd >= 0);
+  close(fd);
+
+  src.hostBaud = src.baud;
+  dst.hostBaud = dst.baud;
+  src.store(0, 70);
+  src.store(55, 71);
+  src.store(99, 72);
+  IndexInvalidate(src);
+
+  CHECK_EQ(AD013_MmapSinkOpen(&sink, path, 64 * 1024), 1);
+  CHECK_EQ(AD013_BackupDB(src, AD013_MmapSinkWrite, &sink), 3);
+  size_t size = sink.pos;
+  CHECK_EQ(AD013_MmapSinkClose(&sink), 1);
+
+  // The file holds the container only
+  CHECK_EQ(AD013_MmapSourceOpen(&source, path), 1);
+  CHECK_EQ(source.size, size);
+  IndexInvalidate(dst);
+  CHECK_EQ(AD013_RestoreDB(dst, AD013_MmapSourceRead, &source, &stats), 3);
+  CHECK_EQ(AD013_MmapSourceClose(&source), 1);
+
+  CHECK_EQ(stats.skipped, 0);
+  CHECK_EQ(dst.fingerAt(0), 70);
+  CHECK_EQ(dst.fingerAt(55), 71);
+  CHECK_EQ(dst.fingerAt(99), 72);
+  CHECK_EQ(dst.count(), 3);
+
+  unlink(path);
+}
+
+// Sink that tries a blocking call while the upload runs
+static int NestedSink(void * ctx, const byte * data, int size) {
+  AD013_Sim * sim = (AD013_Sim *) ctx;
+  (void) data;
+  if (AD013_LoadIndex(*sim) != -1) return -1;
+  return size;
+}
+
+AD013_TEST(blocking_calls_do_not_nest) {
+
+  AD013_Sim sim;
+
+  sim.hostBaud = sim.baud;
+  sim.store(4, 60);
+
+  // The shared context is busy until the upload ends
+  CHECK_EQ(AD013_UploadTemplate(sim, 4, NestedSink, &sim), sim.templateSize);
+  CHECK_EQ(sim.calls[0x1F], 0);
+
+  // Free again afterwards
+  CHECK_EQ(AD013_LoadIndex(sim), 1);
+}
+
+AD013_TEST_MAIN()
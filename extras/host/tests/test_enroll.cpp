@@ -0,0 +1,95 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Host Tests - Enrollment
+// ================================================
+
+#include "ad013_test.h"
+
+#define TOUCH_PIN   6
+
+// A user that lifts the finger after each capture and puts it
+// back a moment later (liftMs and placeMs after the PS_GenChar)
+static void Presses(AD013_Sim & sim, int finger, unsigned long liftMs, unsigned long placeMs) {
+  sim.onReply = [&sim, finger, liftMs, placeMs](uint8_t code, int status) {
+    if (code != 0x02 || status != 0) return;
+    sim.liftAt(AD013_HostNow() + liftMs * 1000);
+    sim.placeAt(AD013_HostNow() + placeMs * 1000, finger);
+  };
+}
+
+AD013_TEST(enroll_takes_five_presses) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  AD013_TestAttach(&sensor, sim);
+  sim.store(0, 99);
+  sim.place(7);
+  Presses(sim, 7, 200, 600);
+
+  CHECK_EQ(AD013_SubmitEnroll(&sensor, false, -1, 20000), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), 20);
+  CHECK_EQ(sensor.enroll.captures, 5);
+  CHECK_EQ(sim.fingerAt(20), 7);
+  CHECK_EQ(sim.calls[0x05], 1);
+  CHECK_EQ(sim.calls[0x04], 1);
+  CHECK(sim.presses >= 5);
+}
+
+AD013_TEST(enroll_waits_for_the_touch_release) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  AD013_TestAttach(&sensor, sim);
+  sim.touchPin = TOUCH_PIN;
+  AD013_HostSetPin(TOUCH_PIN, LOW);
+  CHECK_EQ(AD013_SetTouchPin(&sensor, TOUCH_PIN, RISING), 1);
+  sim.place(7);
+  Presses(sim, 7, 200, 600);
+
+  CHECK_EQ(AD013_SubmitEnroll(&sensor, false, 30, 20000), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), 30);
+  CHECK_EQ(sim.fingerAt(30), 7);
+
+  // One image per press: the release is seen on the touch output
+  CHECK_EQ(sim.calls[0x01], 5);
+
+  AD013_SetTouchPin(&sensor, AD013_TOUCH_NONE);
+}
+
+AD013_TEST(enroll_does_not_reuse_a_held_finger) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  AD013_TestAttach(&sensor, sim);
+  sim.place(7);
+
+  CHECK_EQ(AD013_SubmitEnroll(&sensor, false, 30, 3000), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), AD013_TIMEOUT);
+  CHECK_EQ(sensor.enroll.captures, 1);
+  CHECK_EQ(sim.calls[0x02], 1);
+  CHECK_EQ(sim.calls[0x05], 0);
+  CHECK(!sim.stored(30));
+}
+
+AD013_TEST(enroll_reports_a_duplicate) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  AD013_TestAttach(&sensor, sim);
+  sim.store(22, 7);
+  sim.place(7);
+
+  CHECK_EQ(AD013_SubmitEnroll(&sensor, false, -1, 20000), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), -1);
+  CHECK_EQ(sensor.enroll.status, AD013_ENROLL_DUPLICATE);
+  CHECK_EQ(sensor.enroll.duplicateId, 22);
+}
+
+AD013_TEST_MAIN()
@@ -0,0 +1,163 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Host Tests - Transaction Policy and Fault Injection
+// ================================================
+
+#include "ad013_test.h"
+
+// PS_Empty (no params)
+#define CMD   0x0D
+
+static AD013_Policy Policy(unsigned long deadline, unsigned long frameTimeout,
+                           uint8_t retries, unsigned long backoff) {
+  AD013_Policy policy = { deadline, frameTimeout, retries, backoff };
+  return policy;
+}
+
+AD013_TEST(bad_sum_is_retransmitted) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+  AD013_Metrics m;
+
+  AD013_TestAttach(&sensor, sim);
+  sim.fault(AD013_SIM_FAULT_BAD_SUM, 1, CMD);
+
+  CHECK_EQ(AD013_SubmitCommand(&sensor, CMD), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), 0);
+  CHECK_EQ(sim.calls[CMD], 2);
+
+  AD013_GetMetrics(&m);
+  CHECK_EQ(m.badSums, 1);
+  CHECK_EQ(m.retransmits, 1);
+}
+
+AD013_TEST(short_reply_is_retransmitted) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+  AD013_Metrics m;
+
+  AD013_TestAttach(&sensor, sim);
+  AD013_Policy policy = Policy(0, 100, 2, 10);
+  AD013_SetPolicy(&sensor, &policy);
+  sim.fault(AD013_SIM_FAULT_SHORT, 1, CMD);
+
+  unsigned long long t0 = AD013_HostNow();
+  CHECK_EQ(AD013_SubmitCommand(&sensor, CMD), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), 0);
+  CHECK_EQ(sim.calls[CMD], 2);
+
+  // One frame timeout and one backoff
+  CHECK(AD013_HostNow() - t0 >= 110000);
+
+  AD013_GetMetrics(&m);
+  CHECK_EQ(m.shortReads, 1);
+  CHECK_EQ(m.retransmits, 1);
+}
+
+AD013_TEST(retransmits_are_bounded) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+  AD013_Metrics m;
+
+  AD013_TestAttach(&sensor, sim);
+  AD013_Policy policy = Policy(0, 100, 2, 10);
+  AD013_SetPolicy(&sensor, &policy);
+  sim.fault(AD013_SIM_FAULT_BAD_SUM, 5, CMD);
+
+  CHECK_EQ(AD013_SubmitCommand(&sensor, CMD), 1);
+  CHECK(AD013_TestRun(&sensor) < 0);
+  CHECK_EQ(sim.calls[CMD], 3);
+
+  AD013_GetMetrics(&m);
+  CHECK_EQ(m.retransmits, 2);
+}
+
+AD013_TEST(silent_sensor_times_out) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+  AD013_Metrics m;
+
+  AD013_TestAttach(&sensor, sim);
+  AD013_Policy policy = Policy(0, 200, 2, 10);
+  AD013_SetPolicy(&sensor, &policy);
+  sim.fault(AD013_SIM_FAULT_SILENT, 1, CMD);
+
+  // Nothing came back: not retransmitted (the command may have run)
+  unsigned long long t0 = AD013_HostNow();
+  CHECK_EQ(AD013_SubmitCommand(&sensor, CMD), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), AD013_TIMEOUT);
+  CHECK(AD013_HostNow() - t0 >= 200000);
+  CHECK(AD013_HostNow() - t0 < 300000);
+  CHECK_EQ(sim.calls[CMD], 1);
+
+  AD013_GetMetrics(&m);
+  CHECK_EQ(m.timeouts, 1);
+  CHECK_EQ(m.retransmits, 0);
+}
+
+AD013_TEST(late_reply_within_the_frame_timeout) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  AD013_TestAttach(&sensor, sim);
+  AD013_Policy policy = Policy(0, 300, 2, 10);
+  AD013_SetPolicy(&sensor, &policy);
+  sim.fault(AD013_SIM_FAULT_DELAY, 1, CMD, 200000);
+
+  CHECK_EQ(AD013_SubmitCommand(&sensor, CMD), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), 0);
+  CHECK_EQ(sim.calls[CMD], 1);
+
+  // Same delay past the frame timeout
+  sim.fault(AD013_SIM_FAULT_DELAY, 1, CMD, 400000);
+  CHECK_EQ(AD013_SubmitCommand(&sensor, CMD), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), AD013_TIMEOUT);
+}
+
+AD013_TEST(deadline_cuts_the_retransmits) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+  AD013_Metrics m;
+
+  AD013_TestAttach(&sensor, sim);
+  AD013_Policy policy = Policy(300, 100, 10, 20);
+  AD013_SetPolicy(&sensor, &policy);
+  sim.fault(AD013_SIM_FAULT_SHORT, 10, CMD);
+
+  unsigned long long t0 = AD013_HostNow();
+  CHECK_EQ(AD013_SubmitCommand(&sensor, CMD), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), AD013_TIMEOUT);
+  CHECK(AD013_HostNow() - t0 <= 301000);
+  CHECK(sim.calls[CMD] < 4);
+
+  AD013_GetMetrics(&m);
+  CHECK(m.retransmits + m.deadlines >= 1);
+}
+
+AD013_TEST(deadline_bounds_an_identify) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  AD013_TestAttach(&sensor, sim);
+  AD013_Policy policy = Policy(300, 100, 2, 10);
+  AD013_SetPolicy(&sensor, &policy);
+  sim.store(20, 7);
+
+  // No finger: the flow would wait for its own timeOut
+  unsigned long long t0 = AD013_HostNow();
+  CHECK_EQ(AD013_SubmitIdentify(&sensor, 5000), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), AD013_TIMEOUT);
+  CHECK(AD013_HostNow() - t0 <= 301000);
+}
+
+AD013_TEST_MAIN()
@@ -0,0 +1,92 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Host Tests - Template Index and DB Clears
+// ================================================
+
+#include "ad013_test.h"
+
+// The template index is kept per link slot, across the tests
+static void IndexInvalidate(AD013_Sim & sim) {
+  AD013_Sensor sensor;
+  AD013_SensorInit(&sensor, sim);
+  AD013_IndexInvalidate(&sensor);
+}
+
+AD013_TEST(clear_loads_the_index_first) {
+
+  AD013_Sim sim;
+  int frames = -1;
+
+  sim.store(3, 10);
+  sim.store(25, 11);
+  sim.store(60, 12);
+  IndexInvalidate(sim);
+
+  // Index, then one PS_DeletChar of the user range
+  CHECK_EQ(AD013_ClearUserTemplates(sim, &frames), 1);
+  CHECK_EQ(frames, 2);
+  CHECK_EQ(sim.calls[0x1F], 1);
+  CHECK_EQ(sim.calls[0x0C], 1);
+  CHECK_EQ(sim.count(), 1);
+  CHECK(sim.stored(3));
+}
+
+AD013_TEST(clear_of_an_empty_range_sends_nothing) {
+
+  AD013_Sim sim;
+  int frames = -1;
+
+  sim.store(3, 10);
+  IndexInvalidate(sim);
+  CHECK_EQ(AD013_LoadIndex(sim), 1);
+
+  CHECK_EQ(AD013_ClearUserTemplates(sim, &frames), 1);
+  CHECK_EQ(frames, 0);
+  CHECK_EQ(sim.calls[0x0C] + sim.calls[0x0D], 0);
+  CHECK_EQ(sim.count(), 1);
+}
+
+AD013_TEST(clear_of_all_the_stored_templates_is_one_empty) {
+
+  AD013_Sim sim;
+  int frames = -1;
+
+  sim.store(2, 10);
+  sim.store(7, 11);
+  IndexInvalidate(sim);
+
+  // Only SO templates stored: the SO clear empties the DB
+  CHECK_EQ(AD013_ClearSOTemplates(sim, &frames), 1);
+  CHECK_EQ(frames, 2);
+  CHECK_EQ(sim.calls[0x0D], 1);
+  CHECK_EQ(sim.calls[0x0C], 0);
+  CHECK_EQ(sim.count(), 0);
+
+  // Known to be empty now
+  CHECK_EQ(AD013_ClearTemplates(sim, 0, AD013_MAX_TEMPLATES - 1, &frames), 1);
+  CHECK_EQ(frames, 0);
+  CHECK_EQ(sim.calls[0x1F], 1);
+}
+
+AD013_TEST(clear_without_an_index_sends_the_range) {
+
+  AD013_Sim sim;
+  int frames = -1;
+
+  sim.store(3, 10);
+  sim.store(40, 11);
+  IndexInvalidate(sim);
+
+  // No PS_ReadIndexTable: the whole range as one PS_DeletChar
+  sim.failNext(0x1F, 0x01);
+  CHECK_EQ(AD013_ClearTemplates(sim, 30, 49, &frames), 1);
+  CHECK_EQ(frames, 2);
+  CHECK_EQ(sim.calls[0x0C], 1);
+  CHECK_EQ(sim.count(), 1);
+  CHECK(!sim.stored(40));
+}
+
+AD013_TEST_MAIN()
@@ -0,0 +1,271 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Host Tests - Discovery, Commands and Identify
+// ================================================
+
+#include "ad013_test.h"
+
+#include <unistd.h>
+
+AD013_TEST(scan_finds_the_sensor_speed) {
+
+  AD013_Sim sim(19200);
+
+  sim.hostBaud = 9600;
+  CHECK_EQ(AD013_FindSensor(sim), 1);
+  CHECK_EQ(sim.hostBaud, 19200);
+  CHECK(sim.calls[0x13] >= 1);
+}
+
+AD013_TEST(cached_link_is_tried_first) {
+
+  AD013_Sim sim(38400);
+
+  CHECK_EQ(AD013_FindSensor(sim), 1);
+  unsigned long scanned = sim.calls[0x13];
+
+  // Second boot: one password check at the saved speed
+  sim.hostBaud = 9600;
+  CHECK_EQ(AD013_FindSensor(sim), 1);
+  CHECK_EQ(sim.calls[0x13] - scanned, 1);
+}
+
+AD013_TEST(default_storage_stays_in_ram) {
+
+  AD013_Sim sim(38400);
+
+  // No storage hook: nothing lands in the working directory
+  AD013_SetStorage(NULL, NULL);
+  unlink("ad013_link.bin");
+  CHECK_EQ(AD013_FindSensor(sim), 1);
+  CHECK(access("ad013_link.bin", F_OK) != 0);
+
+  // The record is still cached for this process
+  unsigned long scanned = sim.calls[0x13];
+  sim.hostBaud = 9600;
+  CHECK_EQ(AD013_FindSensor(sim), 1);
+  CHECK_EQ(sim.calls[0x13] - scanned, 1);
+}
+
+AD013_TEST(no_baud_hook_refuses_the_scan) {
+
+  AD013_Sim sim(38400);
+  AD013_Sensor sensor;
+
+  // The library never guesses the Stream type
+  AD013_SetBaudHook(NULL);
+  sim.hostBaud = 9600;
+  CHECK_EQ(AD013_FindSensor(sim), -1);
+  CHECK_EQ(sim.hostBaud, 9600);
+  CHECK_EQ(sim.rxBytes, 0);
+
+  AD013_SensorInit(&sensor, sim);
+  sensor.baud = 38400;
+  CHECK_EQ(AD013_SubmitUpgradeBaud(&sensor, 115200), -1);
+
+  // Per context hook
+  sensor.baudHook = AD013_SoftSerialBaudHook;
+  CHECK_EQ(AD013_SubmitFindSensor(&sensor), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), 1);
+  CHECK_EQ(sim.hostBaud, 38400);
+}
+
+AD013_TEST(other_device_id_is_not_found) {
+
+  AD013_Sim sim(57600);
+
+  sim.devId[3] = 0x01;
+  CHECK(AD013_FindSensor(sim) < 0);
+  CHECK_EQ(sim.calls[0x13], 0);
+}
+
+AD013_TEST(blocking_calls_keep_the_discovered_link) {
+
+  AD013_Sim sim(19200);
+  AD013_Params params = { { 0 }, { (char)0xFF, (char)0xFF, (char)0xFF, 0x01 }, 0 };
+
+  // Found with another device ID, at another speed than the host's
+  sim.devId[3] = 0x01;
+  sim.hostBaud = 57600;
+  sim.store(20, 7);
+  sim.place(7);
+  CHECK_EQ(AD013_FindSensor(sim, -1, &params), 1);
+
+  // The next blocking calls talk to the same sensor
+  CHECK_EQ(AD013_SearchTemplate(sim), 20);
+  CHECK_EQ(AD013_LoadIndex(sim), 1);
+  CHECK_EQ(AD013_SharedSensor(sim)->baud, 19200);
+  CHECK_EQ((uint8_t) AD013_SharedSensor(sim)->devId[3], 0x01);
+}
+
+AD013_TEST(upgrade_uses_the_discovered_password) {
+
+  AD013_Sim sim(57600);
+  AD013_Params params = { { 0x12, 0x34, 0x56, 0x78 }, { (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF }, 4 };
+
+  sim.password = 0x12345678;
+  CHECK_EQ(AD013_FindSensor(sim, -1, &params), 1);
+
+  // Re-verified with the same password at the new speed
+  CHECK_EQ(AD013_UpgradeBaud(sim, 115200), 1);
+  CHECK_EQ(sim.baud, 115200);
+  CHECK_EQ(sim.hostBaud, 115200);
+}
+
+AD013_TEST(command_round_trip) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  AD013_TestAttach(&sensor, sim);
+  sim.store(3, 42);
+
+  CHECK_EQ(AD013_SubmitCommand(&sensor, 0x0D), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), 0);
+  CHECK_EQ(sim.count(), 0);
+}
+
+AD013_TEST(metrics_track_the_fixed_opcodes) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+  AD013_Metrics m;
+
+  AD013_TestAttach(&sensor, sim);
+
+  // PS_ReadIndexTable has its slot, PS_Empty goes to the last one
+  AD013_Params params = { { 0 }, { 0 }, 1 };
+  CHECK_EQ(AD013_SubmitCommand(&sensor, 0x1F, &params), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), 0);
+  CHECK_EQ(AD013_SubmitCommand(&sensor, 0x0D), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), 0);
+  CHECK_EQ(AD013_SubmitCommand(&sensor, 0x0D), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), 0);
+
+  AD013_GetMetrics(&m);
+  CHECK_EQ(m.ops[5].code, 0x1F);
+  CHECK_EQ(m.ops[5].calls, 1);
+  CHECK_EQ(m.ops[5].replies, 1);
+  CHECK(m.ops[5].minUs > 0 && m.ops[5].minUs == m.ops[5].maxUs);
+  CHECK_EQ(m.ops[AD013_METRICS_OPCODES - 1].code, AD013_METRICS_OTHER);
+  CHECK_EQ(m.ops[AD013_METRICS_OPCODES - 1].calls, 2);
+  CHECK_EQ(m.codes[0], 3);
+
+  // 32-bit counters only
+  CHECK(sizeof(AD013_Metrics) <= 400);
+}
+
+AD013_TEST(identify_finds_the_stored_finger) {
+
+  AD013_Sim sim;
+  AD013_SearchResult res;
+
+  sim.store(25, 7);
+  sim.store(30, 8);
+  sim.placeAt(200000, 8);
+
+  CHECK_EQ(AD013_SearchTemplate(sim, 5000, 50, false, &res), 30);
+  CHECK_EQ(res.templateId, 30);
+  CHECK_EQ(res.score, 100);
+}
+
+AD013_TEST(hot_ids_are_left_out_of_the_tiers) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  // Own link slot (empty hot tier), no recent match
+  AD013_TestAttach(&sensor, sim);
+  sensor.slot = 2;
+  AD013_SetMatchCacheTTL(0);
+  sim.store(10, 7);
+  sim.store(50, 8);
+  sim.place(8);
+  CHECK_EQ(AD013_SubmitIdentify(&sensor, 5000, 50, false), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), 50);
+  sim.place(7);
+  CHECK_EQ(AD013_SubmitIdentify(&sensor, 5000, 50, false), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), 10);
+
+  // Hot IDs (most recent first), then the tiers split around them
+  CHECK_EQ(AD013_SubmitIdentify(&sensor, 5000, 50, false), 1);
+  CHECK_EQ(sensor.planLen, 6);
+  CHECK_EQ(sensor.plan[0].start, 10);
+  CHECK_EQ(sensor.plan[1].start, 50);
+  CHECK_EQ(sensor.plan[2].start, 0);
+  CHECK_EQ(sensor.plan[2].count, 10);
+  CHECK_EQ(sensor.plan[3].start, 11);
+  CHECK_EQ(sensor.plan[3].count, 9);
+  CHECK_EQ(sensor.plan[4].start, 20);
+  CHECK_EQ(sensor.plan[4].count, 30);
+  CHECK_EQ(sensor.plan[5].start, 51);
+  CHECK_EQ(sensor.plan[5].count, AD013_MAX_TEMPLATES - 51);
+  CHECK_EQ(sensor.planTier[1], 0);
+  CHECK_EQ(sensor.planTier[3], 1);
+  CHECK_EQ(sensor.planTier[5], 2);
+  sim.place(8);
+  CHECK_EQ(AD013_TestRun(&sensor), 50);
+  CHECK_EQ(sensor.planIdx, 1);
+
+  AD013_SetMatchCacheTTL(AD013_MATCH_CACHE_TTL);
+}
+
+AD013_TEST(hot_ids_stay_with_their_link_slot) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+  AD013_Sensor other;
+
+  AD013_TestAttach(&sensor, sim);
+  AD013_TestAttach(&other, sim);
+  sensor.slot = 3;
+  other.slot = 1;
+  AD013_SetMatchCacheTTL(0);
+  sim.store(50, 8);
+  sim.place(8);
+  CHECK_EQ(AD013_SubmitIdentify(&sensor, 5000, 50, false), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), 50);
+
+  // Another sensor: the same ID is another finger
+  CHECK_EQ(AD013_SubmitIdentify(&other, 5000, 50, false), 1);
+  CHECK_EQ(other.planLen, 2);
+  CHECK_EQ(other.planTier[0], 1);
+  CHECK_EQ(AD013_TestRun(&other), 50);
+
+  CHECK_EQ(AD013_SubmitIdentify(&sensor, 5000, 50, false), 1);
+  CHECK_EQ(sensor.planTier[0], 0);
+  CHECK_EQ(AD013_TestRun(&sensor), 50);
+
+  AD013_SetMatchCacheTTL(AD013_MATCH_CACHE_TTL);
+}
+
+AD013_TEST(identify_times_out_without_a_finger) {
+
+  AD013_Sim sim;
+
+  sim.store(25, 7);
+  CHECK_EQ(AD013_SearchTemplate(sim, 500), AD013_TIMEOUT);
+  CHECK(AD013_HostNow() >= 500000);
+}
+
+AD013_TEST(blocking_calls_report_timeouts) {
+
+  AD013_Sim sim;
+  AD013_Sim silent;
+
+  // No finger within timeOut
+  sim.store(25, 7);
+  CHECK_EQ(AD013_Verify(sim, 25, 500), AD013_TIMEOUT);
+  CHECK_EQ(AD013_Enroll(sim, false, 500), AD013_TIMEOUT);
+
+  // No reply from the sensor
+  silent.fault(AD013_SIM_FAULT_SILENT, 1000, 0x1F);
+  CHECK_EQ(AD013_LoadIndex(silent), AD013_TIMEOUT);
+  silent.fault(AD013_SIM_FAULT_SILENT, 1000, 0x0C);
+  CHECK_EQ(AD013_ClearTemplates(silent, 3, 3), AD013_TIMEOUT);
+}
+
+AD013_TEST_MAIN()
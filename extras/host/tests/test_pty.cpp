@@ -0,0 +1,212 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Host Tests - Linux Transport on a pty
+// ================================================
+
+// The simulator runs in a child process on the master side of a pty
+// (real clock), the library talks to the slave side through
+// AD013_LinuxSerial. The child follows the line speed set on the
+// slave (the pair shares its termios), so the speed scan and the
+// upgrade go through termios as on a USB-UART.
+
+#include "ad013_test.h"
+#include "AD013_Linux.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <functional>
+
+static long SpeedOf(speed_t speed) {
+  switch (speed) {
+    case   B9600: return   9600;
+    case  B19200: return  19200;
+    case  B38400: return  38400;
+    case  B57600: return  57600;
+    case B115200: return 115200;
+    default: return 0;
+  }
+}
+
+// Simulated sensor behind a pty (child process)
+struct PtySensor {
+  int   master;
+  int   slave;
+  pid_t pid;
+  char  path[64];
+
+  PtySensor(long baud, std::function<void(AD013_Sim &)> setup = NULL) : pid(-1) {
+
+    if (openpty(&master, &slave, path, NULL, NULL) < 0) {
+      master = slave = -1;
+      return;
+    }
+
+    if ((pid = fork()) != 0) return;
+
+    // Child: serves the sensor until the slave side is closed
+    AD013_HostReset();
+    AD013_HostRealClock(true);
+    AD013_Sim sim(baud);
+    if (setup) setup(sim);
+    ::close(slave);
+
+    for (;;) {
+      struct pollfd pfd = { master, POLLIN, 0 };
+      struct termios tty;
+      uint8_t buff[256];
+      ssize_t len = 0;
+
+      if (tcgetattr(master, &tty) == 0) sim.hostBaud = SpeedOf(cfgetospeed(&tty));
+
+      if (poll(&pfd, 1, 1) < 0 && errno != EINTR) break;
+      if (pfd.revents & POLLIN) {
+        if ((len = ::read(master, buff, sizeof(buff))) <= 0) break;
+        sim.feed(buff, len);
+      } else if (pfd.revents & (POLLHUP | POLLERR)) {
+        break;
+      }
+
+      // Due timers (replies) fire, then the bytes go out
+      AD013_HostIdle();
+      if ((len = sim.drain(buff, sizeof(buff))) > 0 && ::write(master, buff, len) != len)
+        break;
+    }
+    _exit(0);
+  }
+
+  ~PtySensor() {
+    if (slave >= 0) ::close(slave);
+    if (pid > 0) {
+      kill(pid, SIGTERM);
+      waitpid(pid, NULL, 0);
+    }
+    if (master >= 0) ::close(master);
+  }
+};
+
+// Runs an operation, sleeping on the port between polls
+static int RunOnPort(AD013_Sensor * sensor, AD013_LinuxSerial & port) {
+  while (AD013_Poll(sensor) == AD013_ASYNC_BUSY) port.wait(5);
+  return sensor->result;
+}
+
+AD013_TEST(reads_never_block) {
+
+  AD013_LinuxSerial port;
+  PtySensor pty(57600);
+
+  AD013_HostRealClock(true);
+  CHECK(pty.pid > 0);
+  CHECK_EQ(port.open(pty.path, 57600), 1);
+
+  // Nothing sent, nothing to read
+  unsigned long long t0 = AD013_HostNow();
+  CHECK_EQ(port.available(), 0);
+  CHECK_EQ(port.read(), -1);
+  CHECK_EQ(port.peek(), -1);
+  CHECK(AD013_HostNow() - t0 < 20000);
+
+  // wait() sleeps up to its timeout
+  t0 = AD013_HostNow();
+  CHECK_EQ(port.wait(50), 0);
+  CHECK(AD013_HostNow() - t0 >= 45000);
+}
+
+AD013_TEST(command_through_the_pty) {
+
+  AD013_LinuxSerial port;
+  AD013_Sensor sensor;
+  PtySensor pty(57600, [](AD013_Sim & sim) { sim.store(12, 3); });
+
+  AD013_HostRealClock(true);
+  AD013_SetBaudHook(AD013_PortBaudHook);
+  CHECK_EQ(port.open(pty.path, 57600), 1);
+  AD013_SensorInit(&sensor, port);
+  sensor.baud = 57600;
+
+  // Template index (PS_ReadIndexTable): slot 12 is used
+  AD013_IndexInvalidate(&sensor);
+  CHECK_EQ(AD013_SubmitLoadIndex(&sensor), 1);
+  CHECK_EQ(RunOnPort(&sensor, port), 1);
+  CHECK_EQ(AD013_IndexRangeEmpty(&sensor, 12, 12), 0);
+  CHECK_EQ(AD013_IndexRangeEmpty(&sensor, 13, 13), 1);
+}
+
+AD013_TEST(epoll_wakes_on_the_reply) {
+
+  AD013_LinuxSerial port;
+  AD013_Sensor sensor;
+  PtySensor pty(57600);
+  struct epoll_event ev;
+  int efd = epoll_create1(0);
+  int wakes = 0;
+
+  AD013_HostRealClock(true);
+  AD013_SetBaudHook(AD013_PortBaudHook);
+  CHECK_EQ(port.open(pty.path, 57600), 1);
+  CHECK_EQ(port.watch(efd, &sensor), 1);
+  AD013_SensorInit(&sensor, port);
+  sensor.baud = 57600;
+
+  CHECK_EQ(AD013_SubmitCommand(&sensor, 0x0D), 1);
+  while (AD013_Poll(&sensor) == AD013_ASYNC_BUSY) {
+    if (epoll_wait(efd, &ev, 1, 100) == 1) {
+      CHECK(ev.data.ptr == &sensor);
+      wakes++;
+    }
+  }
+  CHECK_EQ(sensor.result, 0);
+  CHECK(wakes >= 1);
+
+  ::close(efd);
+}
+
+AD013_TEST(scan_sets_the_tty_speed) {
+
+  AD013_LinuxSerial port;
+  PtySensor pty(19200);
+  struct termios tty;
+
+  AD013_HostRealClock(true);
+  AD013_SetBaudHook(AD013_PortBaudHook);
+  CHECK_EQ(port.open(pty.path, 57600), 1);
+
+  // Found at 19200, the port is left there
+  CHECK_EQ(AD013_FindSensor(port), 1);
+  CHECK_EQ(tcgetattr(port.fd(), &tty), 0);
+  CHECK_EQ(SpeedOf(cfgetospeed(&tty)), 19200);
+  CHECK_EQ(SpeedOf(cfgetispeed(&tty)), 19200);
+
+  // Same speed seen on the master side
+  CHECK_EQ(tcgetattr(pty.master, &tty), 0);
+  CHECK_EQ(SpeedOf(cfgetospeed(&tty)), 19200);
+}
+
+AD013_TEST(set_baud_drops_stale_input) {
+
+  AD013_LinuxSerial port;
+  PtySensor pty(57600);
+  const uint8_t junk[4] = { 1, 2, 3, 4 };
+
+  AD013_HostRealClock(true);
+  CHECK_EQ(port.open(pty.path, 57600), 1);
+
+  // Bytes received at the old speed are discarded
+  CHECK_EQ(::write(pty.master, junk, sizeof(junk)), (ssize_t) sizeof(junk));
+  CHECK_EQ(port.wait(200), 1);
+  port.setBaud(115200);
+  CHECK_EQ(port.available(), 0);
+  CHECK_EQ(port.read(), -1);
+}
+
+AD013_TEST_MAIN()
@@ -0,0 +1,335 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Host Tests - Touch Detection, Sleep and Recent Match
+// ================================================
+
+#include "ad013_test.h"
+
+#define TOUCH_PIN   5
+
+// Sensor with its touch output on TOUCH_PIN
+static void AttachTouch(AD013_Sensor * sensor, AD013_Sim & sim) {
+  AD013_TestAttach(sensor, sim);
+  sim.touchPin = TOUCH_PIN;
+  AD013_HostSetPin(TOUCH_PIN, LOW);
+  CHECK_EQ(AD013_SetTouchPin(sensor, TOUCH_PIN, RISING), 1);
+}
+
+// Releases the interrupt slot (contexts live on the stack)
+static void DetachTouch(AD013_Sensor * sensor) {
+  AD013_SetTouchPin(sensor, AD013_TOUCH_NONE);
+}
+
+AD013_TEST(touch_before_submit_is_kept) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  AttachTouch(&sensor, sim);
+  sim.store(20, 7);
+
+  // Edge while idle, then the flow starts
+  sim.place(7);
+  AD013_HostAdvance(30000);
+  AD013_SubmitIdentify(&sensor, 2000);
+  CHECK_EQ(AD013_TestRun(&sensor), 20);
+  CHECK_EQ(sim.calls[0x01], 1);
+  CHECK(sensor.captureLatency >= 30);
+
+  DetachTouch(&sensor);
+}
+
+AD013_TEST(finger_already_on_is_sampled) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  // Finger on before the interrupt is attached (no edge)
+  sim.touchPin = TOUCH_PIN;
+  sim.store(20, 7);
+  sim.place(7);
+  AD013_TestAttach(&sensor, sim);
+  CHECK_EQ(AD013_SetTouchPin(&sensor, TOUCH_PIN, RISING), 1);
+
+  AD013_SubmitIdentify(&sensor, 2000);
+  CHECK_EQ(AD013_TestRun(&sensor), 20);
+  CHECK(AD013_HostNow() < 1000000);
+
+  DetachTouch(&sensor);
+}
+
+AD013_TEST(no_commands_without_a_touch) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  AttachTouch(&sensor, sim);
+  sim.store(20, 7);
+
+  // Stale touch, finger gone before the flow starts
+  sim.place(7);
+  sim.lift();
+  AD013_SubmitIdentify(&sensor, 500);
+  CHECK(AD013_TestRun(&sensor) < 0);
+  CHECK_EQ(sim.calls[0x01], 0);
+
+  DetachTouch(&sensor);
+}
+
+AD013_TEST(recent_match_while_the_finger_stays) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+  AD013_SearchStats stats;
+
+  AttachTouch(&sensor, sim);
+  sim.store(20, 7);
+  sim.place(7);
+
+  AD013_SubmitIdentify(&sensor, 2000);
+  CHECK_EQ(AD013_TestRun(&sensor), 20);
+  AD013_SubmitIdentify(&sensor, 2000);
+  CHECK_EQ(AD013_TestRun(&sensor), 20);
+
+  // Second identify: capture only
+  AD013_GetSearchStats(&stats);
+  CHECK_EQ(stats.suppressed, 1);
+  CHECK_EQ(sim.calls[0x02], 1);
+
+  DetachTouch(&sensor);
+}
+
+AD013_TEST(finger_swap_is_searched_again) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+  AD013_SearchStats stats;
+
+  AttachTouch(&sensor, sim);
+  sim.store(20, 7);
+  sim.store(21, 8);
+  sim.place(7);
+
+  AD013_SubmitIdentify(&sensor, 2000);
+  CHECK_EQ(AD013_TestRun(&sensor), 20);
+
+  // Another finger well within the TTL
+  sim.lift();
+  AD013_HostAdvance(150000);
+  sim.place(8);
+  AD013_HostAdvance(150000);
+
+  AD013_SubmitIdentify(&sensor, 2000);
+  CHECK_EQ(AD013_TestRun(&sensor), 21);
+  AD013_GetSearchStats(&stats);
+  CHECK_EQ(stats.suppressed, 0);
+  CHECK_EQ(sim.calls[0x02], 2);
+
+  DetachTouch(&sensor);
+}
+
+AD013_TEST(finger_swap_during_the_search) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  AttachTouch(&sensor, sim);
+  sim.store(20, 7);
+  sim.store(21, 8);
+  sim.place(7);
+
+  // Swapped once the image is taken, before the match is known
+  sim.onReply = [&sim](uint8_t code, int status) {
+    if (code == 0x02 && status == 0) {
+      sim.lift();
+      sim.place(8);
+      sim.onReply = NULL;
+    }
+  };
+
+  AD013_SubmitIdentify(&sensor, 2000);
+  CHECK_EQ(AD013_TestRun(&sensor), 20);
+  AD013_SubmitIdentify(&sensor, 2000);
+  CHECK_EQ(AD013_TestRun(&sensor), 21);
+
+  DetachTouch(&sensor);
+}
+
+AD013_TEST(recent_match_when_polling) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+  AD013_SearchStats stats;
+
+  AD013_TestAttach(&sensor, sim);
+  sim.store(20, 7);
+  sim.place(7);
+
+  AD013_SubmitIdentify(&sensor, 2000);
+  CHECK_EQ(AD013_TestRun(&sensor), 20);
+  AD013_SubmitIdentify(&sensor, 2000);
+  CHECK_EQ(AD013_TestRun(&sensor), 20);
+
+  AD013_GetSearchStats(&stats);
+  CHECK_EQ(stats.suppressed, 1);
+  CHECK_EQ(sim.calls[0x02], 1);
+}
+
+AD013_TEST(polling_lift_is_searched_again) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+  AD013_SearchStats stats;
+
+  AD013_TestAttach(&sensor, sim);
+  sim.store(20, 7);
+  sim.store(21, 8);
+  sim.place(7);
+
+  AD013_SubmitIdentify(&sensor, 2000);
+  CHECK_EQ(AD013_TestRun(&sensor), 20);
+
+  // A capture without finger drops the recent match
+  sim.lift();
+  AD013_SubmitIdentify(&sensor, 100);
+  CHECK(AD013_TestRun(&sensor) < 0);
+  sim.place(8);
+
+  AD013_SubmitIdentify(&sensor, 2000);
+  CHECK_EQ(AD013_TestRun(&sensor), 21);
+  AD013_GetSearchStats(&stats);
+  CHECK_EQ(stats.suppressed, 0);
+  CHECK_EQ(sim.calls[0x02], 2);
+}
+
+AD013_TEST(blocking_search_loop_is_answered) {
+
+  AD013_Sim sim;
+  AD013_SearchResult result;
+  AD013_SearchStats stats;
+  int matches = 0;
+
+  sim.store(20, 7);
+  sim.place(7);
+
+  // Same finger until it is lifted (a loop on the blocking call)
+  for (int i = 0; i < 10; i++) {
+    if (i == 5) sim.lift();
+    if (AD013_SearchTemplate(sim, 500, 50, false, &result) != 20) break;
+    matches++;
+    AD013_HostAdvance(100000);
+  }
+
+  CHECK_EQ(matches, 5);
+  CHECK_EQ(sim.calls[0x02], 1);
+  CHECK_EQ(result.templateId, -1);
+  AD013_GetSearchStats(&stats);
+  CHECK_EQ(stats.suppressed, 4);
+}
+
+// Puts the sensor to sleep (no finger on)
+static void Sleep(AD013_Sensor * sensor, AD013_Sim & sim) {
+  CHECK_EQ(AD013_SubmitSleep(sensor), 1);
+  CHECK_EQ(AD013_TestRun(sensor), 1);
+  AD013_HostAdvance(10000);
+  CHECK(sim.asleep);
+}
+
+AD013_TEST(identify_wakes_the_sensor) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  AttachTouch(&sensor, sim);
+  sim.store(20, 7);
+  Sleep(&sensor, sim);
+
+  sim.placeAt(AD013_HostNow() + 300000, 7);
+  AD013_SubmitIdentify(&sensor, 2000);
+  CHECK_EQ(AD013_TestRun(&sensor), 20);
+  CHECK(!sim.asleep);
+  CHECK(sensor.wakeLatency >= 60);
+
+  DetachTouch(&sensor);
+}
+
+AD013_TEST(verify_wakes_before_loading_the_template) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  AttachTouch(&sensor, sim);
+  sim.store(20, 7);
+  Sleep(&sensor, sim);
+
+  // Nothing is sent to the sleeping sensor before the touch
+  sim.onReply = [&sim](uint8_t code, int status) {
+    (void) status;
+    if (code == 0x07) CHECK(!sim.asleep);
+  };
+  unsigned long lost = sim.lost;
+  AD013_HostAfter(300000, [&sim, &lost]() {
+    CHECK_EQ(sim.lost, lost);
+    sim.place(7);
+  });
+
+  AD013_SubmitVerify(&sensor, 20, 2000);
+  CHECK_EQ(AD013_TestRun(&sensor), 20);
+  CHECK_EQ(sim.calls[0x07], 1);
+
+  DetachTouch(&sensor);
+}
+
+AD013_TEST(enroll_wakes_before_reading_the_index) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  AttachTouch(&sensor, sim);
+  Sleep(&sensor, sim);
+  AD013_IndexInvalidate(&sensor);
+
+  // Index read once awake, then five presses
+  sim.placeAt(AD013_HostNow() + 200000, 9);
+  sim.onReply = [&sim](uint8_t code, int status) {
+    if (code != 0x02 || status != 0) return;
+    sim.liftAt(AD013_HostNow() + 200000);
+    sim.placeAt(AD013_HostNow() + 600000, 9);
+  };
+
+  AD013_SubmitEnroll(&sensor, false, -1, 20000);
+  CHECK_EQ(AD013_TestRun(&sensor), 20);
+  CHECK_EQ(sim.calls[0x1F], 1);
+  CHECK_EQ(sim.fingerAt(20), 9);
+
+  DetachTouch(&sensor);
+}
+
+AD013_TEST(command_times_out_while_asleep) {
+
+  AD013_Sim sim;
+  AD013_Sensor sensor;
+
+  AttachTouch(&sensor, sim);
+  Sleep(&sensor, sim);
+
+  unsigned long lost = sim.lost;
+  unsigned long long t0 = AD013_HostNow();
+  AD013_SubmitLoadIndex(&sensor);
+  CHECK_EQ(AD013_TestRun(&sensor), AD013_TIMEOUT);
+  CHECK(AD013_HostNow() - t0 >= (AD013_WAKE_TIMEOUT - 1) * 1000UL);
+  CHECK_EQ(sim.lost, lost);
+  CHECK_EQ(sim.calls[0x1F], 0);
+
+  // Already asleep: nothing to send
+  CHECK_EQ(AD013_SubmitSleep(&sensor), 1);
+  CHECK_EQ(AD013_TestRun(&sensor), 1);
+  CHECK_EQ(sim.calls[0x33], 1);
+
+  DetachTouch(&sensor);
+}
+
+AD013_TEST_MAIN()
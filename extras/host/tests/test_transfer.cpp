@@ -0,0 +1,103 @@
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Host Tests - Image Upload
+// ================================================
+
+#include "ad013_test.h"
+
+#include <unistd.h>
+
+#define FINGER   9
+
+// PS_UpImage sends the last captured image
+static void Capture(AD013_Sim & sim) {
+  AD013_Sensor sensor;
+
+  sim.place(FINGER);
+  AD013_TestAttach(&sensor, sim);
+  AD013_SubmitCommand(&sensor, 0x01);
+  CHECK_EQ(AD013_TestRun(&sensor), 0);
+}
+
+// Uploads the image into a mapped file, returns the file content
+static int Upload(AD013_Sim & sim, std::vector<uint8_t> & file, AD013_TransferStats * stats) {
+
+  AD013_MmapSink sink;
+  AD013_MmapSource source;
+  char path[] = "/tmp/ad013_image_XXXXXX";
+  int fd = mkstemp(path);
+  int ret = -1;
+
+  CHECK(fd >= 0);
+  close(fd);
+
+  CHECK_EQ(AD013_MmapSinkOpen(&sink, path, 2 * sim.imageSize), 1);
+  ret = AD013_UploadImage(sim, sim.imageSize, AD013_MmapSinkWrite, &sink, stats);
+  CHECK_EQ(AD013_MmapSinkClose(&sink), 1);
+
+  // The file is truncated to the bytes written
+  CHECK_EQ(AD013_MmapSourceOpen(&source, path), 1);
+  file.resize(source.size);
+  if (source.size) CHECK_EQ(AD013_MmapSourceRead(&source, &file[0], source.size), (int) source.size);
+  CHECK_EQ(AD013_MmapSourceClose(&source), 1);
+  unlink(path);
+
+  return ret;
+}
+
+AD013_TEST(image_upload_into_a_mapped_file) {
+
+  AD013_Sim sim;
+  AD013_TransferStats stats;
+  std::vector<uint8_t> file, image(sim.imageSize);
+
+  Capture(sim);
+  CHECK_EQ(Upload(sim, file, &stats), sim.imageSize);
+  CHECK_EQ(stats.packets, sim.imageSize / sim.packetSize);
+  CHECK_EQ(stats.resyncs, 0);
+
+  AD013_Sim::templateOf(FINGER + 0x10000, &image[0], sim.imageSize);
+  CHECK(file == image);
+}
+
+AD013_TEST(corrupted_packet_is_zero_filled_and_reported) {
+
+  AD013_Sim sim;
+  AD013_TransferStats stats;
+  std::vector<uint8_t> file, image(sim.imageSize);
+
+  Capture(sim);
+  sim.fault(AD013_SIM_FAULT_BAD_SUM, 1, AD013_SIM_DATA, 3);
+  CHECK_EQ(Upload(sim, file, &stats), AD013_PARTIAL);
+  CHECK_EQ(stats.bytes, sim.imageSize);
+  CHECK_EQ(stats.resyncs, 1);
+
+  // Same layout, packet 3 is zeros
+  AD013_Sim::templateOf(FINGER + 0x10000, &image[0], sim.imageSize);
+  memset(&image[3 * sim.packetSize], 0, sim.packetSize);
+  CHECK(file == image);
+}
+
+AD013_TEST(corrupted_last_packet_ends_the_image) {
+
+  AD013_Sim sim;
+  AD013_TransferStats stats;
+  std::vector<uint8_t> file, image(sim.imageSize);
+  int last = sim.imageSize / sim.packetSize - 1;
+
+  // Its end flag is lost too, the image size completes it
+  Capture(sim);
+  sim.fault(AD013_SIM_FAULT_BAD_SUM, 1, AD013_SIM_DATA, last);
+  CHECK_EQ(Upload(sim, file, &stats), AD013_PARTIAL);
+  CHECK_EQ(stats.bytes, sim.imageSize);
+  CHECK_EQ(stats.resyncs, 1);
+
+  AD013_Sim::templateOf(FINGER + 0x10000, &image[0], sim.imageSize);
+  memset(&image[last * sim.packetSize], 0, sim.packetSize);
+  CHECK(file == image);
+}
+
+AD013_TEST_MAIN()